@@ -1,4 +1,5 @@
 #include "async_grpc.hpp"
+#include <algorithm>
 
 namespace async_grpc {
 
@@ -19,6 +20,16 @@ namespace async_grpc {
     return m_cq.get();
   }
 
+  static void ResumeTag(void* tag, bool ok)
+  {
+    auto* job = reinterpret_cast<SuspendedJob*>(tag);
+    job->ok = ok;
+    if (job->rendezvous.exchange(true, std::memory_order_acq_rel)) {
+      assert(job->job);
+      async_lib::Resume(job->job);
+    }
+  }
+
   bool Tick(grpc::CompletionQueue* cq)
   {
     bool ok = false;
@@ -26,15 +37,46 @@ namespace async_grpc {
     if (!cq->Next(&tag, &ok)) {
       return false;
     }
-    auto* job = reinterpret_cast<SuspendedJob*>(tag);
-    job->ok = ok;
-    assert(job->job);
-    async_lib::Resume(job->job);
+    ResumeTag(tag, ok);
     return true;
   }
-  
-  std::jthread SpawnExecutorThread(grpc::CompletionQueue* cq) {
-    return std::jthread([cq]() { while (Tick(cq)) {} });
+
+  bool PollTick(grpc::CompletionQueue* cq, const PollingOptions& options)
+  {
+    if (options.spinBudget.count() <= 0) {
+      return Tick(cq);
+    }
+    const gpr_timespec now = gpr_time_0(GPR_CLOCK_MONOTONIC);
+    const auto spinUntil = std::chrono::steady_clock::now() + options.spinBudget;
+    const size_t batchSize = std::max<size_t>(options.batchSize, 1);
+    while (true) {
+      size_t drained = 0;
+      while (drained < batchSize) {
+        bool ok = false;
+        void* tag = nullptr;
+        auto status = cq->AsyncNext(&tag, &ok, now);
+        if (status == grpc::CompletionQueue::SHUTDOWN) {
+          return false;
+        }
+        if (status == grpc::CompletionQueue::TIMEOUT) {
+          break;
+        }
+        ResumeTag(tag, ok);
+        ++drained;
+      }
+      if (drained > 0) {
+        // Got work, the spin budget starts over on the next call
+        return true;
+      }
+      if (std::chrono::steady_clock::now() >= spinUntil) {
+        return Tick(cq);
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  std::jthread SpawnExecutorThread(grpc::CompletionQueue* cq, const PollingOptions& options) {
+    return std::jthread([cq, options]() { while (PollTick(cq, options)) {} });
   }
 
   void CompletionQueueExecutor::Shutdown()
@@ -47,4 +89,28 @@ namespace async_grpc {
   void CompletionQueueExecutor::Spawn(const Job& job) {
     async_lib::Resume(job);
   }
+
+  void Event::Set()
+  {
+    auto lock = std::unique_lock(m_mutex);
+    if (m_waiting) {
+      // Completes the alarm right away
+      m_alarm.Cancel();
+      m_waiting = false;
+    } else {
+      m_set = true;
+    }
+  }
+
+  void Event::Arm(grpc::CompletionQueue* cq, void* tag)
+  {
+    auto lock = std::unique_lock(m_mutex);
+    if (m_set) {
+      m_set = false;
+      m_alarm.Set(cq, gpr_time_0(GPR_CLOCK_MONOTONIC), tag);
+      return;
+    }
+    m_alarm.Set(cq, gpr_inf_future(GPR_CLOCK_MONOTONIC), tag);
+    m_waiting = true;
+  }
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <thread>
+#include <chrono>
+#include <mutex>
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/alarm.h>
 #include <async_lib/async_lib.hpp>
@@ -43,23 +46,35 @@ namespace async_grpc {
     std::unique_ptr<grpc::CompletionQueue> m_cq;
   };
 
+  // Opt-in busy polling of the completion queue, trading CPU for latency by avoiding a wakeup on every completion
+  struct PollingOptions {
+    // How long a thread keeps spinning on an empty queue before blocking on it, 0 disables polling
+    std::chrono::microseconds spinBudget{ 0 };
+    // Maximum amount of completions drained in one pass before checking the spin budget again
+    size_t batchSize = 16;
+  };
+
   bool Tick(grpc::CompletionQueue* cq);
 
-  std::jthread SpawnExecutorThread(grpc::CompletionQueue* cq);
+  // Spins on the queue for at most options.spinBudget, draining completions in batches, then falls back to a blocking Tick.
+  // Returns false once the queue is shut down and drained
+  bool PollTick(grpc::CompletionQueue* cq, const PollingOptions& options);
+
+  std::jthread SpawnExecutorThread(grpc::CompletionQueue* cq, const PollingOptions& options = {});
 
   template<std::derived_from<CompletionQueueExecutor> TExecutor>
   class ExecutorThreads {
   public:
-    explicit ExecutorThreads(size_t threadCounts)
-      : ExecutorThreads(TExecutor{}, threadCounts)
+    explicit ExecutorThreads(size_t threadCounts, const PollingOptions& polling = {})
+      : ExecutorThreads(TExecutor{}, threadCounts, polling)
     {}
 
-    ExecutorThreads(TExecutor executor, size_t threadCounts)
+    ExecutorThreads(TExecutor executor, size_t threadCounts, const PollingOptions& polling = {})
       : m_executor(std::move(executor))
     {
       m_threads.reserve(threadCounts);
       for (size_t i = 0; i < threadCounts; ++i) {
-        m_threads.push_back(SpawnExecutorThread(m_executor.GetCq()));
+        m_threads.push_back(SpawnExecutorThread(m_executor.GetCq(), polling));
       }
     }
 
@@ -80,8 +95,19 @@ namespace async_grpc {
 
 
   struct SuspendedJob {
+    SuspendedJob() = default;
+
+    // Only ever moved before getting suspended
+    SuspendedJob(SuspendedJob&& other) noexcept
+      : job(other.job)
+      , ok(other.ok)
+    {}
+
     Job job;
     bool ok = false;
+    // Set by whichever comes first of the awaiter being done suspending and the completion queue returning the tag,
+    // the other one resumes the job
+    std::atomic<bool> rendezvous{ false };
   };
 
   struct AwaitData {
@@ -98,10 +124,12 @@ namespace async_grpc {
       : m_func(std::move(func))
     {}
 
+    CompletionQueueAwaitable(CompletionQueueAwaitable&&) = default;
+
     bool await_ready() { return false; }
 
     template<std::derived_from<PromiseBase> TPromise>
-    void await_suspend(std::coroutine_handle<TPromise> handle) {
+    bool await_suspend(std::coroutine_handle<TPromise> handle) {
       m_suspended = true;
       m_job.job = Job(handle);
       auto data = AwaitData{ m_job.job.promise->executor->GetCq(), &m_job };
@@ -110,6 +138,8 @@ namespace async_grpc {
       } else {
         m_result = m_func(data);
       }
+      // The operation may already be complete, in which case we carry on ourselves
+      return !m_job.rendezvous.exchange(true, std::memory_order_acq_rel);
     }
 
     auto await_resume() {
@@ -173,4 +203,30 @@ namespace async_grpc {
     grpc::Alarm m_alarm;
   };
 
+  // Lets a coroutine wait for another coroutine or thread to signal it. A Set while nobody waits isn't lost, the next
+  // Wait returns right away, and several Set before a Wait only resume it once. A single coroutine waits at a time
+  class Event {
+  public:
+    Event() = default;
+    Event(const Event&) = delete;
+    Event& operator=(const Event&) = delete;
+
+    // The coroutine is resumed on its executor's completion queue
+    auto Wait() {
+      return CompletionQueueAwaitable([this](const AwaitData& data) {
+        Arm(data.cq, data.tag);
+      });
+    }
+
+    void Set();
+
+  private:
+    void Arm(grpc::CompletionQueue* cq, void* tag);
+
+    std::mutex m_mutex;
+    bool m_set = false;
+    bool m_waiting = false;
+    grpc::Alarm m_alarm;
+  };
+
 }
@@ -140,7 +140,7 @@ namespace async_grpc {
     }
 
     auto Write(const TRequest& msg, grpc::WriteOptions options) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      return CompletionQueueAwaitable([&, options](const AwaitData& data) {
         m_writer->Write(msg, options, data.tag);
       });
     }
@@ -220,7 +220,7 @@ namespace async_grpc {
     }
 
     auto Write(const TRequest& msg, grpc::WriteOptions options) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      return CompletionQueueAwaitable([&, options](const AwaitData& data) {
         m_readerWriter->Write(msg, options, data.tag);
       });
     }
@@ -0,0 +1,114 @@
+#include "metrics.hpp"
+
+namespace async_grpc {
+
+  struct MethodMetrics::Shard {
+    std::atomic<uint64_t> calls{ 0 };
+    std::atomic<uint64_t> done{ 0 };
+    std::atomic<uint64_t> messagesIn{ 0 };
+    std::atomic<uint64_t> bytesIn{ 0 };
+    std::atomic<uint64_t> messagesOut{ 0 };
+    std::atomic<uint64_t> bytesOut{ 0 };
+    std::array<std::atomic<uint64_t>, utils::Histogram::BucketCount> handlerDurationNs{};
+  };
+
+  static size_t LocalShardIndex() {
+    static std::atomic<size_t> nextIndex{ 0 };
+    thread_local size_t index = nextIndex++ % MethodMetrics::MaxShards;
+    return index;
+  }
+
+  static uint64_t ToNs(MethodMetrics::clock::duration duration) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+  }
+
+  static void Add(std::atomic<uint64_t>& counter, uint64_t value) {
+    // More than one thread may share a shard once there are more than MaxShards threads, hence the fetch_add
+    counter.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  MethodMetrics::MethodMetrics(std::string method)
+    : m_method(std::move(method))
+  {}
+
+  MethodMetrics::~MethodMetrics() {
+    for (auto& shard : m_shards) {
+      delete shard.load();
+    }
+  }
+
+  MethodMetrics::Shard& MethodMetrics::LocalShard() {
+    auto& slot = m_shards[LocalShardIndex()];
+    Shard* shard = slot.load(std::memory_order_acquire);
+    if (!shard) {
+      auto created = std::make_unique<Shard>();
+      if (slot.compare_exchange_strong(shard, created.get(), std::memory_order_acq_rel)) {
+        shard = created.release();
+      }
+    }
+    return *shard;
+  }
+
+  void MethodMetrics::OnCallStarted() {
+    Add(LocalShard().calls, 1);
+  }
+
+  void MethodMetrics::OnHandlerDone(clock::duration duration) {
+    Shard& shard = LocalShard();
+    Add(shard.handlerDurationNs[utils::Histogram::BucketIndex(ToNs(duration))], 1);
+    Add(shard.done, 1);
+  }
+
+  void MethodMetrics::OnMessageIn(size_t bytes) {
+    Shard& shard = LocalShard();
+    Add(shard.messagesIn, 1);
+    Add(shard.bytesIn, bytes);
+  }
+
+  void MethodMetrics::OnMessageOut(size_t bytes) {
+    Shard& shard = LocalShard();
+    Add(shard.messagesOut, 1);
+    Add(shard.bytesOut, bytes);
+  }
+
+  MethodMetricsSnapshot MethodMetrics::Snapshot() const {
+    MethodMetricsSnapshot snapshot;
+    snapshot.method = m_method;
+    uint64_t done = 0;
+    for (const auto& slot : m_shards) {
+      const Shard* shard = slot.load(std::memory_order_acquire);
+      if (!shard) {
+        continue;
+      }
+      snapshot.calls += shard->calls.load(std::memory_order_relaxed);
+      done += shard->done.load(std::memory_order_relaxed);
+      snapshot.messagesIn += shard->messagesIn.load(std::memory_order_relaxed);
+      snapshot.bytesIn += shard->bytesIn.load(std::memory_order_relaxed);
+      snapshot.messagesOut += shard->messagesOut.load(std::memory_order_relaxed);
+      snapshot.bytesOut += shard->bytesOut.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < utils::Histogram::BucketCount; ++i) {
+        snapshot.handlerDurationNs.RecordBucket(i, shard->handlerDurationNs[i].load(std::memory_order_relaxed));
+      }
+    }
+    // Counters are read one after the other, done may have moved past calls in between
+    snapshot.inFlight = snapshot.calls > done ? snapshot.calls - done : 0;
+    return snapshot;
+  }
+
+  MethodMetrics& ServerMetrics::AddMethod(std::string method) {
+    auto lock = std::unique_lock(m_lock);
+    return *m_methods.emplace_back(std::make_unique<MethodMetrics>(std::move(method)));
+  }
+
+  std::vector<MethodMetricsSnapshot> ServerMetrics::Snapshot() const {
+    std::vector<MethodMetricsSnapshot> snapshots;
+    auto lock = std::unique_lock(m_lock);
+    snapshots.reserve(m_methods.size());
+    for (const auto& method : m_methods) {
+      snapshots.push_back(method->Snapshot());
+    }
+    return snapshots;
+  }
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utils/histogram.hpp>
+
+namespace async_grpc {
+
+  struct MethodMetricsSnapshot {
+    std::string method;
+    uint64_t calls = 0;
+    uint64_t inFlight = 0;
+    uint64_t messagesIn = 0;
+    uint64_t bytesIn = 0;
+    uint64_t messagesOut = 0;
+    uint64_t bytesOut = 0;
+    utils::Histogram handlerDurationNs;
+  };
+
+  // Per method counters. Each recording thread gets its own shard of relaxed atomics so recording never locks nor contends,
+  // shards are only summed up when taking a snapshot.
+  class MethodMetrics {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t MaxShards = 64;
+
+    explicit MethodMetrics(std::string method);
+    ~MethodMetrics();
+
+    void OnCallStarted();
+    void OnHandlerDone(clock::duration duration);
+    void OnMessageIn(size_t bytes);
+    void OnMessageOut(size_t bytes);
+
+    MethodMetricsSnapshot Snapshot() const;
+
+  private:
+    MethodMetrics(const MethodMetrics&) = delete;
+    MethodMetrics(MethodMetrics&&) = delete;
+    MethodMetrics& operator=(const MethodMetrics&) = delete;
+    MethodMetrics& operator=(MethodMetrics&&) = delete;
+
+    struct Shard;
+
+    Shard& LocalShard();
+
+    std::array<std::atomic<Shard*>, MaxShards> m_shards{};
+    std::string m_method;
+  };
+
+  class ServerMetrics {
+  public:
+    MethodMetrics& AddMethod(std::string method);
+
+    std::vector<MethodMetricsSnapshot> Snapshot() const;
+
+  private:
+    mutable std::mutex m_lock;
+    std::vector<std::unique_ptr<MethodMetrics>> m_methods;
+  };
+
+}
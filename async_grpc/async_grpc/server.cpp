@@ -20,9 +20,12 @@ namespace async_grpc {
     for (IServiceImpl& service : options.services) {
       builder.RegisterService(service.GetGrpcService());
     }
+    if (options.collectMetrics) {
+      m_metrics = std::make_unique<ServerMetrics>();
+    }
     m_executors.reserve(options.executorCount);
     for (size_t i = 0; i < options.executorCount; ++i) {
-      m_executors.emplace_back(builder.AddCompletionQueue(), options.threadsPerExecutor);
+      m_executors.emplace_back(builder.AddCompletionQueue(), options.threadsPerExecutor, options.polling);
     }
     if (options.options) {
       builder.SetOption(std::move(options.options));
@@ -38,11 +41,29 @@ namespace async_grpc {
     Shutdown();
   }
 
+  std::shared_ptr<grpc::Channel> Server::InProcessChannel(const grpc::ChannelArguments& args)
+  {
+    return m_server->InProcessChannel(args);
+  }
+
+  std::vector<MethodMetricsSnapshot> Server::CollectMetrics() const
+  {
+    if (!m_metrics) {
+      return {};
+    }
+    return m_metrics->Snapshot();
+  }
+
   void Server::Shutdown()
   {
     m_server->Shutdown();
   }
 
+  MethodMetrics* Server::AddMethodMetrics(std::string_view method)
+  {
+    return m_metrics ? &m_metrics->AddMethod(std::string(method)) : nullptr;
+  }
+
   ServerExecutor& Server::SelectNextExecutor()
   {
     // Round Robin on all executors, more algorithms possible
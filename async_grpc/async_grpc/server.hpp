@@ -5,6 +5,7 @@
 #include <vector>
 #include <grpcpp/grpcpp.h>
 #include "async_grpc.hpp"
+#include "metrics.hpp"
 
 namespace async_grpc {
   class Server;
@@ -31,11 +32,66 @@ namespace async_grpc {
     std::vector<std::reference_wrapper<IServiceImpl>> services;
     size_t executorCount = 2;
     size_t threadsPerExecutor = 2;
+    PollingOptions polling;
+    // Per method call counts, latencies and bytes, see Server::CollectMetrics
+    bool collectMetrics = false;
     std::unique_ptr<grpc::ServerBuilderOption> options;
   };
 
+  // Calls func with the result of the awaitable before handing it back
+  template<typename TAwaitable, typename TFunc>
+  class OnResumeAwaitable {
+  public:
+    OnResumeAwaitable(TAwaitable awaitable, TFunc func)
+      : m_awaitable(std::move(awaitable))
+      , m_func(std::move(func))
+    {}
+
+    bool await_ready() { return m_awaitable.await_ready(); }
+
+    template<typename TPromise>
+    auto await_suspend(std::coroutine_handle<TPromise> handle) {
+      return m_awaitable.await_suspend(handle);
+    }
+
+    auto await_resume() {
+      auto result = m_awaitable.await_resume();
+      m_func(result);
+      return result;
+    }
+
+  private:
+    TAwaitable m_awaitable;
+    TFunc m_func;
+  };
+
   struct ServerContext {
     grpc::ServerContext context;
+    // Set by the server when collecting metrics
+    MethodMetrics* metrics = nullptr;
+
+    template<typename TMessage>
+    void RecordMessageIn(const TMessage& message) {
+      if (metrics) {
+        metrics->OnMessageIn(message.ByteSizeLong());
+      }
+    }
+
+    template<typename TMessage>
+    void RecordMessageOut(const TMessage& message) {
+      if (metrics) {
+        metrics->OnMessageOut(message.ByteSizeLong());
+      }
+    }
+
+    template<typename TAwaitable, typename TMessage>
+    auto RecordRead(TAwaitable awaitable, TMessage& message) {
+      return OnResumeAwaitable(std::move(awaitable), [this, &message](bool ok) {
+        if (ok) {
+          RecordMessageIn(message);
+        }
+      });
+    }
   };
 
   // Unary
@@ -59,6 +115,7 @@ namespace async_grpc {
     }
 
     auto Finish(const TResponse& response, const grpc::Status& status = grpc::Status::OK) {
+      RecordMessageOut(response);
       return CompletionQueueAwaitable([&](const AwaitData& data) {
         m_response.Finish(response, status, data.tag);
       });
@@ -95,9 +152,9 @@ namespace async_grpc {
     {}
 
     auto Read(TRequest& request) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      return RecordRead(CompletionQueueAwaitable([&](const AwaitData& data) {
         m_reader.Read(&request, data.tag);
-      });
+      }), request);
     }
 
     auto FinishWithError(const grpc::Status& status) {
@@ -107,6 +164,7 @@ namespace async_grpc {
     }
 
     auto Finish(const TResponse& response, const grpc::Status& status = grpc::Status::OK) {
+      RecordMessageOut(response);
       return CompletionQueueAwaitable([&](const AwaitData& data) {
         m_reader.Finish(response, status, data.tag);
       });
@@ -145,19 +203,22 @@ namespace async_grpc {
     TRequest request;
 
     auto Write(const TResponse& response) {
+      RecordMessageOut(response);
       return CompletionQueueAwaitable([&](const AwaitData& data) {
         m_writer.Write(response, data.tag);
       });
     }
 
     auto Write(const TResponse& response, grpc::WriteOptions options) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      RecordMessageOut(response);
+      return CompletionQueueAwaitable([&, options](const AwaitData& data) {
         m_writer.Write(response, options, data.tag);
       });
     }
 
     auto WriteAndFinish(const TResponse& response, grpc::WriteOptions options, const grpc::Status& status = grpc::Status::OK) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      RecordMessageOut(response);
+      return CompletionQueueAwaitable([&, options](const AwaitData& data) {
         m_writer.WriteAndFinish(response, options, status, data.tag);
       });
     }
@@ -199,25 +260,28 @@ namespace async_grpc {
     {}
 
     auto Read(TRequest& request) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      return RecordRead(CompletionQueueAwaitable([&](const AwaitData& data) {
         m_stream.Read(&request, data.tag);
-      });
+      }), request);
     }
 
     auto Write(const TResponse& response) {
+      RecordMessageOut(response);
       return CompletionQueueAwaitable([&](const AwaitData& data) {
         m_stream.Write(response, data.tag);
       });
     }
 
     auto Write(const TResponse& response, grpc::WriteOptions options) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      RecordMessageOut(response);
+      return CompletionQueueAwaitable([&, options](const AwaitData& data) {
         m_stream.Write(response, options, data.tag);
       });
     }
 
     auto WriteAndFinish(const TResponse& response, grpc::WriteOptions options, const grpc::Status& status = grpc::Status::OK) {
-      return CompletionQueueAwaitable([&](const AwaitData& data) {
+      RecordMessageOut(response);
+      return CompletionQueueAwaitable([&, options](const AwaitData& data) {
         m_stream.WriteAndFinish(response, options, status, data.tag);
       });
     }
@@ -246,7 +310,14 @@ namespace async_grpc {
 
   // ~Bidirectional Stream
 
-#define ASYNC_GRPC_SERVER_LISTEN_FUNC(service, rpc) &service::AsyncService::Request ## rpc
+  // Listen function along with the name of its rpc
+  template<typename TFunc>
+  struct ListenFunc {
+    TFunc func;
+    std::string_view name;
+  };
+
+#define ASYNC_GRPC_SERVER_LISTEN_FUNC(service, rpc) ::async_grpc::ListenFunc{ &service::AsyncService::Request ## rpc, #rpc }
 
   class Server {
   public:
@@ -257,28 +328,34 @@ namespace async_grpc {
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerUnaryHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    void StartListeningUnary(TService& service, TUnaryListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      async_lib::Spawn(SelectNextExecutor(), ListenUnary(service, listenFunc, std::move(handler)));
+    void StartListeningUnary(TService& service, TUnaryListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, std::string_view method = {}) {
+      async_lib::Spawn(SelectNextExecutor(), ListenUnary(service, listenFunc, std::move(handler), AddMethodMetrics(method)));
     }
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerClientStreamHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    void StartListeningClientStream(TService& service, TClientStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      async_lib::Spawn(SelectNextExecutor(), ListenClientStream(service, listenFunc, std::move(handler)));
+    void StartListeningClientStream(TService& service, TClientStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, std::string_view method = {}) {
+      async_lib::Spawn(SelectNextExecutor(), ListenClientStream(service, listenFunc, std::move(handler), AddMethodMetrics(method)));
     }
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerServerStreamHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    void StartListeningServerStream(TService& service, TServerStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      async_lib::Spawn(SelectNextExecutor(), ListenServerStream(service, listenFunc, std::move(handler)));
+    void StartListeningServerStream(TService& service, TServerStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, std::string_view method = {}) {
+      async_lib::Spawn(SelectNextExecutor(), ListenServerStream(service, listenFunc, std::move(handler), AddMethodMetrics(method)));
     }
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerBidirectionalStreamHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    void StartListeningBidirectionalStream(TService& service, TBidirectionalStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      async_lib::Spawn(SelectNextExecutor(), ListenBidirectionalStream(service, listenFunc, std::move(handler)));
+    void StartListeningBidirectionalStream(TService& service, TBidirectionalStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, std::string_view method = {}) {
+      async_lib::Spawn(SelectNextExecutor(), ListenBidirectionalStream(service, listenFunc, std::move(handler), AddMethodMetrics(method)));
     }
 
+    // Channel to this server that doesn't go through the network stack
+    std::shared_ptr<grpc::Channel> InProcessChannel(const grpc::ChannelArguments& args = {});
+
+    // Empty if ServerOptions::collectMetrics wasn't set
+    std::vector<MethodMetricsSnapshot> CollectMetrics() const;
+
     // Will stop listening and will wait for all pending calls to complete. Use Shutdown(deadline) to forcibly cancel pending calls after some time
     void Shutdown();
 
@@ -290,62 +367,86 @@ namespace async_grpc {
   private:
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerUnaryHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    Task<> ListenUnary(TService& service, TUnaryListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
+    Task<> ListenUnary(TService& service, TUnaryListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, MethodMetrics* metrics) {
       while (true) {
         auto& executor = SelectNextExecutor();
         auto context = std::make_unique<ServerUnaryContext<TRequest, TResponse>>();
         if (!co_await context->Listen(executor, service, listenFunc)) {
           break;
         }
-        async_lib::Spawn(executor, handler(std::move(context)));
+        SpawnHandler(executor, handler, std::move(context), metrics);
       }
     }
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerClientStreamHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    Task<> ListenClientStream(TService& service, TClientStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
+    Task<> ListenClientStream(TService& service, TClientStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, MethodMetrics* metrics) {
       while (true) {
         auto& executor = SelectNextExecutor();
         auto context = std::make_unique<ServerClientStreamContext<TRequest, TResponse>>();
         if (!co_await context->Listen(executor, service, listenFunc)) {
           break;
         }
-        async_lib::Spawn(executor, handler(std::move(context)));
+        SpawnHandler(executor, handler, std::move(context), metrics);
       }
     }
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerServerStreamHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    Task<> ListenServerStream(TService& service, TServerStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
+    Task<> ListenServerStream(TService& service, TServerStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, MethodMetrics* metrics) {
       while (true) {
         auto& executor = SelectNextExecutor();
         auto context = std::make_unique<ServerServerStreamContext<TRequest, TResponse>>();
         if (!co_await context->Listen(executor, service, listenFunc)) {
           break;
         }
-        async_lib::Spawn(executor, handler(std::move(context)));
+        SpawnHandler(executor, handler, std::move(context), metrics);
       }
     }
 
     template<typename TRequest, typename TResponse, typename TService, typename TServiceBase, ServerBidirectionalStreamHandlerConcept<TRequest, TResponse> THandler>
       requires std::derived_from<TService, TServiceBase>
-    Task<> ListenBidirectionalStream(TService& service, TBidirectionalStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
+    Task<> ListenBidirectionalStream(TService& service, TBidirectionalStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler, MethodMetrics* metrics) {
       while (true) {
         auto& executor = SelectNextExecutor();
         auto context = std::make_unique<ServerBidirectionalStreamContext<TRequest, TResponse>>();
         if (!co_await context->Listen(executor, service, listenFunc)) {
           break;
         }
+        SpawnHandler(executor, handler, std::move(context), metrics);
+      }
+    }
+
+    // The handler starts right away on the thread that accepted the call, there's no queue in between worth timing
+    template<typename THandler, typename TContext>
+    static void SpawnHandler(ServerExecutor& executor, THandler& handler, std::unique_ptr<TContext>&& context, MethodMetrics* metrics) {
+      if (!metrics) {
         async_lib::Spawn(executor, handler(std::move(context)));
+        return;
+      }
+      context->metrics = metrics;
+      metrics->OnCallStarted();
+      if constexpr (requires { context->request; }) {
+        context->RecordMessageIn(context->request);
       }
+      async_lib::Spawn(executor, MeasureHandler(*metrics, handler(std::move(context))));
     }
 
+    static Task<> MeasureHandler(MethodMetrics& metrics, Task<> handler) {
+      auto start = MethodMetrics::clock::now();
+      co_await std::move(handler);
+      metrics.OnHandlerDone(MethodMetrics::clock::now() - start);
+    }
+
+    MethodMetrics* AddMethodMetrics(std::string_view method);
+
     ServerExecutor& SelectNextExecutor();
 
     std::unique_ptr<grpc::Server> m_server;
 
     std::vector<ExecutorThreads<ServerExecutor>> m_executors;
     std::atomic<size_t> m_nextExecutor = 0;
+    std::unique_ptr<ServerMetrics> m_metrics;
   };
 
   template<ServiceConcept TService>
@@ -360,26 +461,34 @@ namespace async_grpc {
     }
 
     template<typename TRequest, typename TResponse, typename TServiceBase, ServerUnaryHandlerConcept<TRequest, TResponse> THandler>
-    void StartListeningUnary(Server& server, TUnaryListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      server.StartListeningUnary(m_service, listenFunc, std::move(handler));
+    void StartListeningUnary(Server& server, ListenFunc<TUnaryListenFunc<TServiceBase, TRequest, TResponse>> listenFunc, THandler handler) {
+      server.StartListeningUnary(m_service, listenFunc.func, std::move(handler), FullMethodName(listenFunc.name));
     }
 
     template<typename TRequest, typename TResponse, typename TServiceBase, ServerClientStreamHandlerConcept<TRequest, TResponse> THandler>
-    void StartListeningClientStream(Server& server, TClientStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      server.StartListeningClientStream(m_service, listenFunc, std::move(handler));
+    void StartListeningClientStream(Server& server, ListenFunc<TClientStreamListenFunc<TServiceBase, TRequest, TResponse>> listenFunc, THandler handler) {
+      server.StartListeningClientStream(m_service, listenFunc.func, std::move(handler), FullMethodName(listenFunc.name));
     }
 
     template<typename TRequest, typename TResponse, typename TServiceBase, ServerServerStreamHandlerConcept<TRequest, TResponse> THandler>
-    void StartListeningServerStream(Server& server, TServerStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      server.StartListeningServerStream(m_service, listenFunc, std::move(handler));
+    void StartListeningServerStream(Server& server, ListenFunc<TServerStreamListenFunc<TServiceBase, TRequest, TResponse>> listenFunc, THandler handler) {
+      server.StartListeningServerStream(m_service, listenFunc.func, std::move(handler), FullMethodName(listenFunc.name));
     }
 
     template<typename TRequest, typename TResponse, typename TServiceBase, ServerBidirectionalStreamHandlerConcept<TRequest, TResponse> THandler>
-    void StartListeningBidirectionalStream(Server& server, TBidirectionalStreamListenFunc<TServiceBase, TRequest, TResponse> listenFunc, THandler handler) {
-      server.StartListeningBidirectionalStream(m_service, listenFunc, std::move(handler));
+    void StartListeningBidirectionalStream(Server& server, ListenFunc<TBidirectionalStreamListenFunc<TServiceBase, TRequest, TResponse>> listenFunc, THandler handler) {
+      server.StartListeningBidirectionalStream(m_service, listenFunc.func, std::move(handler), FullMethodName(listenFunc.name));
     }
 
   private:
+    static std::string FullMethodName(std::string_view rpc) {
+      std::string name = "/";
+      name += TService::service_full_name();
+      name += '/';
+      name += rpc;
+      return name;
+    }
+
     BaseServiceImpl(const BaseServiceImpl&) = delete;
     BaseServiceImpl(BaseServiceImpl&&) = delete;
     BaseServiceImpl& operator=(const BaseServiceImpl&) = delete;
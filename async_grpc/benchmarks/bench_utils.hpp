@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <utils/histogram.hpp>
+
+namespace bench {
+
+  using clock = std::chrono::steady_clock;
+
+  inline uint64_t ElapsedNs(clock::time_point start, clock::time_point end = clock::now()) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+
+  // Process cpu time, note that MSVC's std::clock returns wall time instead
+  inline double CpuSeconds() {
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+  }
+
+  inline void PrintLatencyHeader(std::string_view firstColumn) {
+    std::cout << std::left << std::setw(28) << firstColumn << std::right
+      << std::setw(12) << "ops/s"
+      << std::setw(10) << "p50 us"
+      << std::setw(10) << "p90 us"
+      << std::setw(10) << "p99 us"
+      << std::setw(10) << "p99.9 us"
+      << std::setw(10) << "max us"
+      << std::setw(10) << "cpu" << std::endl;
+  }
+
+  // cpu is the amount of cores busy on average during the run
+  inline void PrintLatencyRow(std::string_view name, const utils::Histogram& latencies, double seconds, double cpu) {
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+      << std::setw(12) << static_cast<double>(latencies.Count()) / seconds
+      << std::setw(10) << us(latencies.Percentile(50))
+      << std::setw(10) << us(latencies.Percentile(90))
+      << std::setw(10) << us(latencies.Percentile(99))
+      << std::setw(10) << us(latencies.Percentile(99.9))
+      << std::setw(10) << us(latencies.Max())
+      << std::setw(10) << std::setprecision(2) << cpu << std::endl;
+  }
+
+}
@@ -0,0 +1,778 @@
+#include <latch>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include <async_grpc/client.hpp>
+#include <async_grpc/server.hpp>
+#include <protos/echo_service.grpc.pb.h>
+#include "bench_utils.hpp"
+
+// End to end calls against an in process server. For each kind of rpc the coroutine layer is compared to hand written
+// completion queue state machines doing the same work, both using a single completion queue thread on the client and
+// on the server, so that the difference is what the abstraction costs.
+// Latency is per call, except for bidi where it's per message round trip on a long lived stream.
+
+using EchoService = echo_service::EchoService;
+
+static constexpr uint32_t StreamLength = 8;
+static const std::string Payload(64, 'x');
+
+enum class Rpc {
+  Unary,
+  ClientStream,
+  ServerStream,
+  Bidi,
+};
+
+static std::string_view RpcName(Rpc rpc) {
+  switch (rpc) {
+  case Rpc::Unary: return "unary";
+  case Rpc::ClientStream: return "client_stream";
+  case Rpc::ServerStream: return "server_stream";
+  case Rpc::Bidi: return "bidi";
+  }
+  return {};
+}
+
+struct Result {
+  utils::Histogram latencies;
+  double seconds = 0;
+  double cpu = 0;
+};
+
+// startWorker(ops, latencies, done) launches one worker, done gets counted down once it's over
+template<typename TStart>
+static Result Measure(size_t ops, size_t concurrency, TStart startWorker) {
+  auto run = [&](size_t count, utils::Histogram& merged) {
+    std::vector<utils::Histogram> latencies(concurrency);
+    std::latch done(static_cast<std::ptrdiff_t>(concurrency));
+    for (size_t i = 0; i < concurrency; ++i) {
+      startWorker(count / concurrency, latencies[i], done);
+    }
+    done.wait();
+    for (const auto& histogram : latencies) {
+      merged.Merge(histogram);
+    }
+  };
+
+  utils::Histogram warmup;
+  run(ops / 10 + concurrency, warmup);
+
+  Result result;
+  auto cpuStart = bench::CpuSeconds();
+  auto start = bench::clock::now();
+  run(ops, result.latencies);
+  result.seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+  result.cpu = (bench::CpuSeconds() - cpuStart) / result.seconds;
+  return result;
+}
+
+// async_grpc
+
+class BenchEchoService : public async_grpc::BaseServiceImpl<EchoService> {
+public:
+  virtual void StartListening(async_grpc::Server& server) override {
+    StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, UnaryEcho), &UnaryEcho);
+    StartListeningClientStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, ClientStreamEcho), &ClientStreamEcho);
+    StartListeningServerStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, ServerStreamEcho), &ServerStreamEcho);
+    StartListeningBidirectionalStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, BidirectionalStreamEcho), &BidirectionalStreamEcho);
+  }
+
+private:
+  static async_grpc::Task<> UnaryEcho(std::unique_ptr<async_grpc::ServerUnaryContext<echo_service::UnaryEchoRequest, echo_service::UnaryEchoResponse>> context) {
+    echo_service::UnaryEchoResponse response;
+    response.set_message(std::move(*context->request.mutable_message()));
+    co_await context->Finish(response);
+  }
+
+  static async_grpc::Task<> ClientStreamEcho(std::unique_ptr<async_grpc::ServerClientStreamContext<echo_service::ClientStreamEchoRequest, echo_service::ClientStreamEchoResponse>> context) {
+    echo_service::ClientStreamEchoRequest request;
+    echo_service::ClientStreamEchoResponse response;
+    while (co_await context->Read(request)) {
+      response.add_messages(std::move(*request.mutable_message()));
+    }
+    co_await context->Finish(response);
+  }
+
+  static async_grpc::Task<> ServerStreamEcho(std::unique_ptr<async_grpc::ServerServerStreamContext<echo_service::ServerStreamEchoRequest, echo_service::ServerStreamEchoResponse>> context) {
+    echo_service::ServerStreamEchoResponse response;
+    response.set_message(std::move(*context->request.mutable_message()));
+    for (uint32_t n = 1; n <= context->request.count(); ++n) {
+      response.set_n(n);
+      if (!co_await context->Write(response)) {
+        break;
+      }
+    }
+    co_await context->Finish();
+  }
+
+  // Unlike the example server, echoes every message right away
+  static async_grpc::Task<> BidirectionalStreamEcho(std::unique_ptr<async_grpc::ServerBidirectionalStreamContext<echo_service::BidirectionalStreamEchoRequest, echo_service::BidirectionalStreamEchoResponse>> context) {
+    echo_service::BidirectionalStreamEchoRequest request;
+    echo_service::BidirectionalStreamEchoResponse response;
+    while (co_await context->Read(request)) {
+      response.set_message(std::move(*request.mutable_message()->mutable_message()));
+      if (!co_await context->Write(response)) {
+        break;
+      }
+    }
+    co_await context->Finish();
+  }
+};
+
+using AsyncClient = async_grpc::Client<EchoService>;
+
+static async_grpc::Task<bool> AsyncUnaryCall(AsyncClient& client) {
+  echo_service::UnaryEchoRequest request;
+  request.set_message(Payload);
+  echo_service::UnaryEchoResponse response;
+  grpc::ClientContext context;
+  grpc::Status status;
+  co_return co_await client.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(EchoService, UnaryEcho), context, request, response, status) && status.ok();
+}
+
+static async_grpc::Task<bool> AsyncClientStreamCall(AsyncClient& client) {
+  grpc::ClientContext context;
+  echo_service::ClientStreamEchoResponse response;
+  auto call = co_await client.CallClientStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(EchoService, ClientStreamEcho), context, response);
+  if (!call) {
+    co_return false;
+  }
+  echo_service::ClientStreamEchoRequest request;
+  request.set_message(Payload);
+  for (uint32_t i = 0; i < StreamLength; ++i) {
+    if (!co_await call->Write(request)) {
+      break;
+    }
+  }
+  co_await call->WritesDone();
+  grpc::Status status;
+  co_return co_await call->Finish(status) && status.ok() && response.messages_size() == StreamLength;
+}
+
+static async_grpc::Task<bool> AsyncServerStreamCall(AsyncClient& client) {
+  grpc::ClientContext context;
+  echo_service::ServerStreamEchoRequest request;
+  request.set_message(Payload);
+  request.set_count(StreamLength);
+  auto call = co_await client.CallServerStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(EchoService, ServerStreamEcho), context, request);
+  if (!call) {
+    co_return false;
+  }
+  echo_service::ServerStreamEchoResponse response;
+  uint32_t received = 0;
+  while (co_await call->Read(response)) {
+    ++received;
+  }
+  grpc::Status status;
+  co_return co_await call->Finish(status) && status.ok() && received == StreamLength;
+}
+
+static async_grpc::Task<> AsyncCallWorker(async_grpc::Task<bool>(*call)(AsyncClient&), AsyncClient& client, size_t ops, utils::Histogram& latencies, std::latch& done) {
+  for (size_t i = 0; i < ops; ++i) {
+    auto start = bench::clock::now();
+    if (!co_await call(client)) {
+      break;
+    }
+    latencies.Record(bench::ElapsedNs(start));
+  }
+  done.count_down();
+}
+
+static async_grpc::Task<> AsyncBidiWorker(AsyncClient& client, size_t ops, utils::Histogram& latencies, std::latch& done) {
+  grpc::ClientContext context;
+  auto call = co_await client.CallBidirectionalStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(EchoService, BidirectionalStreamEcho), context);
+  if (call) {
+    echo_service::BidirectionalStreamEchoRequest request;
+    request.mutable_message()->set_message(Payload);
+    echo_service::BidirectionalStreamEchoResponse response;
+    for (size_t i = 0; i < ops; ++i) {
+      auto start = bench::clock::now();
+      if (!co_await call->Write(request) || !co_await call->Read(response)) {
+        break;
+      }
+      latencies.Record(bench::ElapsedNs(start));
+    }
+    co_await call->WritesDone();
+    while (co_await call->Read(response)) {
+    }
+    grpc::Status status;
+    co_await call->Finish(status);
+  }
+  done.count_down();
+}
+
+static Result RunAsync(Rpc rpc, size_t ops, size_t concurrency) {
+  BenchEchoService service;
+  async_grpc::ServerOptions options;
+  options.services.push_back(service);
+  options.executorCount = 1;
+  options.threadsPerExecutor = 1;
+  async_grpc::Server server(std::move(options));
+
+  AsyncClient client(server.InProcessChannel());
+  async_grpc::ClientExecutorThreads executor(1);
+
+  auto result = Measure(ops, concurrency, [&](size_t count, utils::Histogram& latencies, std::latch& done) {
+    switch (rpc) {
+    case Rpc::Unary:
+      async_lib::Spawn(executor.GetExecutor(), AsyncCallWorker(&AsyncUnaryCall, client, count, latencies, done));
+      break;
+    case Rpc::ClientStream:
+      async_lib::Spawn(executor.GetExecutor(), AsyncCallWorker(&AsyncClientStreamCall, client, count, latencies, done));
+      break;
+    case Rpc::ServerStream:
+      async_lib::Spawn(executor.GetExecutor(), AsyncCallWorker(&AsyncServerStreamCall, client, count, latencies, done));
+      break;
+    case Rpc::Bidi:
+      async_lib::Spawn(executor.GetExecutor(), AsyncBidiWorker(client, count, latencies, done));
+      break;
+    }
+  });
+  server.Shutdown();
+  return result;
+}
+
+// Raw completion queue
+
+// Every tag is a state machine advanced by the thread polling the completion queue
+struct RawTag {
+  virtual ~RawTag() = default;
+  virtual void Proceed(bool ok) = 0;
+};
+
+static void PollRawTags(grpc::CompletionQueue& cq) {
+  void* tag = nullptr;
+  bool ok = false;
+  while (cq.Next(&tag, &ok)) {
+    static_cast<RawTag*>(tag)->Proceed(ok);
+  }
+}
+
+class RawServer {
+public:
+  RawServer() {
+    grpc::ServerBuilder builder;
+    builder.RegisterService(&m_service);
+    m_cq = builder.AddCompletionQueue();
+    m_server = builder.BuildAndStart();
+    new UnaryCall(*this);
+    new ClientStreamCall(*this);
+    new ServerStreamCall(*this);
+    new BidiCall(*this);
+    m_thread = std::thread([this]() { PollRawTags(*m_cq); });
+  }
+
+  ~RawServer() {
+    m_server->Shutdown();
+    m_cq->Shutdown();
+    m_thread.join();
+  }
+
+  std::shared_ptr<grpc::Channel> InProcessChannel() {
+    return m_server->InProcessChannel({});
+  }
+
+private:
+  // Each call listens for the next one once it gets a request
+  class UnaryCall : public RawTag {
+  public:
+    explicit UnaryCall(RawServer& server)
+      : m_server(server)
+      , m_writer(&m_context)
+    {
+      m_server.m_service.RequestUnaryEcho(&m_context, &m_request, &m_writer, m_server.m_cq.get(), m_server.m_cq.get(), this);
+    }
+
+    virtual void Proceed(bool ok) override {
+      if (!ok || m_finishing) {
+        delete this;
+        return;
+      }
+      new UnaryCall(m_server);
+      m_response.set_message(std::move(*m_request.mutable_message()));
+      m_finishing = true;
+      m_writer.Finish(m_response, grpc::Status::OK, this);
+    }
+
+  private:
+    RawServer& m_server;
+    grpc::ServerContext m_context;
+    echo_service::UnaryEchoRequest m_request;
+    echo_service::UnaryEchoResponse m_response;
+    grpc::ServerAsyncResponseWriter<echo_service::UnaryEchoResponse> m_writer;
+    bool m_finishing = false;
+  };
+
+  class ClientStreamCall : public RawTag {
+  public:
+    explicit ClientStreamCall(RawServer& server)
+      : m_server(server)
+      , m_reader(&m_context)
+    {
+      m_server.m_service.RequestClientStreamEcho(&m_context, &m_reader, m_server.m_cq.get(), m_server.m_cq.get(), this);
+    }
+
+    virtual void Proceed(bool ok) override {
+      switch (m_state) {
+      case State::Listening:
+        if (!ok) {
+          delete this;
+          return;
+        }
+        new ClientStreamCall(m_server);
+        m_state = State::Reading;
+        m_reader.Read(&m_request, this);
+        return;
+      case State::Reading:
+        if (ok) {
+          m_response.add_messages(std::move(*m_request.mutable_message()));
+          m_reader.Read(&m_request, this);
+          return;
+        }
+        m_state = State::Finishing;
+        m_reader.Finish(m_response, grpc::Status::OK, this);
+        return;
+      case State::Finishing:
+        delete this;
+        return;
+      }
+    }
+
+  private:
+    enum class State { Listening, Reading, Finishing };
+
+    RawServer& m_server;
+    grpc::ServerContext m_context;
+    echo_service::ClientStreamEchoRequest m_request;
+    echo_service::ClientStreamEchoResponse m_response;
+    grpc::ServerAsyncReader<echo_service::ClientStreamEchoResponse, echo_service::ClientStreamEchoRequest> m_reader;
+    State m_state = State::Listening;
+  };
+
+  class ServerStreamCall : public RawTag {
+  public:
+    explicit ServerStreamCall(RawServer& server)
+      : m_server(server)
+      , m_writer(&m_context)
+    {
+      m_server.m_service.RequestServerStreamEcho(&m_context, &m_request, &m_writer, m_server.m_cq.get(), m_server.m_cq.get(), this);
+    }
+
+    virtual void Proceed(bool ok) override {
+      switch (m_state) {
+      case State::Listening:
+        if (!ok) {
+          delete this;
+          return;
+        }
+        new ServerStreamCall(m_server);
+        m_response.set_message(std::move(*m_request.mutable_message()));
+        m_state = State::Writing;
+        [[fallthrough]];
+      case State::Writing:
+        if (ok && m_response.n() < m_request.count()) {
+          m_response.set_n(m_response.n() + 1);
+          m_writer.Write(m_response, this);
+          return;
+        }
+        m_state = State::Finishing;
+        m_writer.Finish(grpc::Status::OK, this);
+        return;
+      case State::Finishing:
+        delete this;
+        return;
+      }
+    }
+
+  private:
+    enum class State { Listening, Writing, Finishing };
+
+    RawServer& m_server;
+    grpc::ServerContext m_context;
+    echo_service::ServerStreamEchoRequest m_request;
+    echo_service::ServerStreamEchoResponse m_response;
+    grpc::ServerAsyncWriter<echo_service::ServerStreamEchoResponse> m_writer;
+    State m_state = State::Listening;
+  };
+
+  class BidiCall : public RawTag {
+  public:
+    explicit BidiCall(RawServer& server)
+      : m_server(server)
+      , m_stream(&m_context)
+    {
+      m_server.m_service.RequestBidirectionalStreamEcho(&m_context, &m_stream, m_server.m_cq.get(), m_server.m_cq.get(), this);
+    }
+
+    virtual void Proceed(bool ok) override {
+      switch (m_state) {
+      case State::Listening:
+        if (!ok) {
+          delete this;
+          return;
+        }
+        new BidiCall(m_server);
+        m_state = State::Reading;
+        m_stream.Read(&m_request, this);
+        return;
+      case State::Reading:
+        if (ok) {
+          m_response.set_message(std::move(*m_request.mutable_message()->mutable_message()));
+          m_state = State::Writing;
+          m_stream.Write(m_response, this);
+          return;
+        }
+        break;
+      case State::Writing:
+        if (ok) {
+          m_state = State::Reading;
+          m_stream.Read(&m_request, this);
+          return;
+        }
+        break;
+      case State::Finishing:
+        delete this;
+        return;
+      }
+      m_state = State::Finishing;
+      m_stream.Finish(grpc::Status::OK, this);
+    }
+
+  private:
+    enum class State { Listening, Reading, Writing, Finishing };
+
+    RawServer& m_server;
+    grpc::ServerContext m_context;
+    echo_service::BidirectionalStreamEchoRequest m_request;
+    echo_service::BidirectionalStreamEchoResponse m_response;
+    grpc::ServerAsyncReaderWriter<echo_service::BidirectionalStreamEchoResponse, echo_service::BidirectionalStreamEchoRequest> m_stream;
+    State m_state = State::Listening;
+  };
+
+  EchoService::AsyncService m_service;
+  std::unique_ptr<grpc::ServerCompletionQueue> m_cq;
+  std::unique_ptr<grpc::Server> m_server;
+  std::thread m_thread;
+};
+
+class RawClient {
+public:
+  explicit RawClient(std::shared_ptr<grpc::Channel> channel)
+    : m_stub(std::move(channel))
+    , m_thread([this]() { PollRawTags(m_cq); })
+  {}
+
+  ~RawClient() {
+    m_cq.Shutdown();
+    m_thread.join();
+  }
+
+  void StartWorker(Rpc rpc, size_t ops, utils::Histogram& latencies, std::latch& done) {
+    Worker* worker = nullptr;
+    switch (rpc) {
+    case Rpc::Unary:
+      worker = new UnaryWorker(*this, ops, latencies, done);
+      break;
+    case Rpc::ClientStream:
+      worker = new ClientStreamWorker(*this, ops, latencies, done);
+      break;
+    case Rpc::ServerStream:
+      worker = new ServerStreamWorker(*this, ops, latencies, done);
+      break;
+    case Rpc::Bidi:
+      worker = new BidiWorker(*this, ops, latencies, done);
+      break;
+    }
+    worker->Start();
+  }
+
+private:
+  // Runs ops one after the other and deletes itself once done
+  class Worker : public RawTag {
+  public:
+    Worker(RawClient& client, size_t ops, utils::Histogram& latencies, std::latch& done)
+      : m_client(client)
+      , m_remaining(ops)
+      , m_latencies(latencies)
+      , m_done(done)
+    {}
+
+    virtual void Start() = 0;
+
+  protected:
+    void Complete() {
+      m_done.count_down();
+      delete this;
+    }
+
+    RawClient& m_client;
+    size_t m_remaining;
+    utils::Histogram& m_latencies;
+    std::latch& m_done;
+    bench::clock::time_point m_start;
+  };
+
+  // One call per op
+  class CallWorker : public Worker {
+  public:
+    using Worker::Worker;
+
+    virtual void Start() override {
+      Next();
+    }
+
+  protected:
+    virtual void StartCall() = 0;
+
+    void CallDone(bool success) {
+      if (success) {
+        m_latencies.Record(bench::ElapsedNs(m_start));
+      } else {
+        m_remaining = 0;
+      }
+      Next();
+    }
+
+    std::optional<grpc::ClientContext> m_context;
+    grpc::Status m_status;
+
+  private:
+    void Next() {
+      if (m_remaining == 0) {
+        Complete();
+        return;
+      }
+      --m_remaining;
+      m_start = bench::clock::now();
+      m_context.emplace();
+      StartCall();
+    }
+  };
+
+  class UnaryWorker : public CallWorker {
+  public:
+    UnaryWorker(RawClient& client, size_t ops, utils::Histogram& latencies, std::latch& done)
+      : CallWorker(client, ops, latencies, done)
+    {
+      m_request.set_message(Payload);
+    }
+
+    virtual void Proceed(bool ok) override {
+      m_reader.reset();
+      CallDone(ok && m_status.ok());
+    }
+
+  private:
+    virtual void StartCall() override {
+      m_reader = m_client.m_stub.AsyncUnaryEcho(&*m_context, m_request, &m_client.m_cq);
+      m_reader->Finish(&m_response, &m_status, this);
+    }
+
+    echo_service::UnaryEchoRequest m_request;
+    echo_service::UnaryEchoResponse m_response;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<echo_service::UnaryEchoResponse>> m_reader;
+  };
+
+  class ClientStreamWorker : public CallWorker {
+  public:
+    ClientStreamWorker(RawClient& client, size_t ops, utils::Histogram& latencies, std::latch& done)
+      : CallWorker(client, ops, latencies, done)
+    {
+      m_request.set_message(Payload);
+    }
+
+    virtual void Proceed(bool ok) override {
+      switch (m_state) {
+      case State::Writing:
+        if (ok && m_written < StreamLength) {
+          ++m_written;
+          m_writer->Write(m_request, this);
+          return;
+        }
+        m_state = State::WritingDone;
+        m_writer->WritesDone(this);
+        return;
+      case State::WritingDone:
+        m_state = State::Finishing;
+        m_writer->Finish(&m_status, this);
+        return;
+      case State::Finishing:
+        m_writer.reset();
+        CallDone(ok && m_status.ok() && m_response.messages_size() == StreamLength);
+        return;
+      }
+    }
+
+  private:
+    enum class State { Writing, WritingDone, Finishing };
+
+    virtual void StartCall() override {
+      m_state = State::Writing;
+      m_written = 0;
+      m_response.Clear();
+      m_writer = m_client.m_stub.AsyncClientStreamEcho(&*m_context, &m_response, &m_client.m_cq, this);
+    }
+
+    echo_service::ClientStreamEchoRequest m_request;
+    echo_service::ClientStreamEchoResponse m_response;
+    std::unique_ptr<grpc::ClientAsyncWriter<echo_service::ClientStreamEchoRequest>> m_writer;
+    State m_state = State::Writing;
+    uint32_t m_written = 0;
+  };
+
+  class ServerStreamWorker : public CallWorker {
+  public:
+    ServerStreamWorker(RawClient& client, size_t ops, utils::Histogram& latencies, std::latch& done)
+      : CallWorker(client, ops, latencies, done)
+    {
+      m_request.set_message(Payload);
+      m_request.set_count(StreamLength);
+    }
+
+    virtual void Proceed(bool ok) override {
+      switch (m_state) {
+      case State::Starting:
+      case State::Reading:
+        if (ok) {
+          if (m_state == State::Reading) {
+            ++m_received;
+          }
+          m_state = State::Reading;
+          m_reader->Read(&m_response, this);
+          return;
+        }
+        m_state = State::Finishing;
+        m_reader->Finish(&m_status, this);
+        return;
+      case State::Finishing:
+        m_reader.reset();
+        CallDone(ok && m_status.ok() && m_received == StreamLength);
+        return;
+      }
+    }
+
+  private:
+    enum class State { Starting, Reading, Finishing };
+
+    virtual void StartCall() override {
+      m_state = State::Starting;
+      m_received = 0;
+      m_reader = m_client.m_stub.AsyncServerStreamEcho(&*m_context, m_request, &m_client.m_cq, this);
+    }
+
+    echo_service::ServerStreamEchoRequest m_request;
+    echo_service::ServerStreamEchoResponse m_response;
+    std::unique_ptr<grpc::ClientAsyncReader<echo_service::ServerStreamEchoResponse>> m_reader;
+    State m_state = State::Starting;
+    uint32_t m_received = 0;
+  };
+
+  // One message round trip per op on a single stream
+  class BidiWorker : public Worker {
+  public:
+    BidiWorker(RawClient& client, size_t ops, utils::Histogram& latencies, std::latch& done)
+      : Worker(client, ops, latencies, done)
+    {
+      m_request.mutable_message()->set_message(Payload);
+    }
+
+    virtual void Start() override {
+      m_stream = m_client.m_stub.AsyncBidirectionalStreamEcho(&m_context, &m_client.m_cq, this);
+    }
+
+    virtual void Proceed(bool ok) override {
+      switch (m_state) {
+      case State::Starting:
+        if (!ok) {
+          m_remaining = 0;
+        }
+        Next();
+        return;
+      case State::Writing:
+        if (!ok) {
+          m_remaining = 0;
+          Next();
+          return;
+        }
+        m_state = State::Reading;
+        m_stream->Read(&m_response, this);
+        return;
+      case State::Reading:
+        if (ok) {
+          m_latencies.Record(bench::ElapsedNs(m_start));
+        } else {
+          m_remaining = 0;
+        }
+        Next();
+        return;
+      case State::WritingDone:
+        m_state = State::Draining;
+        m_stream->Read(&m_response, this);
+        return;
+      case State::Draining:
+        if (ok) {
+          m_stream->Read(&m_response, this);
+          return;
+        }
+        m_state = State::Finishing;
+        m_stream->Finish(&m_status, this);
+        return;
+      case State::Finishing:
+        Complete();
+        return;
+      }
+    }
+
+  private:
+    enum class State { Starting, Writing, Reading, WritingDone, Draining, Finishing };
+
+    void Next() {
+      if (m_remaining == 0) {
+        m_state = State::WritingDone;
+        m_stream->WritesDone(this);
+        return;
+      }
+      --m_remaining;
+      m_start = bench::clock::now();
+      m_state = State::Writing;
+      m_stream->Write(m_request, this);
+    }
+
+    grpc::ClientContext m_context;
+    grpc::Status m_status;
+    echo_service::BidirectionalStreamEchoRequest m_request;
+    echo_service::BidirectionalStreamEchoResponse m_response;
+    std::unique_ptr<grpc::ClientAsyncReaderWriter<echo_service::BidirectionalStreamEchoRequest, echo_service::BidirectionalStreamEchoResponse>> m_stream;
+    State m_state = State::Starting;
+  };
+
+  EchoService::Stub m_stub;
+  grpc::CompletionQueue m_cq;
+  std::thread m_thread;
+};
+
+static Result RunRaw(Rpc rpc, size_t ops, size_t concurrency) {
+  RawServer server;
+  RawClient client(server.InProcessChannel());
+  return Measure(ops, concurrency, [&](size_t count, utils::Histogram& latencies, std::latch& done) {
+    client.StartWorker(rpc, count, latencies, done);
+  });
+}
+
+int main(int ac, char** av) {
+  size_t ops = ac > 1 ? std::stoul(av[1]) : 20000;
+
+  bench::PrintLatencyHeader("rpc");
+  for (size_t concurrency : { 1, 16 }) {
+    for (Rpc rpc : { Rpc::Unary, Rpc::ClientStream, Rpc::ServerStream, Rpc::Bidi }) {
+      std::string name = std::string(RpcName(rpc)) + " c" + std::to_string(concurrency);
+      auto async = RunAsync(rpc, ops, concurrency);
+      bench::PrintLatencyRow(name + " async", async.latencies, async.seconds, async.cpu);
+      auto raw = RunRaw(rpc, ops, concurrency);
+      bench::PrintLatencyRow(name + " raw", raw.latencies, raw.seconds, raw.cpu);
+    }
+  }
+}
@@ -0,0 +1,137 @@
+#include <atomic>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <latch>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utils/sharded_hash_map.hpp>
+#include "bench_utils.hpp"
+
+// Mixed read/write workload over a prefilled key space, comparing the std::map behind a single std::shared_mutex the
+// variable service used to have with utils::ShardedHashMap, from 1 to 64 threads.
+// Usage: hash_map_benchmark [keys = 10000000] [read percent = 90] [seconds per run = 1]
+
+class LockedMap {
+public:
+  bool InsertOrAssign(std::string_view key, int64_t value) {
+    auto lock = std::unique_lock(m_mutex);
+    return m_map.insert_or_assign(std::string(key), value).second;
+  }
+
+  std::optional<int64_t> Find(std::string_view key) const {
+    auto lock = std::shared_lock(m_mutex);
+    auto found = m_map.find(key);
+    if (found == m_map.end()) {
+      return std::nullopt;
+    }
+    return found->second;
+  }
+
+private:
+  mutable std::shared_mutex m_mutex;
+  std::map<std::string, int64_t, std::less<>> m_map;
+};
+
+struct Workload {
+  size_t keys = 10'000'000;
+  uint64_t readPercent = 90;
+  double seconds = 1;
+};
+
+// splitmix64, cheap enough not to show up next to a map operation
+static uint64_t NextRandom(uint64_t& state) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+static std::string_view FormatKey(char (&buffer)[24], uint64_t index) {
+  buffer[0] = 'k';
+  auto end = std::to_chars(buffer + 1, buffer + sizeof(buffer), index).ptr;
+  return std::string_view(buffer, static_cast<size_t>(end - buffer));
+}
+
+template<typename TMap>
+static void Fill(TMap& map, size_t keys) {
+  char buffer[24];
+  for (size_t i = 0; i < keys; ++i) {
+    map.InsertOrAssign(FormatKey(buffer, i), static_cast<int64_t>(i));
+  }
+}
+
+// Returns millions of operations per second
+template<typename TMap>
+static double Run(TMap& map, const Workload& workload, size_t threadCount) {
+  std::atomic<bool> stop = false;
+  std::atomic<uint64_t> totalOps = 0;
+  std::latch ready(static_cast<std::ptrdiff_t>(threadCount + 1));
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < threadCount; ++t) {
+    threads.emplace_back([&, t]() {
+      uint64_t random = t + 1;
+      uint64_t ops = 0;
+      uint64_t found = 0;
+      char buffer[24];
+      ready.arrive_and_wait();
+      while (!stop.load(std::memory_order_relaxed)) {
+        uint64_t r = NextRandom(random);
+        auto key = FormatKey(buffer, r % workload.keys);
+        if ((r >> 40) % 100 < workload.readPercent) {
+          found += map.Find(key).has_value();
+        } else {
+          map.InsertOrAssign(key, static_cast<int64_t>(r));
+        }
+        ++ops;
+      }
+      // Keep the reads from being optimized away
+      totalOps += ops + (found > ops);
+    });
+  }
+  ready.arrive_and_wait();
+  auto start = bench::clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(workload.seconds));
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+  return static_cast<double>(totalOps.load()) / seconds / 1e6;
+}
+
+template<typename TMap>
+static void RunAll(std::string_view name, const Workload& workload) {
+  TMap map;
+  auto start = bench::clock::now();
+  Fill(map, workload.keys);
+  std::cout << name << ": filled " << workload.keys << " keys in " << std::fixed << std::setprecision(2)
+    << static_cast<double>(bench::ElapsedNs(start)) / 1e9 << "s" << std::endl;
+  for (size_t threads : { 1, 2, 4, 8, 16, 32, 64 }) {
+    std::cout << std::left << std::setw(20) << name << std::right << std::setw(8) << threads
+      << std::setw(12) << std::setprecision(2) << Run(map, workload, threads) << std::endl;
+  }
+}
+
+int main(int ac, char** av) {
+  Workload workload;
+  if (ac > 1) {
+    workload.keys = std::stoul(av[1]);
+  }
+  if (ac > 2) {
+    workload.readPercent = std::stoul(av[2]);
+  }
+  if (ac > 3) {
+    workload.seconds = std::stod(av[3]);
+  }
+
+  std::cout << workload.readPercent << "% reads over " << workload.keys << " keys, "
+    << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+  std::cout << std::left << std::setw(20) << "storage" << std::right << std::setw(8) << "threads" << std::setw(12) << "Mops/s" << std::endl;
+  RunAll<LockedMap>("map+shared_mutex", workload);
+  RunAll<utils::ShardedHashMap<int64_t>>("sharded hash map", workload);
+}
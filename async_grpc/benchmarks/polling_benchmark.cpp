@@ -0,0 +1,83 @@
+#include <future>
+#include <string>
+#include <async_grpc/client.hpp>
+#include <async_grpc/server.hpp>
+#include <protos/echo_service.grpc.pb.h>
+#include "bench_utils.hpp"
+
+// Sequential unary round trips against an in process server, comparing blocking ticks to several spin budgets.
+// Reports the latency and the amount of cores burnt doing so.
+
+class BenchEchoService : public async_grpc::BaseServiceImpl<echo_service::EchoService> {
+public:
+  virtual void StartListening(async_grpc::Server& server) override {
+    StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, UnaryEcho), &UnaryEcho);
+  }
+
+private:
+  static async_grpc::Task<> UnaryEcho(std::unique_ptr<async_grpc::ServerUnaryContext<echo_service::UnaryEchoRequest, echo_service::UnaryEchoResponse>> context) {
+    echo_service::UnaryEchoResponse response;
+    response.set_message(std::move(*context->request.mutable_message()));
+    co_await context->Finish(response);
+  }
+};
+
+static async_grpc::Task<> RunCalls(async_grpc::Client<echo_service::EchoService>& client, size_t calls, utils::Histogram& latencies, std::promise<void>& done) {
+  echo_service::UnaryEchoRequest request;
+  request.set_message("ping");
+  echo_service::UnaryEchoResponse response;
+  for (size_t i = 0; i < calls; ++i) {
+    grpc::ClientContext context;
+    grpc::Status status;
+    auto start = bench::clock::now();
+    if (!co_await client.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(echo_service::EchoService, UnaryEcho), context, request, response, status) || !status.ok()) {
+      break;
+    }
+    latencies.Record(bench::ElapsedNs(start));
+  }
+  done.set_value();
+}
+
+static void RunConfig(std::string_view name, const async_grpc::PollingOptions& polling, size_t calls) {
+  BenchEchoService service;
+  async_grpc::ServerOptions options;
+  options.services.push_back(service);
+  options.executorCount = 1;
+  options.threadsPerExecutor = 1;
+  options.polling = polling;
+  async_grpc::Server server(std::move(options));
+
+  async_grpc::Client<echo_service::EchoService> client(server.InProcessChannel());
+  async_grpc::ClientExecutorThreads executor(1, polling);
+
+  auto run = [&](size_t count, utils::Histogram& latencies) {
+    std::promise<void> done;
+    async_lib::Spawn(executor.GetExecutor(), RunCalls(client, count, latencies, done));
+    done.get_future().wait();
+  };
+
+  utils::Histogram warmup;
+  run(calls / 10 + 1, warmup);
+
+  utils::Histogram latencies;
+  auto cpuStart = bench::CpuSeconds();
+  auto start = bench::clock::now();
+  run(calls, latencies);
+  double seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+  double cpu = (bench::CpuSeconds() - cpuStart) / seconds;
+
+  bench::PrintLatencyRow(name, latencies, seconds, cpu);
+  server.Shutdown();
+}
+
+int main(int ac, char** av) {
+  size_t calls = ac > 1 ? std::stoul(av[1]) : 20000;
+
+  bench::PrintLatencyHeader("spin budget");
+  RunConfig("blocking", {}, calls);
+  for (auto budget : { 10, 50, 200, 1000 }) {
+    async_grpc::PollingOptions polling;
+    polling.spinBudget = std::chrono::microseconds(budget);
+    RunConfig(std::to_string(budget) + "us", polling, calls);
+  }
+}
@@ -0,0 +1,126 @@
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <server/variable_store.hpp>
+#include "bench_utils.hpp"
+
+// Time for a VariableStore to be ready when it has to replay its whole log, against mapping a snapshot, then the cost
+// of writing a snapshot while a writer keeps going.
+// Usage: startup_benchmark [directory = .] [keys = 1000000]
+
+namespace {
+
+  struct Paths {
+    std::filesystem::path log;
+    std::filesystem::path snapshot;
+  };
+
+  VariableStore::Options MakeOptions(const Paths& paths, bool withSnapshot) {
+    VariableStore::Options options;
+    options.log.path = paths.log;
+    options.log.flushInterval = std::chrono::microseconds(0);
+    if (withSnapshot) {
+      options.snapshot = paths.snapshot;
+      // Only explicit snapshots
+      options.snapshotLogSize = UINT64_MAX;
+    }
+    return options;
+  }
+
+  std::string Key(size_t i) {
+    return "player" + std::to_string(i);
+  }
+
+  double Seconds(bench::clock::time_point start) {
+    return static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+  }
+
+  // Returns the seconds it took to open, then reads a few keys
+  double OpenAndRead(const Paths& paths, bool withSnapshot, size_t keys) {
+    VariableStore store;
+    auto start = bench::clock::now();
+    if (auto opened = store.Open(MakeOptions(paths, withSnapshot)); !opened) {
+      std::cerr << opened.error() << std::endl;
+      return 0;
+    }
+    double openSeconds = Seconds(start);
+    start = bench::clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+      found += store.Read(Key(i * 7919 % keys)).has_value();
+    }
+    std::cout << "  1000 first reads: " << Seconds(start) * 1e3 << "ms, " << found << " found" << std::endl;
+    return openSeconds;
+  }
+
+}
+
+int main(int ac, char** av) {
+  std::filesystem::path directory = ac > 1 ? av[1] : ".";
+  size_t keys = ac > 2 ? std::stoul(av[2]) : 1'000'000;
+  Paths paths{ directory / "startup_benchmark.wal", directory / "startup_benchmark.snapshot" };
+  std::filesystem::remove(paths.log);
+  std::filesystem::remove(paths.snapshot);
+  std::cout << std::fixed << std::setprecision(3);
+
+  {
+    VariableStore store;
+    if (auto opened = store.Open(MakeOptions(paths, false)); !opened) {
+      std::cerr << opened.error() << std::endl;
+      return 1;
+    }
+    auto start = bench::clock::now();
+    for (size_t i = 0; i < keys; ++i) {
+      store.Write(Key(i), static_cast<int64_t>(i));
+    }
+    std::cout << "filled " << keys << " keys in " << Seconds(start) << "s, log is " << store.GetLog()->Size() / (1 << 20) << "MB" << std::endl;
+  }
+
+  std::cout << "replaying the log" << std::endl;
+  double replaySeconds = OpenAndRead(paths, false, keys);
+  std::cout << "  ready in " << replaySeconds * 1e3 << "ms" << std::endl;
+
+  {
+    VariableStore store;
+    if (auto opened = store.Open(MakeOptions(paths, true)); !opened) {
+      std::cerr << opened.error() << std::endl;
+      return 1;
+    }
+    // A writer keeps going while the snapshot is written, its latencies show how much the snapshot stalls it
+    std::atomic<bool> stop = false;
+    utils::Histogram latencies;
+    std::thread writer([&]() {
+      for (uint64_t i = 0; !stop; ++i) {
+        auto start = bench::clock::now();
+        store.Write(Key(i % keys), static_cast<int64_t>(i));
+        latencies.Record(bench::ElapsedNs(start));
+      }
+    });
+    auto start = bench::clock::now();
+    auto written = store.WriteSnapshot();
+    double snapshotSeconds = Seconds(start);
+    stop = true;
+    writer.join();
+    if (!written) {
+      std::cerr << written.error() << std::endl;
+      return 1;
+    }
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1e3; };
+    std::cout << "snapshot written in " << snapshotSeconds << "s, " << latencies.Count() << " concurrent writes, p50 "
+      << us(latencies.Percentile(50)) << "us, p99.9 " << us(latencies.Percentile(99.9)) << "us, max " << us(latencies.Max()) << "us" << std::endl;
+    // The concurrent writes are all in the log now, a quiet snapshot leaves the next start nothing to replay
+    if (auto quiet = store.WriteSnapshot(); !quiet) {
+      std::cerr << quiet.error() << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "mapping the snapshot" << std::endl;
+  double mapSeconds = OpenAndRead(paths, true, keys);
+  std::cout << "  ready in " << mapSeconds * 1e3 << "ms" << std::endl;
+
+  std::filesystem::remove(paths.log);
+  std::filesystem::remove(paths.snapshot);
+}
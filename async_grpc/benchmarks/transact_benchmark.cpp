@@ -0,0 +1,151 @@
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <latch>
+#include <string>
+#include <thread>
+#include <vector>
+#include <server/variable_store.hpp>
+#include "bench_utils.hpp"
+
+// Transfers between random pairs of a small set of hot keys, straight against VariableStore::Transact, so that
+// contention is the only thing measured. Each mode checks that the sum of all the keys is still 0 once done.
+//  - optimistic: reads both keys in a first transaction, then writes them back conditioned on the versions it read,
+//    starting over on a conflict. Nothing is locked between the two transactions
+//  - increments: a single transaction of two increments, conflicts can't happen, the shard locks serialize it
+// Usage: transact_benchmark [seconds per run = 1]
+
+namespace {
+
+  enum class Mode {
+    Optimistic,
+    Increments,
+  };
+
+  struct Result {
+    uint64_t commits = 0;
+    uint64_t conflicts = 0;
+    bool consistent = false;
+  };
+
+  // splitmix64
+  uint64_t NextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  void AddOperation(variable_service::TransactRequest& request, const std::string& key) {
+    request.add_operations()->set_key(key);
+  }
+
+  // Returns the amount of conflicts it took to commit
+  uint64_t Transfer(VariableStore& store, Mode mode, const std::string& from, const std::string& to) {
+    variable_service::TransactRequest request;
+    AddOperation(request, from);
+    AddOperation(request, to);
+    if (mode == Mode::Increments) {
+      request.mutable_operations(0)->mutable_increment()->set_delta(-1);
+      request.mutable_operations(1)->mutable_increment()->set_delta(1);
+      store.Transact(request);
+      return 0;
+    }
+
+    for (uint64_t conflicts = 0;; ++conflicts) {
+      request.mutable_operations(0)->mutable_read();
+      request.mutable_operations(1)->mutable_read();
+      request.mutable_operations(0)->clear_expected_version();
+      request.mutable_operations(1)->clear_expected_version();
+      auto read = store.Transact(request);
+      if (!read) {
+        return conflicts;
+      }
+      for (int i = 0; i < 2; ++i) {
+        const auto& current = read->results(i);
+        auto* operation = request.mutable_operations(i);
+        operation->set_expected_version(current.version());
+        operation->mutable_write()->set_value(current.value() + (i == 0 ? -1 : 1));
+      }
+      auto write = store.Transact(request);
+      if (!write || write->committed()) {
+        return conflicts;
+      }
+    }
+  }
+
+  Result Run(Mode mode, size_t keyCount, size_t threadCount, double seconds) {
+    VariableStore store;
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < keyCount; ++i) {
+      keys.push_back("account" + std::to_string(i));
+      store.Write(keys.back(), 0);
+    }
+
+    Result result;
+    std::atomic<bool> stop = false;
+    std::atomic<uint64_t> commits = 0;
+    std::atomic<uint64_t> conflicts = 0;
+    std::latch ready(static_cast<std::ptrdiff_t>(threadCount + 1));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&, t]() {
+        uint64_t random = t + 1;
+        uint64_t localCommits = 0;
+        uint64_t localConflicts = 0;
+        ready.arrive_and_wait();
+        while (!stop.load(std::memory_order_relaxed)) {
+          uint64_t r = NextRandom(random);
+          size_t from = r % keyCount;
+          // Never the same key twice
+          size_t to = (from + 1 + (r >> 32) % (keyCount - 1)) % keyCount;
+          localConflicts += Transfer(store, mode, keys[from], keys[to]);
+          ++localCommits;
+        }
+        commits += localCommits;
+        conflicts += localConflicts;
+      });
+    }
+    ready.arrive_and_wait();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    int64_t sum = 0;
+    for (const auto& key : keys) {
+      sum += store.Read(key).value_or(Variable{}).value;
+    }
+    result.commits = commits;
+    result.conflicts = conflicts;
+    result.consistent = sum == 0;
+    return result;
+  }
+
+}
+
+int main(int ac, char** av) {
+  double seconds = ac > 1 ? std::stod(av[1]) : 1.0;
+
+  std::cout << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+  std::cout << std::left << std::setw(14) << "mode" << std::right << std::setw(8) << "keys" << std::setw(10) << "threads"
+    << std::setw(14) << "commits/s" << std::setw(12) << "conflicts" << std::setw(8) << "sum" << std::endl;
+  bool consistent = true;
+  for (Mode mode : { Mode::Optimistic, Mode::Increments }) {
+    for (size_t keys : { 2, 16, 1024 }) {
+      for (size_t threads : { 1, 4, 16, 64 }) {
+        auto result = Run(mode, keys, threads, seconds);
+        // Conflicts per attempt, in percent
+        double conflictRate = result.commits ? 100.0 * static_cast<double>(result.conflicts) / static_cast<double>(result.commits + result.conflicts) : 0.0;
+        std::cout << std::left << std::setw(14) << (mode == Mode::Optimistic ? "optimistic" : "increments") << std::right
+          << std::setw(8) << keys << std::setw(10) << threads << std::fixed << std::setprecision(0)
+          << std::setw(14) << static_cast<double>(result.commits) / seconds
+          << std::setw(11) << std::setprecision(1) << conflictRate << "%"
+          << std::setw(8) << (result.consistent ? "ok" : "BROKEN") << std::endl;
+        consistent = consistent && result.consistent;
+      }
+    }
+  }
+  return consistent ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include <filesystem>
+#include <iostream>
+#include <latch>
+#include <string>
+#include <vector>
+#include <async_grpc/client.hpp>
+#include <server/variable_store.hpp>
+#include "bench_utils.hpp"
+
+// Writes to a VariableStore backed by its write-ahead log, each writer coroutine waiting for its write to be on disk
+// before issuing the next one, like VariableServiceImpl does before acknowledging. Runs several batch settings, the
+// first row being the in memory store for reference. Commit latency is the time from the write to Sync() resuming.
+// Usage: wal_benchmark [log directory = .] [writes per run = 20000] [concurrency = 64]
+
+namespace {
+
+  struct Settings {
+    const char* name;
+    size_t batchSize;
+    std::chrono::microseconds flushInterval;
+  };
+
+  async_grpc::Task<> Writer(VariableStore& store, size_t index, size_t writes, utils::Histogram& latencies, std::latch& done) {
+    std::string key = "player" + std::to_string(index);
+    for (size_t i = 0; i < writes; ++i) {
+      auto start = bench::clock::now();
+      store.Write(key, static_cast<int64_t>(i));
+      if (auto* log = store.GetLog(); log && !co_await log->Sync()) {
+        break;
+      }
+      latencies.Record(bench::ElapsedNs(start));
+    }
+    done.count_down();
+  }
+
+  void Run(const std::filesystem::path& directory, const Settings* settings, size_t writes, size_t concurrency) {
+    auto path = directory / "wal_benchmark.wal";
+    std::filesystem::remove(path);
+    VariableStore store;
+    if (settings) {
+      VariableStore::Options options;
+      options.log.path = path;
+      options.log.batchSize = settings->batchSize;
+      options.log.flushInterval = settings->flushInterval;
+      if (auto opened = store.Open(std::move(options)); !opened) {
+        std::cerr << opened.error() << std::endl;
+        return;
+      }
+    }
+
+    async_grpc::ClientExecutorThreads executor(2);
+    std::vector<utils::Histogram> latencies(concurrency);
+    std::latch done(static_cast<std::ptrdiff_t>(concurrency));
+    auto cpuStart = bench::CpuSeconds();
+    auto start = bench::clock::now();
+    for (size_t i = 0; i < concurrency; ++i) {
+      async_lib::Spawn(executor.GetExecutor(), Writer(store, i, writes / concurrency, latencies[i], done));
+    }
+    done.wait();
+    double seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+    double cpu = (bench::CpuSeconds() - cpuStart) / seconds;
+
+    utils::Histogram merged;
+    for (const auto& histogram : latencies) {
+      merged.Merge(histogram);
+    }
+    bench::PrintLatencyRow(settings ? settings->name : "memory only", merged, seconds, cpu);
+    std::filesystem::remove(path);
+  }
+
+}
+
+int main(int ac, char** av) {
+  std::filesystem::path directory = ac > 1 ? av[1] : ".";
+  size_t writes = ac > 2 ? std::stoul(av[2]) : 20'000;
+  size_t concurrency = ac > 3 ? std::stoul(av[3]) : 64;
+
+  using namespace std::chrono_literals;
+  const Settings settings[] = {
+    { "batch 1, no wait", 1, 0us },
+    { "batch 16, 200us", 16, 200us },
+    { "batch 64, 1ms", 64, 1000us },
+    { "batch 256, 5ms", 256, 5000us },
+  };
+
+  std::cout << concurrency << " writers, " << writes << " writes per run, log in " << std::filesystem::absolute(directory).string() << std::endl;
+  bench::PrintLatencyHeader("settings");
+  Run(directory, nullptr, writes, concurrency);
+  for (const auto& setting : settings) {
+    Run(directory, &setting, writes, concurrency);
+  }
+}
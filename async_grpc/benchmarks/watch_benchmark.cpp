@@ -0,0 +1,75 @@
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <server/variable_store.hpp>
+#include "bench_utils.hpp"
+
+// Cost of notifying watchers on the write path. One writer changes keys of a memory only store watched by a growing
+// amount of watchers, all on the same prefix, while a single thread drains them one after the other the way slow
+// streams would. Each change is serialized once whatever the amount of watchers, the rest is a shared pointer per
+// watcher, and keys changing faster than they're drained are coalesced.
+// Usage: watch_benchmark [writes = 200000] [keys = 100]
+
+int main(int ac, char** av) {
+  size_t writes = 200'000;
+  size_t keys = 100;
+  if (ac > 1) {
+    writes = std::stoul(av[1]);
+  }
+  if (ac > 2) {
+    keys = std::stoul(av[2]);
+  }
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < keys; ++i) {
+    names.push_back("key" + std::to_string(i));
+  }
+
+  std::cout << writes << " writes over " << keys << " keys" << std::endl;
+  bench::PrintLatencyHeader("watchers");
+  for (size_t watcherCount : { 0, 1, 16, 256, 1024 }) {
+    VariableStore store;
+    std::vector<std::unique_ptr<VariableWatcher>> watchers;
+    for (size_t i = 0; i < watcherCount; ++i) {
+      watchers.push_back(store.Watch({}, { "key" }));
+    }
+
+    std::atomic<bool> stop = false;
+    uint64_t delivered = 0;
+    std::thread drain([&]() {
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (auto& watcher : watchers) {
+          delivered += watcher->Take().size();
+        }
+        std::this_thread::yield();
+      }
+      for (auto& watcher : watchers) {
+        delivered += watcher->Take().size();
+      }
+    });
+
+    utils::Histogram latencies;
+    auto cpuStart = bench::CpuSeconds();
+    auto start = bench::clock::now();
+    for (size_t i = 0; i < writes; ++i) {
+      auto writeStart = bench::clock::now();
+      store.Write(names[i % keys], static_cast<int64_t>(i));
+      latencies.Record(bench::ElapsedNs(writeStart));
+    }
+    double seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+    double cpu = (bench::CpuSeconds() - cpuStart) / seconds;
+    stop = true;
+    drain.join();
+
+    bench::PrintLatencyRow(std::to_string(watcherCount), latencies, seconds, cpu);
+    if (watcherCount) {
+      double sent = static_cast<double>(writes * watcherCount);
+      std::cout << "  " << delivered << " events delivered out of " << writes * watcherCount << ", "
+        << std::fixed << std::setprecision(1) << 100.0 * (1.0 - static_cast<double>(delivered) / sent) << "% coalesced" << std::endl;
+    }
+  }
+}
@@ -3,16 +3,19 @@
 #include <async_grpc/iostream.hpp>
 #include <protos/echo_service.grpc.pb.h>
 #include <protos/variable_service.grpc.pb.h>
+#include <protos/metrics_service.grpc.pb.h>
 #include <utils/logs.hpp>
 #include <ranges>
 
 using EchoClient = async_grpc::Client<echo_service::EchoService>;
 using VariableClient = async_grpc::Client<variable_service::VariableService>;
+using MetricsClient = async_grpc::Client<metrics_service::MetricsService>;
 
 class Program {
 public:
   Program(const std::shared_ptr<grpc::Channel>& channel)
     : m_echo(channel)
+    , m_metrics(channel)
   {
 #define ADD_HANDLER(command) m_handlers.insert_or_assign(#command, &Program::command)
     ADD_HANDLER(Noop);
@@ -21,6 +24,7 @@ public:
     ADD_HANDLER(ClientStreamEcho);
     ADD_HANDLER(ServerStreamEcho);
     ADD_HANDLER(BidirectionalStreamEcho);
+    ADD_HANDLER(Metrics);
 #undef ADD_HANDLER
   }
 
@@ -232,7 +236,27 @@ private:
     utils::Log() << "End";
   }
 
+  async_grpc::Task<> Metrics() {
+    utils::Log() << "Start";
+    metrics_service::GetMetricsRequest request;
+    metrics_service::GetMetricsResponse response;
+    grpc::Status status;
+    grpc::ClientContext context;
+    if (!co_await m_metrics.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(metrics_service::MetricsService, GetMetrics), context, request, response, status)) {
+      utils::Log() << "Cancelled";
+      co_return;
+    }
+    utils::Log() << "Received [" << status << ']';
+    for (const auto& method : response.methods()) {
+      utils::Log() << method.method() << ": calls " << method.calls() << ", in flight " << method.in_flight()
+        << ", bytes in/out " << method.bytes_in() << '/' << method.bytes_out()
+        << ", handler p50/p99 " << method.handler_duration_ns().p50() << '/' << method.handler_duration_ns().p99() << "ns";
+    }
+    utils::Log() << "End";
+  }
+
   EchoClient m_echo;
+  MetricsClient m_metrics;
   async_grpc::ClientExecutorThreads m_executor{ 2 };
   using THandler = async_grpc::Task<>(Program::*)();
   std::map<std::string, THandler> m_handlers;
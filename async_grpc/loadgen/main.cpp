@@ -0,0 +1,481 @@
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <ranges>
+#include <string>
+#include <thread>
+#include <vector>
+#include <async_grpc/client.hpp>
+#include <protos/echo_service.grpc.pb.h>
+#include <protos/variable_service.grpc.pb.h>
+#include <utils/histogram.hpp>
+
+// Load generator for the example server.
+// Closed loop: `concurrency` coroutines each issue one call after the other.
+// Open loop: calls are issued at a fixed rate whatever the server does, latencies are measured from the time a call
+// was supposed to be issued so that a stalling server isn't hidden by calls that weren't sent (coordinated omission).
+
+namespace loadgen {
+
+  using Clock = std::chrono::steady_clock;
+  using Rng = std::minstd_rand;
+
+  struct Options {
+    std::string target = "[::1]:4213";
+    std::string replicas;
+    std::string scenario = "unary";
+    std::string mode = "closed";
+    size_t concurrency = 16;
+    double rate = 1000;
+    double duration = 10;
+    double warmup = 1;
+    size_t payload = 16;
+    size_t messages = 10;
+    size_t threads = 2;
+    size_t channels = 1;
+    size_t keys = 1000;
+    double readRatio = 0.9;
+    std::string output = "text";
+  };
+
+  static const char* Usage =
+    "Usage: loadgen [--option=value]...\n"
+    "  --target=[::1]:4213      server address\n"
+    "  --replicas=host:port,... read replicas the variable reads are spread on, falling back to the target\n"
+    "  --scenario=unary         unary, client_stream, server_stream, bidi, var_read, var_write, var_mixed, var_increment\n"
+    "  --mode=closed            closed (fixed concurrency) or open (fixed rate)\n"
+    "  --concurrency=16         closed loop outstanding calls\n"
+    "  --rate=1000              open loop calls per second\n"
+    "  --duration=10            measured seconds\n"
+    "  --warmup=1               seconds run before measuring\n"
+    "  --payload=16             echo message size in bytes\n"
+    "  --messages=10            messages per streaming call, bidi streams get one message per ms from the server\n"
+    "  --threads=2              executor threads\n"
+    "  --channels=1             channels calls are spread on\n"
+    "  --keys=1000              variable scenarios key space\n"
+    "  --read-ratio=0.9         var_mixed ratio of reads\n"
+    "  --output=text            text or json\n";
+
+  static bool ParseOptions(int ac, char** av, Options& options) {
+    std::map<std::string, std::string> values;
+    for (int i = 1; i < ac; ++i) {
+      std::string_view arg = av[i];
+      auto eq = arg.find('=');
+      if (!arg.starts_with("--") || eq == std::string_view::npos) {
+        return false;
+      }
+      values.insert_or_assign(std::string(arg.substr(2, eq - 2)), std::string(arg.substr(eq + 1)));
+    }
+    auto take = [&](const char* name, auto& out) {
+      auto found = values.find(name);
+      if (found == values.end()) {
+        return;
+      }
+      if constexpr (std::is_same_v<std::decay_t<decltype(out)>, std::string>) {
+        out = found->second;
+      } else if constexpr (std::is_floating_point_v<std::decay_t<decltype(out)>>) {
+        out = std::stod(found->second);
+      } else {
+        out = std::stoul(found->second);
+      }
+      values.erase(found);
+    };
+    take("target", options.target);
+    take("replicas", options.replicas);
+    take("scenario", options.scenario);
+    take("mode", options.mode);
+    take("concurrency", options.concurrency);
+    take("rate", options.rate);
+    take("duration", options.duration);
+    take("warmup", options.warmup);
+    take("payload", options.payload);
+    take("messages", options.messages);
+    take("threads", options.threads);
+    take("channels", options.channels);
+    take("keys", options.keys);
+    take("read-ratio", options.readRatio);
+    take("output", options.output);
+    return values.empty() && (options.mode == "closed" || options.mode == "open") && (options.output == "text" || options.output == "json")
+      && options.threads > 0 && options.channels > 0 && options.keys > 0 && options.rate > 0 && options.concurrency > 0;
+  }
+
+  class WaitGroup {
+  public:
+    void Add(size_t count = 1) {
+      auto lock = std::unique_lock(m_lock);
+      m_count += count;
+    }
+
+    void Done() {
+      auto lock = std::unique_lock(m_lock);
+      if (--m_count == 0) {
+        m_cv.notify_all();
+      }
+    }
+
+    void Wait() {
+      auto lock = std::unique_lock(m_lock);
+      m_cv.wait(lock, [this]() { return m_count == 0; });
+    }
+
+  private:
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    size_t m_count = 0;
+  };
+
+  // Calls resume on any executor thread, each thread records in its own shard
+  class Recorder {
+  public:
+    explicit Recorder(size_t shards)
+      : m_shards(shards)
+    {}
+
+    void Record(uint64_t latencyNs, bool ok) {
+      auto& shard = m_shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % m_shards.size()];
+      auto lock = std::unique_lock(shard.lock);
+      if (ok) {
+        shard.latencies.Record(latencyNs);
+      } else {
+        ++shard.errors;
+      }
+    }
+
+    utils::Histogram Latencies() {
+      utils::Histogram merged;
+      for (auto& shard : m_shards) {
+        auto lock = std::unique_lock(shard.lock);
+        merged.Merge(shard.latencies);
+      }
+      return merged;
+    }
+
+    uint64_t Errors() {
+      uint64_t errors = 0;
+      for (auto& shard : m_shards) {
+        auto lock = std::unique_lock(shard.lock);
+        errors += shard.errors;
+      }
+      return errors;
+    }
+
+  private:
+    struct Shard {
+      std::mutex lock;
+      utils::Histogram latencies;
+      uint64_t errors = 0;
+    };
+
+    std::vector<Shard> m_shards;
+  };
+
+  static std::vector<std::shared_ptr<grpc::Channel>> MakeChannels(const Options& options, std::string_view targets) {
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (auto target : std::views::split(targets, ',')) {
+      for (size_t i = 0; i < options.channels; ++i) {
+        grpc::ChannelArguments args;
+        // Otherwise channels to the same target share their connection
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        channels.push_back(grpc::CreateCustomChannel(std::string(target.begin(), target.end()), grpc::InsecureChannelCredentials(), args));
+      }
+    }
+    return channels;
+  }
+
+  class LoadGenerator {
+  public:
+    explicit LoadGenerator(const Options& options)
+      : m_options(options)
+      , m_echo(MakeChannels(options, options.target))
+      , m_variable(MakeChannels(options, options.target))
+      , m_replicas(MakeChannels(options, options.replicas.empty() ? options.target : options.replicas))
+      , m_executor(options.threads)
+      , m_recorder(options.threads * 2)
+      , m_payload(options.payload, 'x')
+    {}
+
+    bool SelectScenario() {
+      static const std::map<std::string, Scenario, std::less<>> scenarios = {
+        { "unary", &LoadGenerator::UnaryEcho },
+        { "client_stream", &LoadGenerator::ClientStreamEcho },
+        { "server_stream", &LoadGenerator::ServerStreamEcho },
+        { "bidi", &LoadGenerator::BidirectionalStreamEcho },
+        { "var_read", &LoadGenerator::VariableRead },
+        { "var_write", &LoadGenerator::VariableWrite },
+        { "var_mixed", &LoadGenerator::VariableMixed },
+        { "var_increment", &LoadGenerator::VariableIncrement },
+      };
+      auto found = scenarios.find(m_options.scenario);
+      if (found == scenarios.end()) {
+        return false;
+      }
+      m_scenario = found->second;
+      return true;
+    }
+
+    void Run() {
+      m_start = Clock::now();
+      m_measureStart = m_start + ToDuration(m_options.warmup);
+      m_end = m_measureStart + ToDuration(m_options.duration);
+      if (m_options.mode == "closed") {
+        m_running.Add(m_options.concurrency);
+        for (size_t i = 0; i < m_options.concurrency; ++i) {
+          async_lib::Spawn(m_executor.GetExecutor(), ClosedLoopWorker(Rng(static_cast<Rng::result_type>(i + 1))));
+        }
+      } else {
+        m_running.Add();
+        async_lib::Spawn(m_executor.GetExecutor(), OpenLoopDispatcher());
+      }
+      m_running.Wait();
+      m_executor.Shutdown();
+    }
+
+    void Report(std::ostream& out) {
+      auto latencies = m_recorder.Latencies();
+      uint64_t errors = m_recorder.Errors();
+      double seconds = m_options.duration;
+      auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+      static constexpr std::pair<const char*, double> percentiles[] = {
+        { "p50", 50 }, { "p75", 75 }, { "p90", 90 }, { "p99", 99 }, { "p99.9", 99.9 }, { "p99.99", 99.99 }
+      };
+      out << std::fixed << std::setprecision(1);
+      if (m_options.output == "json") {
+        out << "{\"scenario\":\"" << m_options.scenario << "\",\"mode\":\"" << m_options.mode << '"'
+          << ",\"concurrency\":" << m_options.concurrency << ",\"rate\":" << m_options.rate
+          << ",\"threads\":" << m_options.threads << ",\"channels\":" << m_options.channels
+          << ",\"payload\":" << m_options.payload << ",\"messages\":" << m_options.messages
+          << ",\"duration_s\":" << seconds << ",\"ops\":" << latencies.Count() << ",\"errors\":" << errors
+          << ",\"throughput_ops_s\":" << static_cast<double>(latencies.Count()) / seconds
+          << ",\"latency_us\":{\"min\":" << us(latencies.Min()) << ",\"mean\":" << latencies.Mean() / 1000.0;
+        for (auto [name, p] : percentiles) {
+          out << ",\"" << name << "\":" << us(latencies.Percentile(p));
+        }
+        out << ",\"max\":" << us(latencies.Max()) << "}}" << std::endl;
+        return;
+      }
+      out << "scenario " << m_options.scenario << ", " << m_options.mode << " loop";
+      if (m_options.mode == "closed") {
+        out << ", concurrency " << m_options.concurrency;
+      } else {
+        out << ", rate " << m_options.rate << "/s";
+      }
+      out << ", " << m_options.threads << " threads, " << m_options.channels << " channels\n"
+        << "ops " << latencies.Count() << ", errors " << errors << ", throughput " << static_cast<double>(latencies.Count()) / seconds << " ops/s\n"
+        << "latency us: min " << us(latencies.Min()) << ", mean " << latencies.Mean() / 1000.0;
+      for (auto [name, p] : percentiles) {
+        out << ", " << name << ' ' << us(latencies.Percentile(p));
+      }
+      out << ", max " << us(latencies.Max()) << std::endl;
+    }
+
+  private:
+    using Scenario = async_grpc::Task<bool>(LoadGenerator::*)(Rng&);
+
+    static Clock::duration ToDuration(double seconds) {
+      return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    void Record(Clock::time_point start, bool ok) {
+      if (start >= m_measureStart && start < m_end) {
+        m_recorder.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()), ok);
+      }
+    }
+
+    async_grpc::Task<> ClosedLoopWorker(Rng rng) {
+      while (true) {
+        auto start = Clock::now();
+        if (start >= m_end) {
+          break;
+        }
+        Record(start, co_await (this->*m_scenario)(rng));
+      }
+      m_running.Done();
+    }
+
+    async_grpc::Task<> OpenLoopDispatcher() {
+      const auto interval = std::chrono::duration<double>(1.0 / m_options.rate);
+      Rng rng;
+      for (size_t sent = 0;;) {
+        auto intended = m_start + std::chrono::duration_cast<Clock::duration>(interval * static_cast<double>(sent));
+        if (intended >= m_end) {
+          break;
+        }
+        auto now = Clock::now();
+        if (intended > now) {
+          auto deadline = std::chrono::system_clock::now() + std::chrono::duration_cast<std::chrono::system_clock::duration>(intended - now);
+          if (!co_await async_grpc::Alarm(deadline)) {
+            break;
+          }
+          continue;
+        }
+        // Issue everything that is due, however late we are
+        ++sent;
+        m_running.Add();
+        async_lib::Spawn(m_executor.GetExecutor(), OpenLoopCall(intended, Rng(static_cast<Rng::result_type>(rng()))));
+      }
+      m_running.Done();
+    }
+
+    async_grpc::Task<> OpenLoopCall(Clock::time_point intended, Rng rng) {
+      Record(intended, co_await (this->*m_scenario)(rng));
+      m_running.Done();
+    }
+
+    async_grpc::Task<bool> UnaryEcho(Rng&) {
+      echo_service::UnaryEchoRequest request;
+      request.set_message(m_payload);
+      echo_service::UnaryEchoResponse response;
+      grpc::ClientContext context;
+      grpc::Status status;
+      co_return co_await m_echo.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(echo_service::EchoService, UnaryEcho), context, request, response, status) && status.ok();
+    }
+
+    async_grpc::Task<bool> ClientStreamEcho(Rng&) {
+      echo_service::ClientStreamEchoResponse response;
+      grpc::ClientContext context;
+      auto call = co_await m_echo.CallClientStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(echo_service::EchoService, ClientStreamEcho), context, response);
+      if (!call) {
+        co_return false;
+      }
+      echo_service::ClientStreamEchoRequest request;
+      request.set_message(m_payload);
+      bool ok = true;
+      for (size_t i = 0; ok && i < m_options.messages; ++i) {
+        ok = co_await call->Write(request);
+      }
+      ok = ok && co_await call->WritesDone();
+      grpc::Status status;
+      co_return co_await call->Finish(status) && ok && status.ok();
+    }
+
+    async_grpc::Task<bool> ServerStreamEcho(Rng&) {
+      echo_service::ServerStreamEchoRequest request;
+      request.set_message(m_payload);
+      request.set_count(static_cast<uint32_t>(m_options.messages));
+      grpc::ClientContext context;
+      auto call = co_await m_echo.CallServerStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(echo_service::EchoService, ServerStreamEcho), context, request);
+      if (!call) {
+        co_return false;
+      }
+      echo_service::ServerStreamEchoResponse response;
+      size_t received = 0;
+      while (co_await call->Read(response)) {
+        ++received;
+      }
+      grpc::Status status;
+      co_return co_await call->Finish(status) && status.ok() && received == m_options.messages;
+    }
+
+    async_grpc::Task<bool> BidirectionalStreamEcho(Rng&) {
+      grpc::ClientContext context;
+      auto call = co_await m_echo.CallBidirectionalStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(echo_service::EchoService, BidirectionalStreamEcho), context);
+      if (!call) {
+        co_return false;
+      }
+      echo_service::BidirectionalStreamEchoRequest request;
+      auto* message = request.mutable_message();
+      message->set_message(m_payload);
+      message->set_delay_ms(1);
+      bool ok = co_await call->Write(request);
+      request.mutable_start();
+      ok = ok && co_await call->Write(request);
+      echo_service::BidirectionalStreamEchoResponse response;
+      for (size_t i = 0; ok && i < m_options.messages; ++i) {
+        ok = co_await call->Read(response);
+      }
+      request.mutable_stop();
+      ok = ok && co_await call->Write(request);
+      ok = ok && co_await call->WritesDone();
+      // Drain what the server wrote before receiving the stop
+      while (ok && co_await call->Read(response)) {
+      }
+      grpc::Status status;
+      co_return co_await call->Finish(status) && ok && status.ok();
+    }
+
+    std::string RandomKey(Rng& rng) {
+      return "key" + std::to_string(std::uniform_int_distribution<size_t>(0, m_options.keys - 1)(rng));
+    }
+
+    async_grpc::Task<bool> VariableRead(Rng& rng) {
+      variable_service::ReadRequest request;
+      request.set_key(RandomKey(rng));
+      variable_service::ReadResponse response;
+      grpc::Status status;
+      {
+        grpc::ClientContext context;
+        if (!co_await m_replicas.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Read), context, request, response, status)) {
+          co_return false;
+        }
+      }
+      if (status.error_code() == grpc::StatusCode::UNAVAILABLE && !m_options.replicas.empty()) {
+        // The replica is too far behind or down, the primary has the latest values
+        grpc::ClientContext context;
+        if (!co_await m_variable.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Read), context, request, response, status)) {
+          co_return false;
+        }
+      }
+      co_return status.ok() || status.error_code() == grpc::StatusCode::NOT_FOUND;
+    }
+
+    async_grpc::Task<bool> VariableWrite(Rng& rng) {
+      variable_service::WriteRequest request;
+      request.set_key(RandomKey(rng));
+      request.set_value(static_cast<int64_t>(rng()));
+      variable_service::WriteResponse response;
+      grpc::ClientContext context;
+      grpc::Status status;
+      co_return co_await m_variable.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Write), context, request, response, status) && status.ok();
+    }
+
+    async_grpc::Task<bool> VariableIncrement(Rng& rng) {
+      variable_service::IncrementRequest request;
+      request.set_key(RandomKey(rng));
+      request.set_delta(1);
+      variable_service::IncrementResponse response;
+      grpc::ClientContext context;
+      grpc::Status status;
+      co_return co_await m_variable.CallUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Increment), context, request, response, status) && status.ok();
+    }
+
+    async_grpc::Task<bool> VariableMixed(Rng& rng) {
+      if (std::uniform_real_distribution<double>(0, 1)(rng) < m_options.readRatio) {
+        co_return co_await VariableRead(rng);
+      }
+      co_return co_await VariableWrite(rng);
+    }
+
+    Options m_options;
+    async_grpc::Client<echo_service::EchoService> m_echo;
+    async_grpc::Client<variable_service::VariableService> m_variable;
+    // Where variables are read from, the target itself without replicas
+    async_grpc::Client<variable_service::VariableService> m_replicas;
+    async_grpc::ClientExecutorThreads m_executor;
+    Recorder m_recorder;
+    WaitGroup m_running;
+    std::string m_payload;
+    Scenario m_scenario = nullptr;
+    Clock::time_point m_start;
+    Clock::time_point m_measureStart;
+    Clock::time_point m_end;
+  };
+
+}
+
+int main(int ac, char** av) {
+  loadgen::Options options;
+  if (!loadgen::ParseOptions(ac, av, options)) {
+    std::cerr << loadgen::Usage;
+    return 1;
+  }
+  loadgen::LoadGenerator generator(options);
+  if (!generator.SelectScenario()) {
+    std::cerr << loadgen::Usage;
+    return 1;
+  }
+  generator.Run();
+  generator.Report(std::cout);
+}
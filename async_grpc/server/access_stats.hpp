@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+
+// When and how often a variable was used, for evicting the least recently or least frequently used ones once the store
+// is over its memory budget. Touched by readers under the shared lock of the variable's shard, hence the relaxed atomics:
+// concurrent touches may lose an update, which only makes the stats slightly less accurate.
+// The frequency is a logarithmic counter like Redis' LFU one: it saturates at 255 after about a million accesses, and
+// loses one per DecayPeriodMs without access so that keys that were hot a while ago can be evicted.
+class AccessStats {
+public:
+  static constexpr uint8_t InitialFrequency = 5;
+  static constexpr double LogFactor = 10;
+  static constexpr uint64_t DecayPeriodMs = 60'000;
+
+  AccessStats() = default;
+  AccessStats(const AccessStats& other)
+    : m_lastAccess(other.m_lastAccess.load(std::memory_order_relaxed))
+    , m_frequency(other.m_frequency.load(std::memory_order_relaxed))
+  {}
+  AccessStats& operator=(const AccessStats& other) {
+    m_lastAccess.store(other.m_lastAccess.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_frequency.store(other.m_frequency.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+  }
+
+  // Only writes what changed, readers of a hot key don't keep bouncing its cache line
+  void Touch(uint64_t nowMs) const {
+    uint8_t frequency = Frequency(nowMs);
+    if (frequency < 255) {
+      double base = frequency > InitialFrequency ? frequency - InitialFrequency : 0;
+      thread_local std::minstd_rand random(std::random_device{}());
+      if (std::uniform_real_distribution<double>(0, 1)(random) < 1 / (base * LogFactor + 1)) {
+        ++frequency;
+      }
+    }
+    if (m_frequency.load(std::memory_order_relaxed) != frequency) {
+      m_frequency.store(frequency, std::memory_order_relaxed);
+    }
+    if (m_lastAccess.load(std::memory_order_relaxed) != nowMs) {
+      m_lastAccess.store(nowMs, std::memory_order_relaxed);
+    }
+  }
+
+  // Milliseconds since the unix epoch, 0 if never touched
+  uint64_t LastAccess() const { return m_lastAccess.load(std::memory_order_relaxed); }
+
+  uint8_t Frequency(uint64_t nowMs) const {
+    uint64_t lastAccess = LastAccess();
+    uint8_t frequency = m_frequency.load(std::memory_order_relaxed);
+    if (!lastAccess) {
+      return frequency;
+    }
+    uint64_t periods = nowMs > lastAccess ? (nowMs - lastAccess) / DecayPeriodMs : 0;
+    return periods >= frequency ? 0 : static_cast<uint8_t>(frequency - periods);
+  }
+
+private:
+  mutable std::atomic<uint64_t> m_lastAccess = 0;
+  mutable std::atomic<uint8_t> m_frequency = InitialFrequency;
+};
@@ -0,0 +1,106 @@
+#include "durable_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <utility>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static int OpenFile(const std::filesystem::path& path, DurableFile::Mode mode) {
+  int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (mode == DurableFile::Mode::Append ? _O_APPEND : _O_TRUNC);
+  return _wopen(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+}
+static int WriteSome(int fd, std::string_view data) { return _write(fd, data.data(), static_cast<unsigned>(std::min<size_t>(data.size(), 1u << 30))); }
+static bool SyncFile(int fd) { return _commit(fd) == 0; }
+static void CloseFile(int fd) { _close(fd); }
+// Renames are journaled by NTFS
+static bool SyncDirectory(const std::filesystem::path&) { return true; }
+#else
+static int OpenFile(const std::filesystem::path& path, DurableFile::Mode mode) {
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (mode == DurableFile::Mode::Append ? O_APPEND : O_TRUNC);
+  return ::open(path.c_str(), flags, 0644);
+}
+static ssize_t WriteSome(int fd, std::string_view data) { return ::write(fd, data.data(), data.size()); }
+static bool SyncFile(int fd) { return ::fdatasync(fd) == 0; }
+static void CloseFile(int fd) { ::close(fd); }
+
+static bool SyncDirectory(const std::filesystem::path& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+#endif
+
+utils::expected<DurableFile, std::string> DurableFile::Open(const std::filesystem::path& path, Mode mode)
+{
+  int fd = OpenFile(path, mode);
+  if (fd < 0) {
+    return utils::unexpected("Can't open " + path.string() + ": " + std::strerror(errno));
+  }
+  return DurableFile(fd);
+}
+
+DurableFile::DurableFile(int fd)
+  : m_fd(fd)
+{}
+
+DurableFile::DurableFile(DurableFile&& other) noexcept
+  : m_fd(std::exchange(other.m_fd, -1))
+{}
+
+DurableFile& DurableFile::operator=(DurableFile&& other) noexcept
+{
+  std::swap(m_fd, other.m_fd);
+  return *this;
+}
+
+DurableFile::~DurableFile()
+{
+  if (m_fd >= 0) {
+    CloseFile(m_fd);
+  }
+}
+
+bool DurableFile::Write(std::string_view data)
+{
+  while (!data.empty()) {
+    auto written = WriteSome(m_fd, data);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+  }
+  return true;
+}
+
+bool DurableFile::Sync()
+{
+  return SyncFile(m_fd);
+}
+
+utils::expected<void, std::string> DurableFile::Replace(const std::filesystem::path& from, const std::filesystem::path& to)
+{
+  std::error_code error;
+  std::filesystem::rename(from, to, error);
+  if (error) {
+    return utils::unexpected("Can't rename " + from.string() + " to " + to.string() + ": " + error.message());
+  }
+  auto directory = to.has_parent_path() ? to.parent_path() : std::filesystem::path(".");
+  if (!SyncDirectory(directory)) {
+    return utils::unexpected("Can't sync " + directory.string() + ": " + std::strerror(errno));
+  }
+  return {};
+}
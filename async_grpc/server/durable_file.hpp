@@ -0,0 +1,33 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utils/expected.hpp>
+
+// Write only file with an explicit fsync, which the standard streams don't offer
+class DurableFile {
+public:
+  enum class Mode {
+    Append,
+    Truncate,
+  };
+
+  static utils::expected<DurableFile, std::string> Open(const std::filesystem::path& path, Mode mode);
+
+  DurableFile(DurableFile&& other) noexcept;
+  DurableFile& operator=(DurableFile&& other) noexcept;
+  ~DurableFile();
+
+  bool Write(std::string_view data);
+  // Flushes the content to disk, metadata aside from the size isn't
+  bool Sync();
+
+  // Renames from to to, then syncs the directory so that the rename survives a crash
+  static utils::expected<void, std::string> Replace(const std::filesystem::path& from, const std::filesystem::path& to);
+
+private:
+  explicit DurableFile(int fd);
+
+  int m_fd = -1;
+};
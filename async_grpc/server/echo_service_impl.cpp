@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cassert>
 #include <async_grpc/server.hpp>
 #include <async_grpc/iostream.hpp>
@@ -49,9 +50,11 @@ static async_grpc::Task<> BidirectionalStreamEchoImpl(std::unique_ptr<async_grpc
   async_grpc::Alarm<std::chrono::system_clock::time_point> alarm;
   async_grpc::Task<> subroutine;
   uint32_t delay_ms = 0;
+  // Cancelling the alarm only works while it's pending, the subroutine may be writing at that time
+  std::atomic<bool> stopping = false;
 
   auto writeRoutine = [&]() -> async_grpc::Task<> {
-    while (true) {
+    while (!stopping) {
       utils::Log() << "Write subroutine waiting";
       alarm.SetDeadline(std::chrono::system_clock::now() + std::chrono::milliseconds(delay_ms));
       if (!co_await alarm) {
@@ -91,6 +94,7 @@ static async_grpc::Task<> BidirectionalStreamEchoImpl(std::unique_ptr<async_grpc
         break;
       }
       utils::Log() << "Starting write subroutine";
+      stopping = false;
       subroutine = co_await async_lib::StartSubroutine(writeRoutine());
       break;
     }
@@ -100,6 +104,7 @@ static async_grpc::Task<> BidirectionalStreamEchoImpl(std::unique_ptr<async_grpc
         break;
       }
       utils::Log() << "Stopping subroutine";
+      stopping = true;
       alarm.Cancel();
       co_await std::move(subroutine);
       utils::Log() << "Subroutine stopped";
@@ -111,6 +116,7 @@ static async_grpc::Task<> BidirectionalStreamEchoImpl(std::unique_ptr<async_grpc
   }
   if (subroutine) {
     utils::Log() << "Stopping subroutine";
+    stopping = true;
     alarm.Cancel();
     co_await std::move(subroutine);
     utils::Log() << "Subroutine stopped";
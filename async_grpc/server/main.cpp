@@ -1,21 +1,108 @@
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <async_grpc/server.hpp>
 #include <utils/Logs.hpp>
 #include "echo_service_impl.hpp"
 #include "variable_service_impl.hpp"
+#include "metrics_service_impl.hpp"
+
+static constexpr const char* Usage =
+  "Usage: server [--option=value]...\n"
+  "  --wal=variables.wal      variable service write-ahead log, empty to keep the variables in memory only\n"
+  "  --wal-batch=128          records flushed right away once buffered\n"
+  "  --wal-interval-us=1000   longest a record waits for its batch to fill up\n"
+  "  --snapshot=variables.snapshot   memory mapped on startup and rewritten in the background, empty to only use the log\n"
+  "  --snapshot-log-mb=64     log size that triggers a snapshot\n"
+  "  --max-memory-mb=0        variables past which the least used ones are evicted, 0 for no limit\n"
+  "  --eviction=lru           lru or lfu, which variables to evict first\n"
+  "  --listen=[::1]:4213      address the services listen on\n"
+  "  --replication-buffer-mb=64   log records kept in memory for replicas to catch up from\n"
+  "  --replica-of=host:port   serves reads only, following the variables of that primary in memory, --wal is ignored\n"
+  "  --max-staleness-ms=1000  reads of a replica fail once it caught up with the primary longer ago than that\n";
+
+struct Options {
+  VariableStore::Options store;
+  std::string listen = "[::1]:4213";
+  std::optional<VariableReplica::Options> replica;
+};
+
+static bool ParseOptions(int ac, char** av, Options& all) {
+  auto& options = all.store;
+  options.log.path = "variables.wal";
+  options.snapshot = "variables.snapshot";
+  std::chrono::milliseconds maxStaleness = VariableReplica::Options{}.maxStaleness;
+  for (int i = 1; i < ac; ++i) {
+    std::string_view arg = av[i];
+    auto eq = arg.find('=');
+    if (!arg.starts_with("--") || eq == std::string_view::npos) {
+      return false;
+    }
+    auto name = arg.substr(2, eq - 2);
+    auto value = std::string(arg.substr(eq + 1));
+    if (name == "wal") {
+      options.log.path = value;
+    } else if (name == "wal-batch") {
+      options.log.batchSize = std::stoul(value);
+    } else if (name == "wal-interval-us") {
+      options.log.flushInterval = std::chrono::microseconds(std::stoul(value));
+    } else if (name == "snapshot") {
+      options.snapshot = value;
+    } else if (name == "snapshot-log-mb") {
+      options.snapshotLogSize = std::stoull(value) << 20;
+    } else if (name == "max-memory-mb") {
+      options.memoryBudget = std::stoull(value) << 20;
+    } else if (name == "eviction" && (value == "lru" || value == "lfu")) {
+      options.eviction = value == "lru" ? VariableStore::EvictionPolicy::Lru : VariableStore::EvictionPolicy::Lfu;
+    } else if (name == "listen") {
+      all.listen = value;
+    } else if (name == "replication-buffer-mb") {
+      options.replicationBufferSize = std::stoull(value) << 20;
+    } else if (name == "replica-of") {
+      all.replica.emplace().primary = value;
+    } else if (name == "max-staleness-ms") {
+      maxStaleness = std::chrono::milliseconds(std::stoul(value));
+    } else {
+      return false;
+    }
+  }
+  if (all.replica) {
+    all.replica->maxStaleness = maxStaleness;
+    // The primary's variables replace whatever the replica had
+    options.log.path.clear();
+  }
+  return options.log.batchSize > 0;
+}
+
+int main(int ac, char** av) {
+  Options options;
+  if (!ParseOptions(ac, av, options)) {
+    std::cerr << Usage;
+    return 1;
+  }
 
-int main() {
   utils::Log() << "Setting up services...";
   EchoServiceImpl echo;
   VariableServiceImpl variable;
+  MetricsServiceImpl metrics;
+  if (auto opened = variable.Open(std::move(options.store)); !opened) {
+    utils::Log() << "Failed to open the variables storage: " << opened.error();
+    return 1;
+  }
+  if (options.replica) {
+    variable.ReplicaOf(std::move(*options.replica));
+  }
 
   utils::Log() << "Setting up server...";
   auto server = [&]() {
-    async_grpc::ServerOptions options;
-    options.addresses.push_back("[::1]:4213");
-    options.services.push_back(echo);
-    options.services.push_back(variable);
-    return async_grpc::Server(std::move(options));
+    async_grpc::ServerOptions serverOptions;
+    serverOptions.addresses.push_back(options.listen);
+    serverOptions.services.push_back(echo);
+    serverOptions.services.push_back(variable);
+    serverOptions.services.push_back(metrics);
+    serverOptions.collectMetrics = true;
+    return async_grpc::Server(std::move(serverOptions));
   }();
 
   utils::Log() << "Server started";
@@ -0,0 +1,42 @@
+#include "metrics_service_impl.hpp"
+#include <functional>
+
+static void FillHistogram(metrics_service::Histogram& out, const utils::Histogram& histogram, bool withBuckets) {
+  out.set_count(histogram.Count());
+  out.set_mean(histogram.Mean());
+  out.set_p50(histogram.Percentile(50));
+  out.set_p90(histogram.Percentile(90));
+  out.set_p99(histogram.Percentile(99));
+  out.set_p999(histogram.Percentile(99.9));
+  out.set_max(histogram.Max());
+  if (withBuckets) {
+    for (size_t i = 0; i < utils::Histogram::BucketCount; ++i) {
+      if (uint64_t count = histogram.BucketCountAt(i)) {
+        auto* bucket = out.add_buckets();
+        bucket->set_upper_bound(utils::Histogram::BucketUpperBound(i));
+        bucket->set_count(count);
+      }
+    }
+  }
+}
+
+void MetricsServiceImpl::StartListening(async_grpc::Server& server) {
+  m_server = &server;
+  StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, GetMetrics), std::bind_front(&MetricsServiceImpl::GetMetricsImpl, this));
+}
+
+async_grpc::Task<> MetricsServiceImpl::GetMetricsImpl(std::unique_ptr<async_grpc::ServerUnaryContext<metrics_service::GetMetricsRequest, metrics_service::GetMetricsResponse>> context) {
+  metrics_service::GetMetricsResponse response;
+  for (const auto& snapshot : m_server->CollectMetrics()) {
+    auto* method = response.add_methods();
+    method->set_method(snapshot.method);
+    method->set_calls(snapshot.calls);
+    method->set_in_flight(snapshot.inFlight);
+    method->set_messages_in(snapshot.messagesIn);
+    method->set_bytes_in(snapshot.bytesIn);
+    method->set_messages_out(snapshot.messagesOut);
+    method->set_bytes_out(snapshot.bytesOut);
+    FillHistogram(*method->mutable_handler_duration_ns(), snapshot.handlerDurationNs, context->request.with_buckets());
+  }
+  co_await context->Finish(response);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <async_grpc/server.hpp>
+#include <protos/metrics_service.grpc.pb.h>
+
+// Admin service exposing the metrics collected by the server it listens on, see async_grpc::ServerOptions::collectMetrics
+class MetricsServiceImpl : public async_grpc::BaseServiceImpl<metrics_service::MetricsService> {
+public:
+  virtual void StartListening(async_grpc::Server& server) override;
+
+private:
+  async_grpc::Task<> GetMetricsImpl(std::unique_ptr<async_grpc::ServerUnaryContext<metrics_service::GetMetricsRequest, metrics_service::GetMetricsResponse>> context);
+
+  async_grpc::Server* m_server = nullptr;
+};
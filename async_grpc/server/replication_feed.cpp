@@ -0,0 +1,117 @@
+#include "replication_feed.hpp"
+#include <algorithm>
+
+static gpr_timespec ToTimespec(std::chrono::system_clock::time_point time) {
+  auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+  return gpr_time_from_nanos(sinceEpoch, GPR_CLOCK_REALTIME);
+}
+
+ReplicationFollower::ReplicationFollower(ReplicationFeed& feed)
+  : m_feed(feed)
+{
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  m_feed.m_followers.push_back(this);
+}
+
+ReplicationFollower::~ReplicationFollower()
+{
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  std::erase(m_feed.m_followers, this);
+}
+
+void ReplicationFollower::Wait(grpc::CompletionQueue* cq, void* tag, uint64_t sequence, std::chrono::system_clock::time_point deadline)
+{
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  uint64_t last = m_feed.m_batches.empty() ? m_feed.m_dropped : m_feed.m_batches.back().lastSequence;
+  if (last > sequence) {
+    m_alarm.Set(cq, gpr_time_0(GPR_CLOCK_MONOTONIC), tag);
+    return;
+  }
+  m_alarm.Set(cq, ToTimespec(deadline), tag);
+  m_waiting = true;
+}
+
+void ReplicationFollower::Wake()
+{
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  WakeLocked();
+}
+
+void ReplicationFollower::WakeLocked()
+{
+  if (m_waiting) {
+    // Completes the alarm right away, harmless if its deadline already fired
+    m_alarm.Cancel();
+    m_waiting = false;
+  }
+}
+
+ReplicationPin::ReplicationPin(ReplicationFeed& feed)
+  : m_feed(feed)
+{
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  m_sequence = m_feed.m_batches.empty() ? m_feed.m_dropped : m_feed.m_batches.back().lastSequence;
+  m_feed.m_pins.insert(m_sequence);
+}
+
+ReplicationPin::~ReplicationPin()
+{
+  // The records kept for it are dropped with the next batch
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  m_feed.m_pins.erase(m_feed.m_pins.find(m_sequence));
+}
+
+void ReplicationPin::MoveTo(uint64_t sequence)
+{
+  auto lock = std::unique_lock(m_feed.m_mutex);
+  m_feed.m_pins.erase(m_feed.m_pins.find(m_sequence));
+  m_sequence = sequence;
+  m_feed.m_pins.insert(m_sequence);
+}
+
+ReplicationFeed::ReplicationFeed(uint64_t sequence, size_t maxBytes)
+  : m_maxBytes(maxBytes)
+  , m_dropped(sequence)
+{}
+
+void ReplicationFeed::Append(uint64_t lastSequence, std::string_view records)
+{
+  auto lock = std::unique_lock(m_mutex);
+  m_batches.push_back(Batch{ lastSequence, std::string(records) });
+  m_bytes += records.size();
+  // The batch just appended is always kept, and the ones a pin needs
+  while (m_bytes > m_maxBytes && m_batches.size() > 1 && (m_pins.empty() || m_batches.front().lastSequence <= *m_pins.begin())) {
+    m_bytes -= m_batches.front().records.size();
+    m_dropped = m_batches.front().lastSequence;
+    m_batches.pop_front();
+  }
+  for (ReplicationFollower* follower : m_followers) {
+    follower->WakeLocked();
+  }
+}
+
+std::optional<uint64_t> ReplicationFeed::Read(uint64_t sequence, size_t maxBytes, std::string& records)
+{
+  auto lock = std::unique_lock(m_mutex);
+  uint64_t newest = m_batches.empty() ? m_dropped : m_batches.back().lastSequence;
+  // A replica ahead of the log followed another primary, or one that lost its log
+  if (sequence < m_dropped || sequence > newest) {
+    return std::nullopt;
+  }
+  auto batch = std::upper_bound(m_batches.begin(), m_batches.end(), sequence, [](uint64_t value, const Batch& batch) {
+    return value < batch.lastSequence;
+  });
+  uint64_t last = sequence;
+  for (size_t size = 0; batch != m_batches.end() && (size == 0 || size + batch->records.size() <= maxBytes); ++batch) {
+    records += batch->records;
+    size += batch->records.size();
+    last = batch->lastSequence;
+  }
+  return last;
+}
+
+uint64_t ReplicationFeed::LastSequence()
+{
+  auto lock = std::unique_lock(m_mutex);
+  return m_batches.empty() ? m_dropped : m_batches.back().lastSequence;
+}
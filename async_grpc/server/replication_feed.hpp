@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <grpcpp/alarm.h>
+#include <async_grpc/async_grpc.hpp>
+
+class ReplicationFeed;
+
+// A replica's stream waiting for the primary's log to grow
+class ReplicationFollower {
+public:
+  explicit ReplicationFollower(ReplicationFeed& feed);
+  ReplicationFollower(const ReplicationFollower&) = delete;
+  ReplicationFollower& operator=(const ReplicationFollower&) = delete;
+  ~ReplicationFollower();
+
+  // Resumes once records after sequence are available, Wake is called or deadline is reached, whichever comes first.
+  // The coroutine is resumed on its executor's completion queue. A single wait at a time
+  auto WaitForRecords(uint64_t sequence, std::chrono::system_clock::time_point deadline) {
+    return async_grpc::CompletionQueueAwaitable([this, sequence, deadline](const async_grpc::AwaitData& data) {
+      Wait(data.cq, data.tag, sequence, deadline);
+    });
+  }
+
+  void Wake();
+
+private:
+  friend class ReplicationFeed;
+
+  void Wait(grpc::CompletionQueue* cq, void* tag, uint64_t sequence, std::chrono::system_clock::time_point deadline);
+  // Must be called with the feed's mutex held
+  void WakeLocked();
+
+  ReplicationFeed& m_feed;
+  bool m_waiting = false;
+  // A member for the same reason as VariableWatcher's
+  grpc::Alarm m_alarm;
+};
+
+// Keeps the records after Sequence() in the feed until destroyed, past the feed's maxBytes if need be. For a replica
+// getting a full copy of the variables, whatever changes during the copy is sent next from there
+class ReplicationPin {
+public:
+  explicit ReplicationPin(ReplicationFeed& feed);
+  ReplicationPin(const ReplicationPin&) = delete;
+  ReplicationPin& operator=(const ReplicationPin&) = delete;
+  ~ReplicationPin();
+
+  // The feed's last record when pinned
+  uint64_t Sequence() const { return m_sequence; }
+  // Only keeps the records after sequence from then on, as the replica gets them
+  void MoveTo(uint64_t sequence);
+
+private:
+  ReplicationFeed& m_feed;
+  uint64_t m_sequence;
+};
+
+// The primary's durable log records, kept in memory for the replicas to follow. Records are shipped as they're framed
+// in the log, in the batches they were flushed in. The oldest batches are dropped past maxBytes, a replica that falls
+// further behind than that needs a full copy of the variables
+class ReplicationFeed {
+public:
+  // sequence is the last record already in the log when the feed starts
+  ReplicationFeed(uint64_t sequence, size_t maxBytes);
+  ReplicationFeed(const ReplicationFeed&) = delete;
+  ReplicationFeed& operator=(const ReplicationFeed&) = delete;
+
+  // Called with each batch once it's on disk, see WriteAheadLog::Options::onDurable
+  void Append(uint64_t lastSequence, std::string_view records);
+
+  // Appends the whole batches holding the records after sequence to records, up to about maxBytes, and returns the
+  // sequence of the last record they hold. Empty when the records after sequence were dropped already, or when
+  // sequence is past the last record.
+  // The first batch may start with records up to sequence, they're for the replica to skip
+  std::optional<uint64_t> Read(uint64_t sequence, size_t maxBytes, std::string& records);
+  // Sequence of the last durable record
+  uint64_t LastSequence();
+
+private:
+  friend class ReplicationFollower;
+  friend class ReplicationPin;
+
+  struct Batch {
+    uint64_t lastSequence;
+    std::string records;
+  };
+
+  size_t m_maxBytes;
+  std::mutex m_mutex;
+  std::deque<Batch> m_batches;
+  size_t m_bytes = 0;
+  // Last record before the first batch kept
+  uint64_t m_dropped;
+  std::vector<ReplicationFollower*> m_followers;
+  // Sequences of the pins, no record after the lowest one is dropped
+  std::multiset<uint64_t> m_pins;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+struct Variable {
+  int64_t value = 0;
+  // Sequence number of the last change. Shared by all keys so that a deleted then recreated key never gets an old version back
+  uint64_t version = 0;
+  // Milliseconds since the unix epoch from which the variable is gone, 0 if it never expires. An absolute time so that
+  // replaying the log or loading a snapshot expires it at the same moment
+  uint64_t expiresAt = 0;
+
+  bool Expired(uint64_t nowMs) const { return expiresAt && expiresAt <= nowMs; }
+};
+
+inline uint64_t NowMs() {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+// The store has a single key space, the keys of a tenant are stored as "\0<tenant>\0<key>" and the ones of the default,
+// empty, tenant as they are. Neither a tenant nor a key of the default tenant may start with or contain a '\0' that
+// would make them ambiguous, see ValidKey.
+// Stored keys are hashed in two halves: the high one on their tenant part alone, the low one on the whole key. All the
+// keys of a tenant land in the same shard, where a tenant is fetched or deleted under a single lock, and spread over its
+// slots like any other keys, so a tenant with many keys doesn't slow down the lookups of the others
+
+inline bool ValidKey(std::string_view tenant, std::string_view key) {
+  return tenant.find('\0') == std::string_view::npos && (!tenant.empty() || !key.starts_with('\0'));
+}
+
+inline std::string StoredKey(std::string_view tenant, std::string_view key) {
+  if (tenant.empty()) {
+    return std::string(key);
+  }
+  std::string stored;
+  stored.reserve(tenant.size() + key.size() + 2);
+  stored += '\0';
+  stored += tenant;
+  stored += '\0';
+  stored += key;
+  return stored;
+}
+
+// Returns the tenant and the key
+inline std::pair<std::string_view, std::string_view> SplitStoredKey(std::string_view stored) {
+  if (!stored.starts_with('\0')) {
+    return { {}, stored };
+  }
+  size_t end = stored.find('\0', 1);
+  if (end == std::string_view::npos) {
+    return { {}, stored };
+  }
+  return { stored.substr(1, end - 1), stored.substr(end + 1) };
+}
+
+// "\0<tenant>\0" for the keys of a tenant, which is also StoredKey(tenant, ""), the whole key otherwise
+inline std::string_view HashedPart(std::string_view stored) {
+  auto [tenant, key] = SplitStoredKey(stored);
+  return tenant.empty() ? stored : stored.substr(0, stored.size() - key.size());
+}
+
+// Combines the hash of the tenant part and the one of the whole key, see above
+inline uint64_t CombineKeyHashes(uint64_t tenantHash, uint64_t keyHash) {
+  return (tenantHash & 0xffffffff00000000) | (keyHash & 0xffffffff);
+}
+
+struct StoredKeyHash {
+  static_assert(sizeof(size_t) == sizeof(uint64_t), "The shard comes from the high half of the hash");
+  // The keys of a tenant are chained in their shard, see utils::ShardedHashMap
+  using is_grouping = void;
+
+  size_t operator()(std::string_view stored) const {
+    std::hash<std::string_view> hash;
+    auto hashed = HashedPart(stored);
+    uint64_t keyHash = hash(stored);
+    return CombineKeyHashes(hashed.size() == stored.size() ? keyHash : hash(hashed), keyHash);
+  }
+};
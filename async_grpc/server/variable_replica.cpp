@@ -0,0 +1,143 @@
+#include "variable_replica.hpp"
+#include <algorithm>
+#include <vector>
+#include <async_grpc/iostream.hpp>
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[VariableReplica] ";
+}
+
+VariableReplica::VariableReplica(VariableStore& store, Options options)
+  : m_store(store)
+  , m_options(std::move(options))
+  , m_client(grpc::CreateChannel(m_options.primary, grpc::InsecureChannelCredentials()))
+{
+  async_lib::Spawn(m_executor.GetExecutor(), Run());
+}
+
+VariableReplica::~VariableReplica()
+{
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_stopping = true;
+    if (m_context) {
+      m_context->TryCancel();
+    }
+    if (m_sleeping) {
+      m_alarm.Cancel();
+    }
+  }
+  m_stopped.get_future().wait();
+  m_executor.Shutdown();
+}
+
+bool VariableReplica::Fresh() const
+{
+  auto caughtUpAt = Clock::time_point(Clock::duration(m_caughtUpAt.load(std::memory_order_relaxed)));
+  return caughtUpAt != Clock::time_point::min() && Clock::now() - caughtUpAt <= m_options.maxStaleness;
+}
+
+async_grpc::Task<> VariableReplica::Run()
+{
+  Log() << "Following " << m_options.primary;
+  while (true) {
+    co_await Follow();
+    co_await Sleep(ReconnectDelay);
+    auto lock = std::unique_lock(m_mutex);
+    m_sleeping = false;
+    if (m_stopping) {
+      break;
+    }
+  }
+  m_stopped.set_value();
+}
+
+async_grpc::Task<> VariableReplica::Follow()
+{
+  grpc::ClientContext context;
+  {
+    auto lock = std::unique_lock(m_mutex);
+    if (m_stopping) {
+      co_return;
+    }
+    m_context = &context;
+  }
+  if (m_copying) {
+    // The copy was cut short, the variables are a mix of old and new ones. Starting from scratch, the primary sends
+    // either all its records or another copy
+    m_store.Clear();
+    m_applied = 0;
+    m_copying = false;
+  }
+
+  auto call = co_await m_client.CallBidirectionalStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Replicate), context);
+  if (!call) {
+    auto lock = std::unique_lock(m_mutex);
+    m_context = nullptr;
+    co_return;
+  }
+  variable_service::ReplicateRequest request;
+  request.set_applied_sequence(m_applied);
+  variable_service::ReplicateResponse response;
+  if (co_await call->Write(request)) {
+    Log() << "Resuming from sequence " << m_applied;
+    while (co_await call->Read(response)) {
+      if (!Apply(response)) {
+        Log() << "Received corrupted records, reconnecting";
+        context.TryCancel();
+        break;
+      }
+      request.set_applied_sequence(m_applied);
+      if (!co_await call->Write(request)) {
+        break;
+      }
+    }
+  }
+  grpc::Status status;
+  co_await call->Finish(status);
+  Log() << "Stream to " << m_options.primary << " ended at sequence " << m_applied << " [" << status << ']';
+
+  auto lock = std::unique_lock(m_mutex);
+  m_context = nullptr;
+}
+
+bool VariableReplica::Apply(const variable_service::ReplicateResponse& response)
+{
+  if (response.reset()) {
+    Log() << "Receiving a full copy";
+    m_store.Clear();
+    m_applied = 0;
+    m_copying = true;
+  }
+  if (response.variables_size()) {
+    std::vector<LogEntry> entries;
+    entries.reserve(response.variables_size());
+    for (const auto& variable : response.variables()) {
+      entries.push_back(LogEntry{ variable.key(), variable.value(), variable.version(), variable.expires_at_ms() });
+    }
+    m_store.Apply(entries);
+  }
+  const auto& records = response.records();
+  size_t parsed = WriteAheadLog::ForEachRecord(records, [this](uint64_t sequence, std::span<const LogEntry> entries) {
+    // The first records of a response may be applied already
+    if (sequence > m_applied) {
+      m_store.Apply(entries);
+      m_applied = sequence;
+    }
+  });
+  if (parsed < records.size()) {
+    return false;
+  }
+  if (response.sequence()) {
+    if (m_copying) {
+      Log() << "Full copy received, following from sequence " << response.sequence();
+      m_copying = false;
+    }
+    m_applied = std::max(m_applied, response.sequence());
+  }
+  if (!m_copying && m_applied >= response.primary_sequence()) {
+    m_caughtUpAt.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+  }
+  return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <string>
+#include <grpcpp/alarm.h>
+#include <async_grpc/client.hpp>
+#include <protos/variable_service.grpc.pb.h>
+#include "variable_store.hpp"
+
+// Keeps a store in memory in sync with a primary's, by following its log through the Replicate call. The stream is
+// reopened whenever it breaks, carrying on from the last record applied
+class VariableReplica {
+public:
+  struct Options {
+    // host:port of the primary
+    std::string primary;
+    // Reads are refused once the replica last caught up with the primary longer ago than that. The primary sends
+    // heartbeats every VariableServiceImpl::ReplicationHeartbeatInterval, it has to be longer
+    std::chrono::milliseconds maxStaleness{ 1000 };
+  };
+
+  static constexpr auto ReconnectDelay = std::chrono::seconds(1);
+
+  // The store has to be in memory only, its variables are replaced by the primary's
+  VariableReplica(VariableStore& store, Options options);
+  VariableReplica(const VariableReplica&) = delete;
+  VariableReplica& operator=(const VariableReplica&) = delete;
+  ~VariableReplica();
+
+  // Whether the replica applied everything the primary had on disk at some point in the last maxStaleness
+  bool Fresh() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  async_grpc::Task<> Run();
+  // Returns once the stream breaks
+  async_grpc::Task<> Follow();
+  // Applies a response, false if its records are corrupted
+  bool Apply(const variable_service::ReplicateResponse& response);
+  // Resumes after delay or once the replica is stopping
+  auto Sleep(std::chrono::system_clock::duration delay) {
+    return async_grpc::CompletionQueueAwaitable([this, delay](const async_grpc::AwaitData& data) {
+      auto lock = std::unique_lock(m_mutex);
+      m_alarm.Set(data.cq, std::chrono::system_clock::now() + (m_stopping ? std::chrono::system_clock::duration::zero() : delay), data.tag);
+      m_sleeping = true;
+    });
+  }
+
+  VariableStore& m_store;
+  Options m_options;
+  async_grpc::Client<variable_service::VariableService> m_client;
+
+  // Only used by the coroutine following the primary
+  uint64_t m_applied = 0;
+  bool m_copying = false;
+  // Clock::time_point of the last time the replica caught up, in ticks
+  std::atomic<Clock::rep> m_caughtUpAt = Clock::time_point::min().time_since_epoch().count();
+
+  // Guards what the destructor uses to interrupt the coroutine
+  std::mutex m_mutex;
+  bool m_stopping = false;
+  grpc::ClientContext* m_context = nullptr;
+  bool m_sleeping = false;
+  grpc::Alarm m_alarm;
+  std::promise<void> m_stopped;
+
+  // Last, its thread is joined before anything else is destroyed
+  async_grpc::ClientExecutorThreads m_executor{ 1 };
+};
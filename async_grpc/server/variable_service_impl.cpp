@@ -1,47 +1,676 @@
 #include "variable_service_impl.hpp"
+#include <atomic>
 #include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <async_grpc/iostream.hpp>
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[VariableService] ";
+}
+
+static grpc::Status LogFailure() {
+  return grpc::Status(grpc::StatusCode::UNAVAILABLE, "Failed to persist the change");
+}
+
+static grpc::Status ReadOnly() {
+  return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "This is a read replica, change variables on the primary");
+}
+
+static grpc::Status Stale() {
+  return grpc::Status(grpc::StatusCode::UNAVAILABLE, "The replica is too far behind the primary");
+}
+
+static utils::expected<std::string, grpc::Status> MakeKey(std::string_view tenant, std::string_view key) {
+  if (!ValidKey(tenant, key)) {
+    return utils::unexpected(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid tenant or key"));
+  }
+  return StoredKey(tenant, key);
+}
+
+static bool ValidTenant(std::string_view tenant) {
+  return !tenant.empty() && ValidKey(tenant, {});
+}
+
+// Sets the result of a Session response, or its status when the operation failed. Returns whether it succeeded
+template<typename TResponse>
+static bool SetResult(variable_service::SessionResponse& response, utils::expected<TResponse, grpc::Status> result, TResponse* (variable_service::SessionResponse::*field)()) {
+  if (!result) {
+    response.set_code(result.error().error_code());
+    response.set_message(result.error().error_message());
+    return false;
+  }
+  *(response.*field)() = std::move(*result);
+  return true;
+}
 
 void VariableServiceImpl::StartListening(async_grpc::Server& server) {
   StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Write), std::bind_front(&VariableServiceImpl::WriteImpl, this));
   StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Read), std::bind_front(&VariableServiceImpl::ReadImpl, this));
   StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Del), std::bind_front(&VariableServiceImpl::DelImpl, this));
+  StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Increment), std::bind_front(&VariableServiceImpl::IncrementImpl, this));
+  StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, CompareAndSwap), std::bind_front(&VariableServiceImpl::CompareAndSwapImpl, this));
+  StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Transact), std::bind_front(&VariableServiceImpl::TransactImpl, this));
+  StartListeningServerStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Watch), std::bind_front(&VariableServiceImpl::WatchImpl, this));
+  StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, GetAll), std::bind_front(&VariableServiceImpl::GetAllImpl, this));
+  StartListeningUnary(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, DeleteAll), std::bind_front(&VariableServiceImpl::DeleteAllImpl, this));
+  StartListeningServerStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Scan), std::bind_front(&VariableServiceImpl::ScanImpl, this));
+  StartListeningBidirectionalStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Session), std::bind_front(&VariableServiceImpl::SessionImpl, this));
+  StartListeningBidirectionalStream(server, ASYNC_GRPC_SERVER_LISTEN_FUNC(Service, Replicate), std::bind_front(&VariableServiceImpl::ReplicateImpl, this));
 }
 
 async_grpc::Task<> VariableServiceImpl::WriteImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::WriteRequest, variable_service::WriteResponse>> context) {
-  variable_service::WriteResponse response;
-  bool was_inserted;
-  {
-    auto lock = std::unique_lock(m_mutex);
-    // The forbidden upsert
-    was_inserted = m_storage.insert_or_assign(context->request.key(), context->request.value()).second;
+  auto response = Execute(context->request);
+  if (!response) {
+    co_await context->FinishWithError(response.error());
+    co_return;
+  }
+  if (!co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
   }
-  response.set_was_inserted(was_inserted);
 
-  co_await context->Finish(response);
+  co_await context->Finish(*response);
 }
 
 async_grpc::Task<> VariableServiceImpl::ReadImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::ReadRequest, variable_service::ReadResponse>> context)
 {
-  auto lock = std::shared_lock(m_mutex);
-  auto found = m_storage.find(context->request.key());
-  if (found == m_storage.end()) {
-    lock.unlock();
-    co_await context->FinishWithError(grpc::Status(grpc::StatusCode::NOT_FOUND, "Request key was not found in storage"));
-  } else {
-    variable_service::ReadResponse response;
-    response.set_value(found->second);
-    lock.unlock();
-    co_await context->Finish(response);
+  auto response = Execute(context->request);
+  if (!response) {
+    co_await context->FinishWithError(response.error());
+    co_return;
+  }
+  // The value may come from a change that isn't on disk yet
+  if (!co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
   }
+  co_await context->Finish(*response);
 }
 
 async_grpc::Task<> VariableServiceImpl::DelImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::DelRequest, variable_service::DelResponse>> context) {
-  bool was_deleted;
-  {
-    auto lock = std::unique_lock(m_mutex);
-    was_deleted = m_storage.erase(context->request.key());
+  auto response = Execute(context->request);
+  if (!response) {
+    co_await context->FinishWithError(response.error());
+    co_return;
+  }
+  if (response->was_deleted() && !co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
+  }
+  co_await context->Finish(*response);
+}
+
+async_grpc::Task<> VariableServiceImpl::IncrementImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::IncrementRequest, variable_service::IncrementResponse>> context)
+{
+  auto response = Execute(context->request);
+  if (!response) {
+    co_await context->FinishWithError(response.error());
+    co_return;
+  }
+  if (!co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
+  }
+  co_await context->Finish(*response);
+}
+
+async_grpc::Task<> VariableServiceImpl::CompareAndSwapImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::CompareAndSwapRequest, variable_service::CompareAndSwapResponse>> context)
+{
+  if (m_replica) {
+    co_await context->FinishWithError(ReadOnly());
+    co_return;
+  }
+  const auto& request = context->request;
+  auto key = MakeKey(request.tenant(), request.key());
+  if (!key) {
+    co_await context->FinishWithError(key.error());
+    co_return;
+  }
+  std::optional<int64_t> expected;
+  if (request.has_expected()) {
+    expected = request.expected();
+  }
+  auto result = m_store.CompareAndSwap(*key, expected, request.value());
+  // Also when it didn't swap, current may be a value that isn't on disk yet
+  if (!co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
+  }
+  variable_service::CompareAndSwapResponse response;
+  response.set_swapped(result.swapped);
+  if (result.current) {
+    response.set_current(result.current->value);
+  }
+  co_await context->Finish(response);
+}
+
+async_grpc::Task<> VariableServiceImpl::TransactImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::TransactRequest, variable_service::TransactResponse>> context)
+{
+  auto response = Execute(context->request);
+  if (!response) {
+    co_await context->FinishWithError(response.error());
+    co_return;
+  }
+  if (response->committed() && !co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
+  }
+  co_await context->Finish(*response);
+}
+
+async_grpc::Task<> VariableServiceImpl::WatchImpl(std::unique_ptr<async_grpc::ServerServerStreamContext<variable_service::WatchRequest, variable_service::WatchResponse>> context)
+{
+  const auto& request = context->request;
+  if (request.keys().empty() && request.prefixes().empty()) {
+    co_await context->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Nothing to watch"));
+    co_return;
+  }
+  if (request.keys_size() + request.prefixes_size() > MaxWatchedKeys) {
+    co_await context->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Too many keys and prefixes, the limit is " + std::to_string(MaxWatchedKeys)));
+    co_return;
+  }
+  bool valid = true;
+  std::vector<std::string> keys;
+  std::vector<std::string> prefixes;
+  for (const auto& key : request.keys()) {
+    valid = valid && ValidKey(request.tenant(), key);
+    keys.push_back(StoredKey(request.tenant(), key));
+  }
+  for (const auto& prefix : request.prefixes()) {
+    valid = valid && ValidKey(request.tenant(), prefix);
+    prefixes.push_back(StoredKey(request.tenant(), prefix));
+  }
+  if (!valid) {
+    co_await context->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid tenant or key"));
+    co_return;
+  }
+  auto watcher = m_store.Watch(keys, prefixes);
+  variable_service::WatchResponse response;
+  while (true) {
+    // Also wakes up when nothing changes, the empty response finds out whether the client is still there
+    co_await watcher->WaitForChanges(std::chrono::system_clock::now() + WatchHeartbeatInterval);
+    if (watcher->Overflowed()) {
+      co_await context->Finish(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many changes pending, watch again"));
+      co_return;
+    }
+    auto changes = watcher->Take();
+    // Like the other calls, nothing is shown before it's on disk
+    if (!changes.empty() && !co_await Durable()) {
+      co_await context->Finish(LogFailure());
+      co_return;
+    }
+    response.clear_events();
+    for (const auto& change : changes) {
+      response.add_events(change->event);
+    }
+    if (!co_await context->Write(response)) {
+      // The client is gone
+      co_await context->Finish(grpc::Status::CANCELLED);
+      co_return;
+    }
+  }
+}
+
+async_grpc::Task<> VariableServiceImpl::GetAllImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::GetAllRequest, variable_service::GetAllResponse>> context)
+{
+  if (!Fresh()) {
+    co_await context->FinishWithError(Stale());
+    co_return;
+  }
+  if (!ValidTenant(context->request.tenant())) {
+    co_await context->FinishWithError(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid tenant"));
+    co_return;
+  }
+  variable_service::GetAllResponse response;
+  for (auto& [key, variable] : m_store.GetAll(context->request.tenant())) {
+    auto* added = response.add_variables();
+    added->set_key(std::move(key));
+    added->set_value(variable.value);
+    added->set_version(variable.version);
+  }
+  // Some of them may not be on disk yet
+  if (response.variables_size() && !co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
+  }
+  co_await context->Finish(response);
+}
+
+async_grpc::Task<> VariableServiceImpl::DeleteAllImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::DeleteAllRequest, variable_service::DeleteAllResponse>> context)
+{
+  if (m_replica) {
+    co_await context->FinishWithError(ReadOnly());
+    co_return;
+  }
+  if (!ValidTenant(context->request.tenant())) {
+    co_await context->FinishWithError(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid tenant"));
+    co_return;
+  }
+  variable_service::DeleteAllResponse response;
+  response.set_deleted(static_cast<uint32_t>(m_store.DeleteAll(context->request.tenant())));
+  if (response.deleted() && !co_await Durable()) {
+    co_await context->FinishWithError(LogFailure());
+    co_return;
   }
-  variable_service::DelResponse response;
-  response.set_was_deleted(was_deleted);
   co_await context->Finish(response);
 }
+
+async_grpc::Task<> VariableServiceImpl::ScanImpl(std::unique_ptr<async_grpc::ServerServerStreamContext<variable_service::ScanRequest, variable_service::ScanResponse>> context)
+{
+  const auto& request = context->request;
+  if (!ValidKey(request.tenant(), {})) {
+    co_await context->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid tenant"));
+    co_return;
+  }
+  if (!Fresh()) {
+    co_await context->Finish(Stale());
+    co_return;
+  }
+  variable_service::ScanCursor cursor;
+  if (!request.cursor().empty()) {
+    if (!cursor.ParseFromString(request.cursor())) {
+      co_await context->Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid cursor"));
+      co_return;
+    }
+    if (cursor.snapshot_sequence() != m_store.SnapshotSequence()) {
+      co_await context->Finish(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "The cursor is from before a restart, scan again"));
+      co_return;
+    }
+  }
+  cursor.set_snapshot_sequence(m_store.SnapshotSequence());
+  auto matches = [&](std::string_view key) {
+    return key.starts_with(request.prefix()) && key >= request.start() && (request.end().empty() || key < request.end());
+  };
+
+  // Each batch waits for the previous one to be written: a slow client slows the scan down instead of piling responses
+  // up, and no lock is held while waiting
+  uint64_t remaining = request.limit() ? request.limit() : std::numeric_limits<uint64_t>::max();
+  variable_service::ScanResponse response;
+  size_t responseBytes = 0;
+  // Returns false once the call is finished
+  auto send = [&](bool finish) -> async_grpc::Task<bool> {
+    // Like GetAll, the variables may not be on disk yet
+    if (response.variables_size() && !co_await Durable()) {
+      co_await context->Finish(LogFailure());
+      co_return false;
+    }
+    if (finish) {
+      co_await context->WriteAndFinish(response, grpc::WriteOptions());
+      co_return false;
+    }
+    if (!co_await context->Write(response)) {
+      // The client is gone
+      co_await context->Finish(grpc::Status::CANCELLED);
+      co_return false;
+    }
+    response.Clear();
+    responseBytes = 0;
+    co_return true;
+  };
+
+  VariableStore::ScanPosition position{ cursor.unit(), cursor.after() };
+  std::vector<std::pair<std::string, Variable>> variables;
+  while (m_store.ScanUnit(request.tenant(), position, variables)) {
+    for (auto& [key, variable] : variables) {
+      if (!matches(key)) {
+        continue;
+      }
+      cursor.set_after(key);
+      responseBytes += key.size() + 2 * sizeof(uint64_t);
+      auto* added = response.add_variables();
+      added->set_key(std::move(key));
+      added->set_value(variable.value);
+      added->set_version(variable.version);
+      if (--remaining == 0 || responseBytes >= ScanBatchBytes) {
+        cursor.SerializeToString(response.mutable_cursor());
+        // Past the limit, the cursor lets the client ask for the next ones
+        if (!co_await send(remaining == 0)) {
+          co_return;
+        }
+      }
+    }
+    position = VariableStore::ScanPosition{ position.unit + 1, {} };
+    cursor.set_unit(position.unit);
+    cursor.clear_after();
+  }
+  // No cursor, the scan is over
+  co_await send(true);
+}
+
+async_grpc::Task<> VariableServiceImpl::SessionImpl(std::unique_ptr<async_grpc::ServerBidirectionalStreamContext<variable_service::SessionRequest, variable_service::SessionResponse>> context)
+{
+  // Requests are read ahead by a subroutine while the previous ones wait for the log. The ones received meanwhile are
+  // then run as a batch whose changes share the next sync, the same group commit as separate calls get from the log
+  std::mutex mutex;
+  std::vector<variable_service::SessionRequest> received;
+  bool readerDone = false;
+  std::atomic<bool> stopping = false;
+  async_grpc::Event receivedEvent;
+  async_grpc::Event drainedEvent;
+  auto readRequests = [&]() -> async_grpc::Task<> {
+    while (!stopping) {
+      bool full;
+      {
+        auto lock = std::unique_lock(mutex);
+        full = received.size() >= MaxSessionPending;
+      }
+      if (full) {
+        co_await drainedEvent.Wait();
+        continue;
+      }
+      variable_service::SessionRequest request;
+      if (!co_await context->Read(request)) {
+        break;
+      }
+      {
+        auto lock = std::unique_lock(mutex);
+        received.push_back(std::move(request));
+      }
+      receivedEvent.Set();
+    }
+    {
+      auto lock = std::unique_lock(mutex);
+      readerDone = true;
+    }
+    receivedEvent.Set();
+  };
+  auto reader = co_await async_lib::StartSubroutine(readRequests());
+
+  // Returns false once the client is gone. Responses are buffered until the last one, it flushes them all
+  auto send = [&](const std::vector<variable_service::SessionResponse>& responses) -> async_grpc::Task<bool> {
+    for (size_t i = 0; i < responses.size(); ++i) {
+      auto options = grpc::WriteOptions();
+      if (i + 1 < responses.size()) {
+        options.set_buffer_hint();
+      }
+      if (!co_await context->Write(responses[i], options)) {
+        co_return false;
+      }
+    }
+    co_return true;
+  };
+
+  std::vector<variable_service::SessionRequest> batch;
+  std::vector<variable_service::SessionResponse> responses;
+  // Indexes of the responses to only send once on disk
+  std::vector<size_t> durable;
+  bool done = false;
+  bool gone = false;
+  while (!done && !gone) {
+    co_await receivedEvent.Wait();
+    {
+      auto lock = std::unique_lock(mutex);
+      batch.swap(received);
+      done = readerDone;
+    }
+    drainedEvent.Set();
+    for (const auto& request : batch) {
+      if (Execute(request, responses.emplace_back())) {
+        durable.push_back(responses.size() - 1);
+      }
+    }
+    batch.clear();
+    // Reads may see the changes made earlier in the batch, they all wait for the log together. Responses are sent in the
+    // order the requests were received
+    if (!durable.empty() && !co_await Durable()) {
+      for (size_t index : durable) {
+        auto& response = responses[index];
+        auto tag = response.tag();
+        response.Clear();
+        response.set_tag(tag);
+        response.set_code(LogFailure().error_code());
+        response.set_message(LogFailure().error_message());
+      }
+    }
+    gone = !co_await send(responses);
+    responses.clear();
+    durable.clear();
+  }
+
+  stopping = true;
+  if (!done) {
+    // The client is gone, the pending read has to complete
+    context->context.TryCancel();
+  }
+  drainedEvent.Set();
+  co_await std::move(reader);
+  co_await context->Finish(done ? grpc::Status::OK : grpc::Status::CANCELLED);
+}
+
+async_grpc::Task<> VariableServiceImpl::ReplicateImpl(std::unique_ptr<async_grpc::ServerBidirectionalStreamContext<variable_service::ReplicateRequest, variable_service::ReplicateResponse>> context)
+{
+  auto* feed = m_store.GetReplicationFeed();
+  if (!feed) {
+    co_await context->Finish(grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Only a primary with a log can be replicated"));
+    co_return;
+  }
+  variable_service::ReplicateRequest request;
+  if (!co_await context->Read(request)) {
+    co_await context->Finish(grpc::Status::CANCELLED);
+    co_return;
+  }
+  std::string peer = context->context.peer();
+  Log() << "Replica " << peer << " following from sequence " << request.applied_sequence();
+
+  // Acknowledgements are read concurrently with the responses being sent, they only tell how far behind the replica is
+  ReplicationFollower follower(*feed);
+  std::atomic<uint64_t> acked = request.applied_sequence();
+  std::atomic<bool> stopping = false;
+  auto readAcks = [&]() -> async_grpc::Task<> {
+    variable_service::ReplicateRequest ack;
+    while (co_await context->Read(ack)) {
+      acked = ack.applied_sequence();
+    }
+    stopping = true;
+    follower.Wake();
+  };
+  auto reader = co_await async_lib::StartSubroutine(readAcks());
+
+  variable_service::ReplicateResponse response;
+  grpc::Status status;
+  // Returns false once the replica is gone
+  auto send = [&]() -> async_grpc::Task<bool> {
+    bool sent = !stopping && co_await context->Write(response);
+    response.Clear();
+    co_return sent;
+  };
+  uint64_t after = request.applied_sequence();
+  // Held from the start of a full copy until the replica caught up, following it, so that the records written during
+  // the copy can't be dropped before they're sent and trigger another copy
+  std::optional<ReplicationPin> copyPin;
+  while (!stopping) {
+    // Before reading the records, the replica is up to date once it applied them
+    uint64_t primarySequence = feed->LastSequence();
+    auto last = feed->Read(after, ReplicationBatchBytes, *response.mutable_records());
+    if (last && copyPin) {
+      if (*last >= primarySequence) {
+        copyPin.reset();
+      } else {
+        copyPin->MoveTo(*last);
+      }
+    } else if (!last) {
+      // The records the replica needs were dropped, it gets all the variables instead. They're copied a unit at a time
+      // after the pinned sequence, the records from there on are sent next to bring them all to the same point. The
+      // CQ thread only holds a lock for a unit, and is given back whenever a response is sent
+      copyPin.emplace(*feed);
+      uint64_t start = copyPin->Sequence();
+      Log() << "Sending a full copy of the variables to " << peer;
+      response.set_reset(true);
+      // Like GetAll, the variables may not be on disk yet
+      auto sendCopy = [&]() -> async_grpc::Task<bool> {
+        if (!co_await Durable()) {
+          status = LogFailure();
+          co_return false;
+        }
+        co_return co_await send();
+      };
+      size_t responseBytes = 0;
+      size_t copied = 0;
+      bool sent = true;
+      std::vector<std::pair<std::string, Variable>> variables;
+      for (uint64_t unit = 0; sent && m_store.CopyUnit(unit, variables); ++unit) {
+        for (auto& [key, variable] : variables) {
+          auto* added = response.add_variables();
+          added->set_key(std::move(key));
+          added->set_value(variable.value);
+          added->set_version(variable.version);
+          added->set_expires_at_ms(variable.expiresAt);
+          responseBytes += added->key().size() + 3 * sizeof(uint64_t);
+          ++copied;
+          if (responseBytes >= ReplicationBatchBytes) {
+            sent = co_await sendCopy();
+            responseBytes = 0;
+            if (!sent) {
+              break;
+            }
+          }
+        }
+      }
+      if (!sent) {
+        break;
+      }
+      response.set_sequence(start);
+      response.set_primary_sequence(feed->LastSequence());
+      if (!co_await sendCopy()) {
+        break;
+      }
+      Log() << "Sent a full copy of " << copied << " variables to " << peer;
+      after = start;
+      continue;
+    }
+    if (*last == after) {
+      // Nothing new, the heartbeat is only sent if the deadline is reached first
+      co_await follower.WaitForRecords(after, std::chrono::system_clock::now() + ReplicationHeartbeatInterval);
+      primarySequence = feed->LastSequence();
+      if (primarySequence > after) {
+        continue;
+      }
+    }
+    response.set_sequence(*last);
+    response.set_primary_sequence(primarySequence);
+    if (!co_await send()) {
+      break;
+    }
+    after = *last;
+  }
+
+  if (!stopping) {
+    // The replica is still there, its pending read has to complete
+    context->context.TryCancel();
+  }
+  co_await std::move(reader);
+  Log() << "Replica " << peer << " stopped following at sequence " << acked << ", " << feed->LastSequence() - std::min(acked.load(), feed->LastSequence()) << " records behind";
+  co_await context->Finish(status);
+}
+
+utils::expected<variable_service::ReadResponse, grpc::Status> VariableServiceImpl::Execute(const variable_service::ReadRequest& request)
+{
+  if (!Fresh()) {
+    return utils::unexpected(Stale());
+  }
+  auto key = MakeKey(request.tenant(), request.key());
+  if (!key) {
+    return utils::unexpected(key.error());
+  }
+  auto found = m_store.Read(*key);
+  if (!found) {
+    return utils::unexpected(grpc::Status(grpc::StatusCode::NOT_FOUND, "Request key was not found in storage"));
+  }
+  variable_service::ReadResponse response;
+  response.set_value(found->value);
+  response.set_version(found->version);
+  response.set_expires_at_ms(found->expiresAt);
+  return response;
+}
+
+utils::expected<variable_service::WriteResponse, grpc::Status> VariableServiceImpl::Execute(const variable_service::WriteRequest& request)
+{
+  if (m_replica) {
+    return utils::unexpected(ReadOnly());
+  }
+  auto key = MakeKey(request.tenant(), request.key());
+  if (!key) {
+    return utils::unexpected(key.error());
+  }
+  variable_service::WriteResponse response;
+  // The forbidden upsert
+  uint64_t ttl = request.ttl_ms();
+  response.set_was_inserted(m_store.Write(*key, request.value(), ttl ? NowMs() + ttl : 0));
+  return response;
+}
+
+utils::expected<variable_service::DelResponse, grpc::Status> VariableServiceImpl::Execute(const variable_service::DelRequest& request)
+{
+  if (m_replica) {
+    return utils::unexpected(ReadOnly());
+  }
+  auto key = MakeKey(request.tenant(), request.key());
+  if (!key) {
+    return utils::unexpected(key.error());
+  }
+  variable_service::DelResponse response;
+  response.set_was_deleted(m_store.Del(*key));
+  return response;
+}
+
+utils::expected<variable_service::IncrementResponse, grpc::Status> VariableServiceImpl::Execute(const variable_service::IncrementRequest& request)
+{
+  if (m_replica) {
+    return utils::unexpected(ReadOnly());
+  }
+  auto key = MakeKey(request.tenant(), request.key());
+  if (!key) {
+    return utils::unexpected(key.error());
+  }
+  auto incremented = m_store.Increment(*key, request.delta(), request.initial_value());
+  if (!incremented) {
+    return utils::unexpected(incremented.error());
+  }
+  variable_service::IncrementResponse response;
+  response.set_value(incremented->value);
+  return response;
+}
+
+utils::expected<variable_service::TransactResponse, grpc::Status> VariableServiceImpl::Execute(const variable_service::TransactRequest& request)
+{
+  if (m_replica) {
+    return utils::unexpected(ReadOnly());
+  }
+  return m_store.Transact(request);
+}
+
+bool VariableServiceImpl::Execute(const variable_service::SessionRequest& request, variable_service::SessionResponse& response)
+{
+  using variable_service::SessionRequest;
+  using variable_service::SessionResponse;
+  response.set_tag(request.tag());
+  switch (request.operation_case()) {
+  case SessionRequest::kRead:
+    // Like the unary Read, the value may not be on disk yet
+    return SetResult(response, Execute(request.read()), &SessionResponse::mutable_read);
+  case SessionRequest::kWrite:
+    return SetResult(response, Execute(request.write()), &SessionResponse::mutable_write);
+  case SessionRequest::kDel:
+    return SetResult(response, Execute(request.del()), &SessionResponse::mutable_del) && response.del().was_deleted();
+  case SessionRequest::kIncrement:
+    return SetResult(response, Execute(request.increment()), &SessionResponse::mutable_increment);
+  case SessionRequest::kTransact:
+    return SetResult(response, Execute(request.transact()), &SessionResponse::mutable_transact) && response.transact().committed();
+  default:
+    response.set_code(grpc::StatusCode::INVALID_ARGUMENT);
+    response.set_message("No operation");
+    return false;
+  }
+}
+
+async_grpc::Task<bool> VariableServiceImpl::Durable()
+{
+  if (auto* log = m_store.GetLog()) {
+    co_return co_await log->Sync();
+  }
+  co_return true;
+}
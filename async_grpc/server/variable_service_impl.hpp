@@ -1,19 +1,64 @@
 #pragma once
 
+#include <chrono>
+#include <memory>
 #include <async_grpc/server.hpp>
 #include <protos/variable_service.grpc.pb.h>
-#include <map>
-#include <shared_mutex>
+#include "variable_replica.hpp"
+#include "variable_store.hpp"
 
 class VariableServiceImpl : public async_grpc::BaseServiceImpl<variable_service::VariableService> {
 public:
   virtual void StartListening(async_grpc::Server& server) override;
 
+  // Makes the variables survive restarts unless the log path is empty, changes are then only acknowledged once logged
+  // to disk
+  utils::expected<void, std::string> Open(VariableStore::Options options) { return m_store.Open(std::move(options)); }
+  // Makes the service a read replica of a primary, once opened in memory only. Changes are refused, reads are refused
+  // while the replica is too far behind
+  void ReplicaOf(VariableReplica::Options options) { m_replica = std::make_unique<VariableReplica>(m_store, std::move(options)); }
+
+  // How often the primary tells an idle replica it's up to date, see VariableReplica::Options::maxStaleness
+  static constexpr auto ReplicationHeartbeatInterval = std::chrono::milliseconds(100);
+
 private:
+  static constexpr auto WatchHeartbeatInterval = std::chrono::seconds(5);
+  // Keys and prefixes of a single Watch call
+  static constexpr int MaxWatchedKeys = 1024;
+  // Scan responses are sent once they hold that much
+  static constexpr size_t ScanBatchBytes = 64 << 10;
+  // Replicate responses hold about that much
+  static constexpr size_t ReplicationBatchBytes = 1 << 20;
+  // Session requests read ahead of the ones being run, past that the client is slowed down by flow control
+  static constexpr size_t MaxSessionPending = 1024;
+
   async_grpc::Task<> WriteImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::WriteRequest, variable_service::WriteResponse>> context);
   async_grpc::Task<> ReadImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::ReadRequest, variable_service::ReadResponse>> context);
   async_grpc::Task<> DelImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::DelRequest, variable_service::DelResponse>> context);
+  async_grpc::Task<> IncrementImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::IncrementRequest, variable_service::IncrementResponse>> context);
+  async_grpc::Task<> CompareAndSwapImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::CompareAndSwapRequest, variable_service::CompareAndSwapResponse>> context);
+  async_grpc::Task<> TransactImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::TransactRequest, variable_service::TransactResponse>> context);
+  async_grpc::Task<> GetAllImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::GetAllRequest, variable_service::GetAllResponse>> context);
+  async_grpc::Task<> DeleteAllImpl(std::unique_ptr<async_grpc::ServerUnaryContext<variable_service::DeleteAllRequest, variable_service::DeleteAllResponse>> context);
+  async_grpc::Task<> WatchImpl(std::unique_ptr<async_grpc::ServerServerStreamContext<variable_service::WatchRequest, variable_service::WatchResponse>> context);
+  async_grpc::Task<> ScanImpl(std::unique_ptr<async_grpc::ServerServerStreamContext<variable_service::ScanRequest, variable_service::ScanResponse>> context);
+  async_grpc::Task<> SessionImpl(std::unique_ptr<async_grpc::ServerBidirectionalStreamContext<variable_service::SessionRequest, variable_service::SessionResponse>> context);
+  async_grpc::Task<> ReplicateImpl(std::unique_ptr<async_grpc::ServerBidirectionalStreamContext<variable_service::ReplicateRequest, variable_service::ReplicateResponse>> context);
+  // Whether reads may be served, always on a primary
+  bool Fresh() const { return !m_replica || m_replica->Fresh(); }
+  // What the calls do to the store, shared by the unary calls and Session. The changes are made but not on disk yet
+  utils::expected<variable_service::ReadResponse, grpc::Status> Execute(const variable_service::ReadRequest& request);
+  utils::expected<variable_service::WriteResponse, grpc::Status> Execute(const variable_service::WriteRequest& request);
+  utils::expected<variable_service::DelResponse, grpc::Status> Execute(const variable_service::DelRequest& request);
+  utils::expected<variable_service::IncrementResponse, grpc::Status> Execute(const variable_service::IncrementRequest& request);
+  utils::expected<variable_service::TransactResponse, grpc::Status> Execute(const variable_service::TransactRequest& request);
+  // Runs the operation of a Session request, returns whether it changed or read variables and has to wait for them to be
+  // on disk
+  bool Execute(const variable_service::SessionRequest& request, variable_service::SessionResponse& response);
+  // Waits for the changes made so far to be on disk, false if they couldn't be written
+  async_grpc::Task<bool> Durable();
 
-  std::shared_mutex m_mutex;
-  std::map<std::string, int64_t> m_storage;
+  VariableStore m_store;
+  // Null on a primary. After the store, it's stopped before the store goes away
+  std::unique_ptr<VariableReplica> m_replica;
 };
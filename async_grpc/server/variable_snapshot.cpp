@@ -0,0 +1,219 @@
+#include "variable_snapshot.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include "durable_file.hpp"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char Magic[8] = { 'V', 'A', 'R', 'S', 'N', 'A', 'P', '\0' };
+
+#ifdef _WIN32
+static utils::expected<std::pair<const char*, size_t>, std::string> MapFile(const std::filesystem::path& path) {
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return utils::unexpected("Can't open " + path.string());
+  }
+  LARGE_INTEGER size{};
+  GetFileSizeEx(file, &size);
+  HANDLE mapping = size.QuadPart ? CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+  CloseHandle(file);
+  if (!mapping) {
+    return utils::unexpected("Can't map " + path.string());
+  }
+  // The view keeps the mapping alive
+  auto* data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  CloseHandle(mapping);
+  if (!data) {
+    return utils::unexpected("Can't map " + path.string());
+  }
+  return std::pair(data, static_cast<size_t>(size.QuadPart));
+}
+
+static void UnmapFile(const char* data, size_t) {
+  UnmapViewOfFile(data);
+}
+#else
+static utils::expected<std::pair<const char*, size_t>, std::string> MapFile(const std::filesystem::path& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return utils::unexpected("Can't open " + path.string() + ": " + std::strerror(errno));
+  }
+  struct stat status {};
+  if (::fstat(fd, &status) != 0 || status.st_size == 0) {
+    ::close(fd);
+    return utils::unexpected("Can't map the empty or unreadable " + path.string());
+  }
+  auto size = static_cast<size_t>(status.st_size);
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping keeps the file alive
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return utils::unexpected("Can't map " + path.string() + ": " + std::strerror(errno));
+  }
+  // Lookups land anywhere in the table, reading ahead would only waste memory
+  ::madvise(data, size, MADV_RANDOM);
+  return std::pair(static_cast<const char*>(data), size);
+}
+
+static void UnmapFile(const char* data, size_t size) {
+  ::munmap(const_cast<char*>(data), size);
+}
+#endif
+
+utils::expected<std::unique_ptr<VariableSnapshot>, std::string> VariableSnapshot::Load(const std::filesystem::path& path)
+{
+  auto mapped = MapFile(path);
+  if (!mapped) {
+    return utils::unexpected(std::move(mapped.error()));
+  }
+  auto [data, size] = *mapped;
+  auto snapshot = std::unique_ptr<VariableSnapshot>(new VariableSnapshot(data, size));
+  // Only the header is checked, the rest is faulted in lazily. Keys are bounds checked when read
+  if (size < sizeof(Header) || std::memcmp(snapshot->GetHeader().magic, Magic, sizeof(Magic)) != 0) {
+    return utils::unexpected(path.string() + " isn't a variable snapshot");
+  }
+  const Header& header = snapshot->GetHeader();
+  if (header.formatVersion != FormatVersion) {
+    return utils::unexpected(path.string() + " has format version " + std::to_string(header.formatVersion) + ", expected " + std::to_string(FormatVersion));
+  }
+  bool validSize = std::has_single_bit(header.slotCount) && header.slotCount < size / sizeof(Slot) && header.count < header.slotCount
+    && std::has_single_bit(header.tenantSlotCount) && header.tenantSlotCount < size / sizeof(TenantSlot) && header.memberCount <= header.count
+    && sizeof(Header) + header.slotCount * sizeof(Slot) + header.tenantSlotCount * sizeof(TenantSlot) + header.memberCount * sizeof(uint64_t) + header.keysSize == size;
+  if (!validSize) {
+    return utils::unexpected(path.string() + " is truncated or corrupted");
+  }
+  return snapshot;
+}
+
+utils::expected<void, std::string> VariableSnapshot::Write(const std::filesystem::path& path, const std::unordered_map<std::string, Variable>& variables, uint64_t logSequence, uint64_t lastVersion)
+{
+  Header header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.formatVersion = FormatVersion;
+  header.logSequence = logSequence;
+  header.lastVersion = lastVersion;
+  header.count = variables.size();
+  // Same 3/4 load factor as the in memory map
+  header.slotCount = std::max<uint64_t>(16, std::bit_ceil(variables.size() * 4 / 3 + 1));
+
+  std::vector<Slot> slots(header.slotCount, Slot{});
+  std::string keys;
+  // The slots of each tenant's keys, by StoredKey(tenant, {})
+  std::unordered_map<std::string_view, std::vector<uint64_t>> tenants;
+  uint64_t mask = header.slotCount - 1;
+  for (const auto& [key, variable] : variables) {
+    uint64_t hash = Hash(key);
+    uint64_t i = hash & mask;
+    while (slots[i].hash) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = Slot{ hash, keys.size(), static_cast<uint32_t>(key.size()), 0, variable.value, variable.version, variable.expiresAt };
+    keys.append(key);
+    if (!SplitStoredKey(key).first.empty()) {
+      tenants[HashedPart(key)].push_back(i);
+    }
+  }
+  header.keysSize = keys.size();
+
+  header.tenantSlotCount = std::max<uint64_t>(16, std::bit_ceil(tenants.size() * 4 / 3 + 1));
+  std::vector<TenantSlot> tenantSlots(header.tenantSlotCount, TenantSlot{});
+  std::vector<uint64_t> members;
+  members.reserve(variables.size());
+  uint64_t tenantMask = header.tenantSlotCount - 1;
+  for (const auto& [prefix, tenantMembers] : tenants) {
+    uint64_t hash = HashBytes(prefix);
+    uint64_t i = hash & tenantMask;
+    while (tenantSlots[i].hash) {
+      i = (i + 1) & tenantMask;
+    }
+    tenantSlots[i] = TenantSlot{ hash, members.size(), tenantMembers.size() };
+    members.insert(members.end(), tenantMembers.begin(), tenantMembers.end());
+  }
+  header.memberCount = members.size();
+
+  auto writingPath = path;
+  writingPath += ".writing";
+  auto file = DurableFile::Open(writingPath, DurableFile::Mode::Truncate);
+  if (!file) {
+    return utils::unexpected(std::move(file.error()));
+  }
+  bool written = file->Write(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)))
+    && file->Write(std::string_view(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(Slot)))
+    && file->Write(std::string_view(reinterpret_cast<const char*>(tenantSlots.data()), tenantSlots.size() * sizeof(TenantSlot)))
+    && file->Write(std::string_view(reinterpret_cast<const char*>(members.data()), members.size() * sizeof(uint64_t)))
+    && file->Write(keys)
+    && file->Sync();
+  if (!written) {
+    return utils::unexpected("Failed to write " + writingPath.string() + ": " + std::strerror(errno));
+  }
+  return DurableFile::Replace(writingPath, path);
+}
+
+VariableSnapshot::VariableSnapshot(const char* data, size_t size)
+  : m_data(data)
+  , m_size(size)
+{}
+
+VariableSnapshot::~VariableSnapshot()
+{
+  UnmapFile(m_data, m_size);
+}
+
+std::optional<Variable> VariableSnapshot::Find(std::string_view key) const
+{
+  uint64_t hash = Hash(key);
+  uint64_t mask = SlotCount() - 1;
+  // Bounded so that a corrupted table without empty slots can't loop forever
+  for (uint64_t probe = 0, i = hash & mask; probe < SlotCount() && Slots()[i].hash; ++probe, i = (i + 1) & mask) {
+    const Slot& slot = Slots()[i];
+    if (slot.hash == hash && ValidKey(slot) && Key(slot) == key) {
+      return ToVariable(slot);
+    }
+  }
+  return std::nullopt;
+}
+
+const VariableSnapshot::TenantSlot* VariableSnapshot::FindTenant(std::string_view prefix) const
+{
+  uint64_t hash = HashBytes(prefix);
+  uint64_t count = GetHeader().tenantSlotCount;
+  uint64_t mask = count - 1;
+  for (uint64_t probe = 0, i = hash & mask; probe < count && TenantSlots()[i].hash; ++probe, i = (i + 1) & mask) {
+    const TenantSlot& tenant = TenantSlots()[i];
+    // The keys tell whether it's the tenant or another one with the same hash
+    bool valid = tenant.count && tenant.first < GetHeader().memberCount && tenant.count <= GetHeader().memberCount - tenant.first
+      && Members()[tenant.first] < SlotCount() && ValidKey(Slots()[Members()[tenant.first]]);
+    if (tenant.hash == hash && valid && Key(Slots()[Members()[tenant.first]]).starts_with(prefix)) {
+      return &tenant;
+    }
+  }
+  return nullptr;
+}
+
+uint64_t VariableSnapshot::Hash(std::string_view key)
+{
+  auto hashed = HashedPart(key);
+  uint64_t keyHash = HashBytes(key);
+  uint64_t hash = CombineKeyHashes(hashed.size() == key.size() ? keyHash : HashBytes(hashed), keyHash);
+  return hash ? hash : 1;
+}
+
+uint64_t VariableSnapshot::HashBytes(std::string_view bytes)
+{
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : bytes) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+  }
+  return hash ? hash : 1;
+}
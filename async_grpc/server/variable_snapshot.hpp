@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utils/expected.hpp>
+#include "variable.hpp"
+
+// Read only snapshot of the variable store, memory mapped and looked up in place: loading one costs a mmap whatever
+// its size, pages get faulted in as keys are read.
+// The file is a header, an open addressing table of fixed size slots (linear probing), a second one indexing the slots
+// of each tenant's keys and the keys the slots point to.
+// Integers are in native byte order, the header's format version must be bumped on any layout change.
+// Keys are hashed like in the store (see StoredKeyHash), a tenant's keys spread over the table and are found through the
+// tenant index.
+
+class VariableSnapshot {
+public:
+  static constexpr uint32_t FormatVersion = 3;
+
+  static utils::expected<std::unique_ptr<VariableSnapshot>, std::string> Load(const std::filesystem::path& path);
+
+  // Writes a temporary file next to path then renames it, a crash leaves either the previous snapshot or the new one.
+  // logSequence is the last log record the variables include
+  static utils::expected<void, std::string> Write(const std::filesystem::path& path, const std::unordered_map<std::string, Variable>& variables, uint64_t logSequence, uint64_t lastVersion);
+
+  VariableSnapshot(const VariableSnapshot&) = delete;
+  VariableSnapshot& operator=(const VariableSnapshot&) = delete;
+  ~VariableSnapshot();
+
+  std::optional<Variable> Find(std::string_view key) const;
+
+  // func(std::string_view key, const Variable& variable)
+  template<typename TFunc>
+  void ForEach(TFunc&& func) const {
+    ForEachInSlots(0, SlotCount(), func);
+  }
+
+  // Same as ForEach on the slots [first, first + count) of the table, to go through it a piece at a time
+  template<typename TFunc>
+  void ForEachInSlots(uint64_t first, uint64_t count, TFunc&& func) const {
+    for (uint64_t i = first; i < SlotCount() && i - first < count; ++i) {
+      const Slot& slot = Slots()[i];
+      if (slot.hash && ValidKey(slot)) {
+        func(Key(slot), ToVariable(slot));
+      }
+    }
+  }
+
+  // func(std::string_view key, const Variable& variable) on the variables of a non empty tenant, prefix being
+  // StoredKey(tenant, {})
+  template<typename TFunc>
+  void ForEachInTenant(std::string_view prefix, TFunc&& func) const {
+    const TenantSlot* tenant = FindTenant(prefix);
+    if (!tenant) {
+      return;
+    }
+    for (uint64_t i = tenant->first; i < tenant->first + tenant->count; ++i) {
+      uint64_t index = Members()[i];
+      if (index >= SlotCount()) {
+        continue;
+      }
+      const Slot& slot = Slots()[index];
+      if (slot.hash && ValidKey(slot) && Key(slot).starts_with(prefix)) {
+        func(Key(slot), ToVariable(slot));
+      }
+    }
+  }
+
+  uint64_t LogSequence() const { return GetHeader().logSequence; }
+  uint64_t LastVersion() const { return GetHeader().lastVersion; }
+  uint64_t Size() const { return GetHeader().count; }
+  uint64_t SlotCount() const { return GetHeader().slotCount; }
+  // Size of all the keys
+  uint64_t KeysSize() const { return GetHeader().keysSize; }
+
+private:
+  struct Header {
+    char magic[8];
+    uint32_t formatVersion;
+    uint32_t reserved;
+    uint64_t logSequence;
+    uint64_t lastVersion;
+    uint64_t count;
+    uint64_t slotCount;
+    uint64_t tenantSlotCount;
+    // Entries of the tenant index, the keys of a tenant are next to each other
+    uint64_t memberCount;
+    uint64_t keysSize;
+  };
+
+  // hash 0 marks an empty slot
+  struct Slot {
+    uint64_t hash;
+    uint64_t keyOffset;
+    uint32_t keySize;
+    uint32_t reserved;
+    int64_t value;
+    uint64_t version;
+    uint64_t expiresAt;
+  };
+
+  // The tenant's keys are in the slots listed by Members()[first, first + count), hash 0 marks an empty slot
+  struct TenantSlot {
+    uint64_t hash;
+    uint64_t first;
+    uint64_t count;
+  };
+
+  VariableSnapshot(const char* data, size_t size);
+
+  // Stable across builds and platforms, unlike std::hash. Combines the hashes of HashedPart(key) and key
+  static uint64_t Hash(std::string_view key);
+  static uint64_t HashBytes(std::string_view bytes);
+  // Null if the tenant has no variables
+  const TenantSlot* FindTenant(std::string_view prefix) const;
+
+  const Header& GetHeader() const { return *reinterpret_cast<const Header*>(m_data); }
+  const Slot* Slots() const { return reinterpret_cast<const Slot*>(m_data + sizeof(Header)); }
+  const TenantSlot* TenantSlots() const { return reinterpret_cast<const TenantSlot*>(Slots() + SlotCount()); }
+  const uint64_t* Members() const { return reinterpret_cast<const uint64_t*>(TenantSlots() + GetHeader().tenantSlotCount); }
+  bool ValidKey(const Slot& slot) const { return slot.keyOffset <= GetHeader().keysSize && slot.keySize <= GetHeader().keysSize - slot.keyOffset; }
+  static Variable ToVariable(const Slot& slot) { return Variable{ slot.value, slot.version, slot.expiresAt }; }
+  std::string_view Key(const Slot& slot) const { return std::string_view(reinterpret_cast<const char*>(Members() + GetHeader().memberCount) + slot.keyOffset, slot.keySize); }
+
+  const char* m_data;
+  size_t m_size;
+};
@@ -0,0 +1,720 @@
+#include "variable_store.hpp"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[VariableStore] ";
+}
+
+static bool Changed(const std::optional<Variable>& before, const std::optional<Variable>& after) {
+  return before.has_value() != after.has_value() || (before && before->version != after->version);
+}
+
+// The variable unless it expired
+static std::optional<Variable> Live(const std::optional<Variable>& variable, uint64_t nowMs) {
+  return variable && !variable->Expired(nowMs) ? variable : std::nullopt;
+}
+
+static std::optional<int64_t> CheckedAdd(int64_t value, int64_t delta) {
+  if (delta > 0 ? value > std::numeric_limits<int64_t>::max() - delta : value < std::numeric_limits<int64_t>::min() - delta) {
+    return std::nullopt;
+  }
+  return value + delta;
+}
+
+VariableStore::~VariableStore()
+{
+  // Before the log goes away
+  m_sweeperThread = {};
+  m_snapshotThread = {};
+}
+
+utils::expected<void, std::string> VariableStore::Open(Options options)
+{
+  m_options = std::move(options);
+  if (m_options.log.path.empty()) {
+    // Snapshots are only written for the log to be truncated
+    m_options.snapshot.clear();
+    m_sweeperThread = std::jthread([this](std::stop_token stop) { RunSweeper(stop); });
+    return {};
+  }
+
+  uint64_t snapshotSequence = 0;
+  std::error_code error;
+  if (!m_options.snapshot.empty() && std::filesystem::exists(m_options.snapshot, error)) {
+    auto snapshot = VariableSnapshot::Load(m_options.snapshot);
+    if (!snapshot) {
+      return utils::unexpected(std::move(snapshot.error()));
+    }
+    m_snapshot = std::move(*snapshot);
+    m_lastVersion = m_snapshot->LastVersion();
+    m_memoryUsed = static_cast<int64_t>(m_snapshot->KeysSize() + m_snapshot->Size() * VariableOverhead);
+    snapshotSequence = m_snapshot->LogSequence();
+    Log() << "Mapped a snapshot of " << m_snapshot->Size() << " variables from " << m_options.snapshot.string();
+  }
+
+  m_options.log.onDurable = [this](uint64_t lastSequence, std::string_view records) {
+    // Nothing is appended before the log is opened, the feed is there by the time batches get flushed
+    m_feed->Append(lastSequence, records);
+  };
+  auto log = WriteAheadLog::Open(m_options.log, snapshotSequence, [this](std::span<const LogEntry> entries) {
+    Apply(entries);
+  });
+  if (!log) {
+    return utils::unexpected(std::move(log.error()));
+  }
+  m_log = std::move(*log);
+  m_feed = std::make_unique<ReplicationFeed>(m_log->Mark().sequence, m_options.replicationBufferSize);
+
+  if (!m_options.snapshot.empty()) {
+    m_snapshotThread = std::jthread([this](std::stop_token stop) { RunSnapshots(stop); });
+  }
+  // Once the snapshot is loaded and the log replayed, what it expires or evicts then gets logged
+  m_sweeperThread = std::jthread([this](std::stop_token stop) { RunSweeper(stop); });
+  return {};
+}
+
+utils::expected<void, std::string> VariableStore::WriteSnapshot()
+{
+  auto lock = std::unique_lock(m_snapshotMutex);
+  if (!m_log || m_options.snapshot.empty()) {
+    return utils::unexpected(std::string("The store isn't persisted"));
+  }
+
+  // Everything logged up to start is in the copy below, but for the variables that expired. The copy isn't a point in time view, shards are copied one
+  // after the other while changes keep coming, but changes made during the copy are logged after start and replaying
+  // the log from there on top of the snapshot brings back a consistent state
+  auto start = m_log->Mark();
+  auto variables = Copy();
+  // The copy may hold changes that aren't on disk yet, like part of a transaction. Those must not outlive a crash
+  // without the log records that complete them
+  if (!m_log->WaitDurable(m_log->Mark().sequence)) {
+    return utils::unexpected(std::string("The log can't be written to"));
+  }
+  if (auto written = VariableSnapshot::Write(m_options.snapshot, variables, start.sequence, m_lastVersion); !written) {
+    return written;
+  }
+  Log() << "Wrote a snapshot of " << variables.size() << " variables";
+  m_log->DropBefore(start);
+  return {};
+}
+
+std::unordered_map<std::string, Variable> VariableStore::Copy() const
+{
+  uint64_t now = NowMs();
+  std::unordered_map<std::string, Variable> variables;
+  if (m_snapshot) {
+    variables.reserve(m_snapshot->Size());
+    m_snapshot->ForEach([&](std::string_view key, const Variable& variable) {
+      if (!variable.Expired(now)) {
+        variables.emplace(key, variable);
+      }
+    });
+  }
+  m_storage.ForEach([&](std::string_view key, const StoredVariable& stored) {
+    if (auto variable = Live(stored.variable, now)) {
+      variables.insert_or_assign(std::string(key), *variable);
+    } else {
+      variables.erase(std::string(key));
+    }
+  });
+  return variables;
+}
+
+void VariableStore::Apply(std::span<const LogEntry> entries)
+{
+  for (const auto& entry : entries) {
+    std::optional<Variable> variable;
+    if (entry.value) {
+      variable = Variable{ *entry.value, entry.version, entry.expiresAt };
+    }
+    m_storage.Modify(entry.key, [&](std::optional<StoredVariable>& stored) {
+      Overlay(entry.key, stored, variable);
+      m_watchers.Publish(entry.key, variable);
+    });
+    if (entry.version > m_lastVersion) {
+      m_lastVersion = entry.version;
+    }
+  }
+}
+
+void VariableStore::Clear()
+{
+  // Replicas are in memory only, there's no snapshot under the overlay
+  m_storage.ModifySlots({}, std::numeric_limits<size_t>::max(), [](std::string_view, std::optional<StoredVariable>& stored) {
+    stored.reset();
+  });
+  m_memoryUsed = 0;
+}
+
+void VariableStore::RunSnapshots(std::stop_token stop)
+{
+  uint64_t retryAt = 0;
+  std::mutex mutex;
+  std::condition_variable_any wakeup;
+  while (true) {
+    {
+      auto lock = std::unique_lock(mutex);
+      if (wakeup.wait_for(lock, stop, std::chrono::seconds(1), []() { return false; }), stop.stop_requested()) {
+        return;
+      }
+    }
+    uint64_t logSize = m_log->Size();
+    if (logSize == 0 || logSize < std::max(m_options.snapshotLogSize, retryAt)) {
+      continue;
+    }
+    if (auto written = WriteSnapshot(); !written) {
+      Log() << "Failed to write a snapshot: " << written.error();
+      // Not before the log grew some more
+      retryAt = logSize + m_options.snapshotLogSize;
+    } else {
+      retryAt = 0;
+    }
+  }
+}
+
+void VariableStore::RunSweeper(std::stop_token stop)
+{
+  std::mutex mutex;
+  std::condition_variable_any wakeup;
+  while (true) {
+    {
+      auto lock = std::unique_lock(mutex);
+      if (wakeup.wait_for(lock, stop, SweepInterval, []() { return false; }), stop.stop_requested()) {
+        return;
+      }
+    }
+    // Like Redis' active expiry: a batch finding many expired variables likely means more are, go on while it's the
+    // case without taking over the machine
+    auto start = std::chrono::steady_clock::now();
+    while (!stop.stop_requested()) {
+      auto [seen, expired] = SweepBatch(NowMs());
+      if (expired * 4 < seen || seen == 0 || std::chrono::steady_clock::now() - start > SweepTimeLimit) {
+        break;
+      }
+    }
+    // Changes evict for themselves, this is for the budget being exceeded otherwise, like by replaying the log
+    EvictOverBudget(std::numeric_limits<size_t>::max());
+  }
+}
+
+std::pair<size_t, size_t> VariableStore::SweepBatch(uint64_t nowMs)
+{
+  size_t seen = 0;
+  size_t expired = 0;
+  m_sweepCursor = m_storage.ModifySlots(m_sweepCursor, SweepBatchSlots, [&](std::string_view key, std::optional<StoredVariable>& stored) {
+    if (!stored->variable) {
+      return;
+    }
+    ++seen;
+    if (stored->variable->Expired(nowMs)) {
+      // Nothing to log, replaying the change expires it just the same
+      Overlay(key, stored, std::nullopt);
+      m_watchers.Publish(key, std::nullopt);
+      ++expired;
+    }
+  });
+  if (m_sweepCursor == m_storage.End()) {
+    m_sweepCursor = {};
+  }
+
+  if (m_snapshot) {
+    // Expired snapshot variables get a deletion in the overlay, they're gone from the next snapshot
+    m_snapshot->ForEachInSlots(m_sweepSnapshotSlot, SweepBatchSlots, [&](std::string_view key, const Variable& variable) {
+      ++seen;
+      if (!variable.Expired(nowMs)) {
+        return;
+      }
+      m_storage.Modify(key, [&](std::optional<StoredVariable>& stored) {
+        if (!stored) {
+          Overlay(key, stored, std::nullopt);
+          m_watchers.Publish(key, std::nullopt);
+          ++expired;
+        }
+      });
+    });
+    m_sweepSnapshotSlot += SweepBatchSlots;
+    if (m_sweepSnapshotSlot >= m_snapshot->SlotCount()) {
+      m_sweepSnapshotSlot = 0;
+    }
+  }
+  m_expiredCount.fetch_add(expired, std::memory_order_relaxed);
+  return { seen, expired };
+}
+
+void VariableStore::EvictOverBudget(size_t maxEvictions)
+{
+  uint64_t budget = m_options.memoryBudget;
+  for (size_t i = 0; budget && i < maxEvictions && MemoryUsed() > budget; ++i) {
+    if (!EvictOne()) {
+      return;
+    }
+  }
+}
+
+bool VariableStore::EvictOne()
+{
+  // Sampled like Redis does rather than tracking the exact order of accesses, which would take a lock shared by all
+  // the keys on every read. Expired variables go first, they're gone anyway
+  thread_local std::minstd_rand random(std::random_device{}());
+  uint64_t now = NowMs();
+  auto score = [&](const std::optional<Variable>& variable, const AccessStats& access) -> uint64_t {
+    if (variable && variable->Expired(now)) {
+      return 0;
+    }
+    uint64_t lastAccess = std::min<uint64_t>(access.LastAccess(), (uint64_t(1) << 56) - 1) + 1;
+    if (m_options.eviction == EvictionPolicy::Lfu) {
+      return (uint64_t(access.Frequency(now)) << 56) | lastAccess;
+    }
+    return lastAccess;
+  };
+  std::optional<std::string> victim;
+  uint64_t victimScore = std::numeric_limits<uint64_t>::max();
+  auto consider = [&](std::string_view key, uint64_t keyScore) {
+    if (!victim || keyScore < victimScore) {
+      victim = std::string(key);
+      victimScore = keyScore;
+    }
+  };
+  auto randomBits = [&]() { return (uint64_t(random()) << 32) ^ random(); };
+  m_storage.Sample(randomBits(), EvictionSamples, [&](std::string_view key, const StoredVariable& stored) {
+    if (stored.variable) {
+      consider(key, score(stored.variable, stored.access));
+    }
+  });
+  if (m_snapshot && m_snapshot->SlotCount()) {
+    // Variables only in the snapshot were never used since the store was opened, with a budget reads bring them in
+    // the overlay
+    m_snapshot->ForEachInSlots(randomBits() % m_snapshot->SlotCount(), EvictionSamples, [&](std::string_view key, const Variable& variable) {
+      if (!m_storage.Visit(key, [](const StoredVariable&) {})) {
+        consider(key, score(variable, AccessStats()));
+      }
+    });
+  }
+  if (!victim) {
+    return false;
+  }
+
+  m_storage.Modify(*victim, [&](std::optional<StoredVariable>& stored) {
+    if (!(stored ? stored->variable : FindInSnapshot(*victim))) {
+      // Deleted since it was sampled
+      return;
+    }
+    Overlay(*victim, stored, std::nullopt);
+    RecordChange(*victim, std::nullopt);
+    m_evictedCount.fetch_add(1, std::memory_order_relaxed);
+  });
+  return true;
+}
+
+std::optional<Variable> VariableStore::FindInSnapshot(std::string_view key) const
+{
+  return m_snapshot ? m_snapshot->Find(key) : std::nullopt;
+}
+
+template<typename TFunc>
+auto VariableStore::ModifyVariable(std::string_view key, TFunc&& func)
+{
+  uint64_t now = NowMs();
+  auto result = m_storage.Modify(key, [&](std::optional<StoredVariable>& stored) {
+    auto before = Live(stored ? stored->variable : FindInSnapshot(key), now);
+    auto variable = before;
+    auto result = std::forward<TFunc>(func)(variable);
+    if (Changed(before, variable)) {
+      Overlay(key, stored, variable);
+    }
+    if (stored) {
+      Touch(*stored, now);
+    }
+    return result;
+  });
+  EvictOverBudget(MaxEvictionsPerChange);
+  return result;
+}
+
+void VariableStore::Overlay(std::string_view key, std::optional<StoredVariable>& stored, const std::optional<Variable>& variable)
+{
+  // Expired or not, a variable takes memory until it's removed
+  bool existed = stored ? stored->variable.has_value() : FindInSnapshot(key).has_value();
+  if (existed != variable.has_value()) {
+    auto size = static_cast<int64_t>(key.size() + VariableOverhead);
+    m_memoryUsed.fetch_add(variable ? size : -size, std::memory_order_relaxed);
+  }
+  if (variable) {
+    if (!stored) {
+      stored.emplace();
+    }
+    stored->variable = variable;
+  } else if (stored ? FindInSnapshot(key).has_value() : existed) {
+    stored = StoredVariable{};
+  } else {
+    // Nothing to hide in the snapshot
+    stored.reset();
+  }
+}
+
+void VariableStore::Touch(const StoredVariable& stored, uint64_t nowMs) const
+{
+  // Only needed to pick what to evict
+  if (m_options.memoryBudget) {
+    stored.access.Touch(nowMs);
+  }
+}
+
+uint64_t VariableStore::NextVersion()
+{
+  return m_lastVersion.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void VariableStore::RecordChange(std::string_view key, const std::optional<Variable>& variable)
+{
+  m_watchers.Publish(key, variable);
+  if (!m_log) {
+    return;
+  }
+  LogEntry entry{ key, std::nullopt, 0 };
+  if (variable) {
+    entry.value = variable->value;
+    entry.version = variable->version;
+    entry.expiresAt = variable->expiresAt;
+  }
+  m_log->Append(std::span(&entry, 1));
+}
+
+std::unique_ptr<VariableWatcher> VariableStore::Watch(const std::vector<std::string>& keys, const std::vector<std::string>& prefixes, size_t maxPending)
+{
+  auto watcher = m_watchers.Add(keys, prefixes, maxPending);
+  // Read once registered so that no change falls in between, a change pushed meanwhile is newer than what's read
+  for (const auto& key : keys) {
+    watcher->PushIfAbsent(VariableWatchers::Serialize(key, Read(key)));
+  }
+  return watcher;
+}
+
+std::vector<std::pair<std::string, Variable>> VariableStore::GetAll(std::string_view tenant) const
+{
+  auto prefix = StoredKey(tenant, {});
+  uint64_t now = NowMs();
+  // What changed since the snapshot, deleted ones included
+  std::unordered_map<std::string, std::optional<Variable>> changed;
+  m_storage.ForEachInGroup(prefix, [&](std::string_view key, const StoredVariable& stored) {
+    if (key.starts_with(prefix)) {
+      changed.emplace(key, stored.variable);
+      Touch(stored, now);
+    }
+  });
+  std::vector<std::pair<std::string, Variable>> variables;
+  for (const auto& [key, variable] : changed) {
+    if (variable && !variable->Expired(now)) {
+      variables.emplace_back(key.substr(prefix.size()), *variable);
+    }
+  }
+  if (m_snapshot) {
+    // Doesn't change, no need for the lock
+    m_snapshot->ForEachInTenant(prefix, [&](std::string_view key, const Variable& variable) {
+      if (key.starts_with(prefix) && !variable.Expired(now) && !changed.contains(std::string(key))) {
+        variables.emplace_back(key.substr(prefix.size()), variable);
+      }
+    });
+  }
+  return variables;
+}
+
+size_t VariableStore::DeleteAll(std::string_view tenant)
+{
+  auto prefix = StoredKey(tenant, {});
+  uint64_t now = NowMs();
+  return m_storage.ModifyGroup(prefix, [&](auto& entries) {
+    // Expired variables are deleted along, only the others are counted
+    std::vector<std::string> keys;
+    size_t live = 0;
+    auto add = [&](std::string_view key, const Variable& variable) {
+      keys.emplace_back(key);
+      live += !variable.Expired(now);
+    };
+    entries.ForEach([&](std::string_view key, const StoredVariable& stored) {
+      if (stored.variable && key.starts_with(prefix)) {
+        add(key, *stored.variable);
+      }
+    });
+    if (m_snapshot) {
+      m_snapshot->ForEachInTenant(prefix, [&](std::string_view key, const Variable& variable) {
+        if (key.starts_with(prefix) && !entries.Find(key)) {
+          add(key, variable);
+        }
+      });
+    }
+    if (keys.empty()) {
+      return live;
+    }
+
+    if (m_log) {
+      // A single record like a transaction, a crash doesn't leave half a tenant
+      std::vector<LogEntry> logEntries;
+      logEntries.reserve(keys.size());
+      for (const auto& key : keys) {
+        logEntries.push_back(LogEntry{ key, std::nullopt, 0 });
+      }
+      m_log->Append(logEntries);
+    }
+    for (const auto& key : keys) {
+      entries.Modify(key, [&](std::optional<StoredVariable>& stored) {
+        Overlay(key, stored, std::nullopt);
+      });
+      m_watchers.Publish(key, std::nullopt);
+    }
+    return live;
+  });
+}
+
+template<typename TFunc>
+bool VariableStore::ForEachInUnit(uint64_t unit, TFunc&& func) const
+{
+  uint64_t snapshotUnits = m_snapshot ? (m_snapshot->SlotCount() + ScanSnapshotSlots - 1) / ScanSnapshotSlots : 0;
+  if (unit < snapshotUnits) {
+    // Doesn't change, the changed variables are seen with the overlay's shards. A variable found unchanged here that
+    // changes before its shard is read is seen twice, never missed
+    m_snapshot->ForEachInSlots(unit * ScanSnapshotSlots, ScanSnapshotSlots, [&](std::string_view key, const Variable& variable) {
+      if (!m_storage.Visit(key, [](const StoredVariable&) {})) {
+        func(key, variable);
+      }
+    });
+  } else if (unit - snapshotUnits < m_storage.ShardCount()) {
+    m_storage.ForEachInShard(unit - snapshotUnits, [&](std::string_view key, const StoredVariable& stored) {
+      if (stored.variable) {
+        func(key, *stored.variable);
+      }
+    });
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool VariableStore::ScanUnit(std::string_view tenant, const ScanPosition& position, std::vector<std::pair<std::string, Variable>>& variables) const
+{
+  variables.clear();
+  if (!tenant.empty()) {
+    if (position.unit > 0) {
+      return false;
+    }
+    variables = GetAll(tenant);
+    std::erase_if(variables, [&](const auto& variable) { return variable.first <= position.after; });
+  } else {
+    uint64_t now = NowMs();
+    bool found = ForEachInUnit(position.unit, [&](std::string_view key, const Variable& variable) {
+      // Keys starting with a '\0' are the other tenants'
+      if (!key.starts_with('\0') && !variable.Expired(now) && key > position.after) {
+        variables.emplace_back(key, variable);
+      }
+    });
+    if (!found) {
+      return false;
+    }
+  }
+  std::sort(variables.begin(), variables.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+  return true;
+}
+
+bool VariableStore::CopyUnit(uint64_t unit, std::vector<std::pair<std::string, Variable>>& variables) const
+{
+  variables.clear();
+  uint64_t now = NowMs();
+  return ForEachInUnit(unit, [&](std::string_view key, const Variable& variable) {
+    if (!variable.Expired(now)) {
+      variables.emplace_back(key, variable);
+    }
+  });
+}
+
+std::optional<Variable> VariableStore::Read(std::string_view key)
+{
+  uint64_t now = NowMs();
+  std::optional<Variable> variable;
+  bool changed = m_storage.Visit(key, [&](const StoredVariable& stored) {
+    variable = stored.variable;
+    Touch(stored, now);
+  });
+  if (!changed) {
+    variable = FindInSnapshot(key);
+    if (variable && m_options.memoryBudget && !variable->Expired(now)) {
+      // Brought in the overlay for its accesses to be counted
+      m_storage.Modify(key, [&](std::optional<StoredVariable>& stored) {
+        if (!stored) {
+          stored.emplace().variable = variable;
+        }
+        Touch(*stored, now);
+      });
+    }
+  }
+  return Live(variable, now);
+}
+
+bool VariableStore::Write(std::string_view key, int64_t value, uint64_t expiresAt)
+{
+  return ModifyVariable(key, [&](std::optional<Variable>& variable) {
+    bool inserted = !variable;
+    variable = Variable{ value, NextVersion(), expiresAt };
+    RecordChange(key, variable);
+    return inserted;
+  });
+}
+
+bool VariableStore::Del(std::string_view key)
+{
+  return ModifyVariable(key, [&](std::optional<Variable>& variable) {
+    if (!variable) {
+      return false;
+    }
+    variable.reset();
+    RecordChange(key, variable);
+    return true;
+  });
+}
+
+utils::expected<Variable, grpc::Status> VariableStore::Increment(std::string_view key, int64_t delta, int64_t initialValue)
+{
+  return ModifyVariable(key, [&](std::optional<Variable>& variable) -> utils::expected<Variable, grpc::Status> {
+    auto sum = CheckedAdd(variable ? variable->value : initialValue, delta);
+    if (!sum) {
+      return utils::unexpected(grpc::Status(grpc::StatusCode::OUT_OF_RANGE, "Increment would overflow"));
+    }
+    variable = Variable{ *sum, NextVersion(), variable ? variable->expiresAt : 0 };
+    RecordChange(key, variable);
+    return *variable;
+  });
+}
+
+CompareAndSwapResult VariableStore::CompareAndSwap(std::string_view key, std::optional<int64_t> expected, int64_t value)
+{
+  return ModifyVariable(key, [&](std::optional<Variable>& variable) {
+    CompareAndSwapResult result;
+    result.swapped = variable ? expected == variable->value : !expected;
+    if (result.swapped) {
+      variable = Variable{ value, NextVersion(), variable ? variable->expiresAt : 0 };
+      RecordChange(key, variable);
+    }
+    result.current = variable;
+    return result;
+  });
+}
+
+utils::expected<variable_service::TransactResponse, grpc::Status> VariableStore::Transact(const variable_service::TransactRequest& request)
+{
+  using Operation = variable_service::Operation;
+  const auto& operations = request.operations();
+  if (operations.size() > MaxTransactOperations) {
+    return utils::unexpected(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Too many operations, the limit is " + std::to_string(MaxTransactOperations)));
+  }
+  // Each key is loaded once however many operations use it
+  std::vector<std::string> storedKeys;
+  std::vector<size_t> keyIndexes;
+  keyIndexes.reserve(operations.size());
+  for (const auto& operation : operations) {
+    if (operation.type_case() == Operation::TYPE_NOT_SET) {
+      return utils::unexpected(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Operation without a type"));
+    }
+    if (!ValidKey(operation.tenant(), operation.key())) {
+      return utils::unexpected(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid tenant or key"));
+    }
+    auto key = StoredKey(operation.tenant(), operation.key());
+    auto found = std::find(storedKeys.begin(), storedKeys.end(), key);
+    keyIndexes.push_back(static_cast<size_t>(found - storedKeys.begin()));
+    if (found == storedKeys.end()) {
+      storedKeys.push_back(std::move(key));
+    }
+  }
+  std::vector<std::string_view> keys(storedKeys.begin(), storedKeys.end());
+
+  uint64_t now = NowMs();
+  auto result = m_storage.ModifyMany(keys, [&](std::span<std::optional<StoredVariable>> stored) -> utils::expected<variable_service::TransactResponse, grpc::Status> {
+    variable_service::TransactResponse response;
+    std::vector<std::optional<Variable>> variables;
+    variables.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      variables.push_back(Live(stored[i] ? stored[i]->variable : FindInSnapshot(keys[i]), now));
+    }
+    // Operations apply to a copy, a failing one leaves the storage untouched
+    std::vector<std::optional<Variable>> working(variables.begin(), variables.end());
+    // Every change of the batch gets the same version
+    uint64_t version = 0;
+    auto changeVersion = [&]() {
+      if (!version) {
+        version = NextVersion();
+      }
+      return version;
+    };
+
+    for (int i = 0; i < operations.size(); ++i) {
+      const Operation& operation = operations[i];
+      std::optional<Variable>& variable = working[keyIndexes[static_cast<size_t>(i)]];
+      if (operation.has_expected_version() && operation.expected_version() != (variable ? variable->version : 0)) {
+        response.Clear();
+        response.set_failed_operation(static_cast<uint32_t>(i));
+        return response;
+      }
+      switch (operation.type_case()) {
+      case Operation::kWrite: {
+        uint64_t ttl = operation.write().ttl_ms();
+        variable = Variable{ operation.write().value(), changeVersion(), ttl ? now + ttl : 0 };
+        break;
+      }
+      case Operation::kDel:
+        variable.reset();
+        break;
+      case Operation::kIncrement: {
+        auto sum = CheckedAdd(variable ? variable->value : operation.increment().initial_value(), operation.increment().delta());
+        if (!sum) {
+          return utils::unexpected(grpc::Status(grpc::StatusCode::OUT_OF_RANGE, "Increment of operation " + std::to_string(i) + " would overflow"));
+        }
+        variable = Variable{ *sum, changeVersion(), variable ? variable->expiresAt : 0 };
+        break;
+      }
+      default:
+        break;
+      }
+      auto* result = response.add_results();
+      if (variable) {
+        result->set_exists(true);
+        result->set_value(variable->value);
+        result->set_version(variable->version);
+      }
+    }
+
+    if (m_log) {
+      // A single record, the batch is replayed whole or not at all
+      std::vector<LogEntry> entries;
+      for (size_t i = 0; i < keys.size(); ++i) {
+        if (Changed(variables[i], working[i])) {
+          entries.push_back(LogEntry{ keys[i], std::nullopt, 0 });
+          if (working[i]) {
+            entries.back().value = working[i]->value;
+            entries.back().version = working[i]->version;
+            entries.back().expiresAt = working[i]->expiresAt;
+          }
+        }
+      }
+      if (!entries.empty()) {
+        m_log->Append(entries);
+      }
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (Changed(variables[i], working[i])) {
+        Overlay(keys[i], stored[i], working[i]);
+        m_watchers.Publish(keys[i], working[i]);
+      }
+      if (stored[i]) {
+        Touch(*stored[i], now);
+      }
+    }
+    response.set_committed(true);
+    return response;
+  });
+  EvictOverBudget(MaxEvictionsPerChange);
+  return result;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <grpcpp/support/status.h>
+#include <protos/variable_service.pb.h>
+#include <utils/expected.hpp>
+#include <utils/sharded_hash_map.hpp>
+#include "access_stats.hpp"
+#include "replication_feed.hpp"
+#include "variable.hpp"
+#include "variable_snapshot.hpp"
+#include "variable_watchers.hpp"
+#include "write_ahead_log.hpp"
+
+struct CompareAndSwapResult {
+  bool swapped = false;
+  std::optional<Variable> current;
+};
+
+// Storage behind VariableServiceImpl, keys are stored keys (see StoredKey). Once persisted, the variables live in a memory mapped snapshot overlaid with the
+// ones changed since, the snapshot being rewritten in the background as the log grows.
+// Variables may expire: expired ones read as missing right away and a background sweeper reclaims them a few slots at a
+// time. With a memory budget, the least recently or frequently used variables are evicted by the changes that exceed it
+class VariableStore {
+public:
+  static constexpr int MaxTransactOperations = 128;
+  // Rough cost of a variable besides its key: its slot, key and value in the table
+  static constexpr size_t VariableOverhead = 96;
+  // Snapshot slots read by a scan at a time
+  static constexpr uint64_t ScanSnapshotSlots = 4096;
+
+  enum class EvictionPolicy {
+    Lru,
+    Lfu,
+  };
+
+  // Scans read the store a unit at a time: chunks of snapshot slots, then the shards of the overlay. The variables of a
+  // non empty tenant are a single unit, they're all in the same shard
+  struct ScanPosition {
+    uint64_t unit = 0;
+    // Only the keys after it within the unit
+    std::string after;
+  };
+
+  struct Options {
+    WriteAheadLog::Options log;
+    // Empty to only rely on the log
+    std::filesystem::path snapshot;
+    // Log size past which a snapshot is written, the log then only keeps the records that came after it
+    uint64_t snapshotLogSize = 64 << 20;
+    // Estimated bytes of variables (keys plus VariableOverhead each) past which variables are evicted, 0 for no limit.
+    // Evictions are logged like deletions and notified to watchers
+    uint64_t memoryBudget = 0;
+    EvictionPolicy eviction = EvictionPolicy::Lru;
+    // Log records kept in memory for replicas to catch up from, see ReplicationFeed
+    size_t replicationBufferSize = 64 << 20;
+  };
+
+  VariableStore() = default;
+  VariableStore(const VariableStore&) = delete;
+  VariableStore& operator=(const VariableStore&) = delete;
+  ~VariableStore();
+
+  // Maps the snapshot and replays the log after it, every change is then appended to the log. An empty log path keeps
+  // the variables in memory only. Must be called before using the store, expired variables are only reclaimed once
+  // opened. Changes are visible to readers before they are on disk, use GetLog()->Sync() before acknowledging them
+  utils::expected<void, std::string> Open(Options options);
+  // Done in the background once the log is big enough, the store keeps serving while it's written
+  utils::expected<void, std::string> WriteSnapshot();
+  // Null when the store is in memory only
+  WriteAheadLog* GetLog() { return m_log.get(); }
+  // What replicas follow, null when the store is in memory only
+  ReplicationFeed* GetReplicationFeed() { return m_feed.get(); }
+  // The watcher starts with the current values of keys, then gets the changes of keys and of the keys starting with
+  // one of prefixes until it's destroyed
+  std::unique_ptr<VariableWatcher> Watch(const std::vector<std::string>& keys, const std::vector<std::string>& prefixes, size_t maxPending = VariableWatchers::DefaultMaxPending);
+
+  std::optional<Variable> Read(std::string_view key);
+  // Returns true if the key was inserted. Sets the expiry of the variable (see Variable::expiresAt), the other changes
+  // keep it
+  bool Write(std::string_view key, int64_t value, uint64_t expiresAt = 0);
+  // Returns true if the key existed
+  bool Del(std::string_view key);
+  // A missing key starts from initialValue, fails with OUT_OF_RANGE on overflow
+  utils::expected<Variable, grpc::Status> Increment(std::string_view key, int64_t delta, int64_t initialValue);
+  // An empty expected value only matches a missing key
+  CompareAndSwapResult CompareAndSwap(std::string_view key, std::optional<int64_t> expected, int64_t value);
+  // Runs the operations in order, holding the locks of the shards involved for the duration of the batch.
+  // Either all of them apply or none
+  utils::expected<variable_service::TransactResponse, grpc::Status> Transact(const variable_service::TransactRequest& request);
+  // The variables of a non empty tenant, keys without the tenant. A consistent view, taken under a single shard lock
+  std::vector<std::pair<std::string, Variable>> GetAll(std::string_view tenant) const;
+  // Deletes the variables of a non empty tenant atomically, returns how many there were
+  size_t DeleteAll(std::string_view tenant);
+  // Applies changes made elsewhere, like the primary's log records on a replica. They aren't logged, watchers are notified
+  void Apply(std::span<const LogEntry> entries);
+  // Drops every variable without logging nor notifying anything, for a replica about to get a full copy
+  void Clear();
+  // All the variables but the expired ones. Not a point in time view, see WriteSnapshot
+  std::unordered_map<std::string, Variable> Copy() const;
+  // Same as Copy a scan unit at a time, keys of every tenant. Sets variables to the ones of the unit, read under a
+  // single lock. Returns false past the last unit
+  bool CopyUnit(uint64_t unit, std::vector<std::pair<std::string, Variable>>& variables) const;
+  // Sets variables to the ones of tenant in the unit at position after position.after, keys without the tenant and
+  // sorted. The variables of a unit are read under a single lock. Returns false past the last unit
+  bool ScanUnit(std::string_view tenant, const ScanPosition& position, std::vector<std::pair<std::string, Variable>>& variables) const;
+  // Units depend on the snapshot, a scan can only resume on the same one
+  uint64_t SnapshotSequence() const { return m_snapshot ? m_snapshot->LogSequence() : 0; }
+
+  // Estimated bytes of the variables, expired ones included until they're reclaimed
+  uint64_t MemoryUsed() const { return static_cast<uint64_t>(std::max<int64_t>(m_memoryUsed.load(std::memory_order_relaxed), 0)); }
+  uint64_t ExpiredCount() const { return m_expiredCount.load(std::memory_order_relaxed); }
+  uint64_t EvictedCount() const { return m_evictedCount.load(std::memory_order_relaxed); }
+
+private:
+  // Time between two sweeps of expired variables
+  static constexpr auto SweepInterval = std::chrono::milliseconds(100);
+  // Slots visited in a row, a sweep goes on with another batch while at least a quarter of the variables it finds
+  // expired, for at most SweepTimeLimit
+  static constexpr size_t SweepBatchSlots = 1024;
+  static constexpr auto SweepTimeLimit = std::chrono::milliseconds(10);
+  // Variables compared to pick one to evict, more is closer to the exact least used one and slower
+  static constexpr size_t EvictionSamples = 16;
+  // Bound on the evictions done by a single change, the sweeper catches up with the rest
+  static constexpr size_t MaxEvictionsPerChange = 16;
+
+  // What the overlay holds for a key
+  struct StoredVariable {
+    // Empty when deleted, hiding the snapshot's variable
+    std::optional<Variable> variable;
+    AccessStats access;
+  };
+
+  uint64_t NextVersion();
+  std::optional<Variable> FindInSnapshot(std::string_view key) const;
+  // Calls func(std::string_view key, const Variable& variable) on the variables of a scan unit, expired ones included.
+  // Returns false past the last unit
+  template<typename TFunc>
+  bool ForEachInUnit(uint64_t unit, TFunc&& func) const;
+  // Runs func(std::optional<Variable>& variable) under the key's shard lock, the variable coming from the snapshot if
+  // the key didn't change since. An expired variable is passed as missing
+  template<typename TFunc>
+  auto ModifyVariable(std::string_view key, TFunc&& func);
+  // Stores a changed variable in the overlay, a deleted one only needs to be kept if it hides a snapshot one.
+  // Keeps the memory estimate up to date
+  void Overlay(std::string_view key, std::optional<StoredVariable>& stored, const std::optional<Variable>& variable);
+  void Touch(const StoredVariable& stored, uint64_t nowMs) const;
+  void RunSnapshots(std::stop_token stop);
+  void RunSweeper(std::stop_token stop);
+  // Removes the expired variables of the next slots, returns the number of variables seen and of expired ones
+  std::pair<size_t, size_t> SweepBatch(uint64_t nowMs);
+  // Evicts variables until under budget, at most maxEvictions of them
+  void EvictOverBudget(size_t maxEvictions);
+  // Returns false if there was nothing to evict
+  bool EvictOne();
+  // Logs the change and notifies its watchers. Must be called under the key's shard lock so that changes of a key are
+  // logged and notified in the order they're made
+  void RecordChange(std::string_view key, const std::optional<Variable>& variable);
+
+  std::atomic<uint64_t> m_lastVersion{ 0 };
+  // Variables changed since the snapshot, and the ones read since with a memory budget so that their accesses count
+  utils::ShardedHashMap<StoredVariable, StoredKeyHash> m_storage;
+  // Not swapped once opened, the snapshots written meanwhile are for the next start
+  std::unique_ptr<const VariableSnapshot> m_snapshot;
+  // Before the log, whose flushing thread appends to it until the log is destroyed
+  std::unique_ptr<ReplicationFeed> m_feed;
+  std::unique_ptr<WriteAheadLog> m_log;
+  VariableWatchers m_watchers;
+  Options m_options;
+  std::mutex m_snapshotMutex;
+  std::jthread m_snapshotThread;
+
+  std::atomic<int64_t> m_memoryUsed = 0;
+  std::atomic<uint64_t> m_expiredCount = 0;
+  std::atomic<uint64_t> m_evictedCount = 0;
+  // Only used by the sweeper thread
+  utils::ShardedHashMap<StoredVariable, StoredKeyHash>::Cursor m_sweepCursor;
+  uint64_t m_sweepSnapshotSlot = 0;
+  std::jthread m_sweeperThread;
+};
@@ -0,0 +1,203 @@
+#include "variable_watchers.hpp"
+#include <algorithm>
+#include <utility>
+#include <protos/variable_service.pb.h>
+
+static gpr_timespec ToTimespec(std::chrono::system_clock::time_point time) {
+  auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+  return gpr_time_from_nanos(sinceEpoch, GPR_CLOCK_REALTIME);
+}
+
+VariableWatcher::VariableWatcher(VariableWatchers& watchers, size_t maxPending)
+  : m_watchers(watchers)
+  , m_maxPending(maxPending)
+  , m_coalesceAt(maxPending + 1)
+{}
+
+VariableWatcher::~VariableWatcher()
+{
+  m_watchers.Remove(this);
+}
+
+void VariableWatcher::Wait(grpc::CompletionQueue* cq, void* tag, std::chrono::system_clock::time_point deadline)
+{
+  auto lock = std::unique_lock(m_mutex);
+  if (!m_pending.empty() || m_overflowed) {
+    m_alarm.Set(cq, gpr_time_0(GPR_CLOCK_MONOTONIC), tag);
+    return;
+  }
+  m_alarm.Set(cq, ToTimespec(deadline), tag);
+  m_waiting = true;
+}
+
+void VariableWatcher::Wake()
+{
+  if (m_waiting) {
+    // Completes the alarm right away, harmless if its deadline already fired
+    m_alarm.Cancel();
+    m_waiting = false;
+  }
+}
+
+std::vector<std::shared_ptr<const WatchedChange>> VariableWatcher::Take()
+{
+  auto lock = std::unique_lock(m_mutex);
+  m_waiting = false;
+  Coalesce();
+  m_coalesceAt = m_maxPending + 1;
+  return std::exchange(m_pending, {});
+}
+
+bool VariableWatcher::Overflowed()
+{
+  auto lock = std::unique_lock(m_mutex);
+  return m_overflowed;
+}
+
+void VariableWatcher::Push(std::shared_ptr<const WatchedChange> change)
+{
+  Buffer(std::move(change), true);
+}
+
+void VariableWatcher::PushIfAbsent(std::shared_ptr<const WatchedChange> change)
+{
+  Buffer(std::move(change), false);
+}
+
+void VariableWatcher::Buffer(std::shared_ptr<const WatchedChange> change, bool replace)
+{
+  auto lock = std::unique_lock(m_mutex);
+  if (m_overflowed) {
+    return;
+  }
+  if (!replace && std::ranges::any_of(m_pending, [&](const auto& pending) { return pending->key == change->key; })) {
+    return;
+  }
+  m_pending.push_back(std::move(change));
+  // Appending is what most pushes do, duplicates are only dropped once the buffer doubled since the last time. The
+  // buffer stays under twice the amount of keys it holds
+  if (m_pending.size() >= m_coalesceAt) {
+    Coalesce();
+    if (m_pending.size() > m_maxPending) {
+      m_overflowed = true;
+      m_pending.clear();
+    }
+    m_coalesceAt = std::max(m_maxPending + 1, m_pending.size() * 2);
+  }
+  Wake();
+}
+
+void VariableWatcher::Coalesce()
+{
+  if (m_pending.size() < 2) {
+    return;
+  }
+  // Keys point into the changes, replaced ones are swapped to the back and only released at the end
+  std::unordered_map<std::string_view, size_t> indexes;
+  indexes.reserve(m_pending.size());
+  size_t kept = 0;
+  for (size_t i = 0; i < m_pending.size(); ++i) {
+    auto [found, inserted] = indexes.try_emplace(m_pending[i]->key, kept);
+    if (inserted) {
+      std::swap(m_pending[kept++], m_pending[i]);
+    } else {
+      // The key keeps the place of its first change
+      std::swap(m_pending[found->second], m_pending[i]);
+    }
+  }
+  m_pending.resize(kept);
+}
+
+std::unique_ptr<VariableWatcher> VariableWatchers::Add(const std::vector<std::string>& keys, const std::vector<std::string>& prefixes, size_t maxPending)
+{
+  auto watcher = std::make_unique<VariableWatcher>(*this, maxPending);
+  auto lock = std::unique_lock(m_mutex);
+  Registration& registration = m_registrations[watcher.get()];
+  for (const auto& key : keys) {
+    m_keys[key].push_back(watcher.get());
+    registration.keys.push_back(key);
+  }
+  for (const auto& prefix : prefixes) {
+    m_prefixes[prefix].push_back(watcher.get());
+    ++m_prefixLengths[prefix.size()];
+    registration.prefixes.push_back(prefix);
+  }
+  ++m_count;
+  return watcher;
+}
+
+void VariableWatchers::Remove(VariableWatcher* watcher)
+{
+  auto lock = std::unique_lock(m_mutex);
+  auto found = m_registrations.find(watcher);
+  if (found == m_registrations.end()) {
+    return;
+  }
+  auto removeFrom = [&](WatcherMap& map, const std::string& key) {
+    auto entry = map.find(key);
+    std::erase(entry->second, watcher);
+    if (entry->second.empty()) {
+      map.erase(entry);
+    }
+  };
+  for (const auto& key : found->second.keys) {
+    removeFrom(m_keys, key);
+  }
+  for (const auto& prefix : found->second.prefixes) {
+    removeFrom(m_prefixes, prefix);
+    if (--m_prefixLengths[prefix.size()] == 0) {
+      m_prefixLengths.erase(prefix.size());
+    }
+  }
+  m_registrations.erase(found);
+  --m_count;
+}
+
+void VariableWatchers::Publish(std::string_view key, const std::optional<Variable>& variable)
+{
+  if (m_count.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  auto lock = std::shared_lock(m_mutex);
+  std::shared_ptr<const WatchedChange> change;
+  auto notify = [&](const std::vector<VariableWatcher*>& watchers) {
+    if (!change) {
+      change = Serialize(key, variable);
+    }
+    for (VariableWatcher* watcher : watchers) {
+      watcher->Push(change);
+    }
+  };
+  if (auto found = m_keys.find(key); found != m_keys.end()) {
+    notify(found->second);
+  }
+  for (auto [length, count] : m_prefixLengths) {
+    if (length > key.size()) {
+      break;
+    }
+    if (length == 0 && key.starts_with('\0')) {
+      // The empty prefix of the default tenant, the key is a tenant's
+      continue;
+    }
+    if (auto found = m_prefixes.find(key.substr(0, length)); found != m_prefixes.end()) {
+      notify(found->second);
+    }
+  }
+}
+
+std::shared_ptr<const WatchedChange> VariableWatchers::Serialize(std::string_view key, const std::optional<Variable>& variable)
+{
+  variable_service::WatchEvent event;
+  auto [tenant, tenantKey] = SplitStoredKey(key);
+  event.set_tenant(std::string(tenant));
+  event.set_key(std::string(tenantKey));
+  if (variable) {
+    event.set_exists(true);
+    event.set_value(variable->value);
+    event.set_version(variable->version);
+  }
+  auto change = std::make_shared<WatchedChange>();
+  change->key = key;
+  event.SerializeToString(&change->event);
+  return change;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <grpcpp/alarm.h>
+#include <async_grpc/async_grpc.hpp>
+#include "variable.hpp"
+
+class VariableWatchers;
+
+// A change as sent to the watchers, serialized once as a variable_service::WatchEvent and shared by all of them
+struct WatchedChange {
+  std::string key;
+  std::string event;
+};
+
+// Buffers the changes of the keys a stream watches until it's ready to send them. Only the latest change of a key is
+// kept, so a slow stream skips intermediate values instead of queuing them, and the buffer holds at most maxPending
+// keys. Past that the watcher overflows and stops buffering, the stream has to start over
+class VariableWatcher {
+public:
+  VariableWatcher(VariableWatchers& watchers, size_t maxPending);
+  VariableWatcher(const VariableWatcher&) = delete;
+  VariableWatcher& operator=(const VariableWatcher&) = delete;
+  // Stops receiving changes
+  ~VariableWatcher();
+
+  // Resumes once changes are pending, the watcher overflowed or deadline is reached, whichever comes first.
+  // The coroutine is resumed on its executor's completion queue. A single wait at a time
+  auto WaitForChanges(std::chrono::system_clock::time_point deadline) {
+    return async_grpc::CompletionQueueAwaitable([this, deadline](const async_grpc::AwaitData& data) {
+      Wait(data.cq, data.tag, deadline);
+    });
+  }
+
+  // Pending changes, one per key in the order the keys first changed since the previous call
+  std::vector<std::shared_ptr<const WatchedChange>> Take();
+  bool Overflowed();
+
+  void Push(std::shared_ptr<const WatchedChange> change);
+  // Only buffers the change if the key has none pending, used for the initial values which may be older than a change
+  // pushed meanwhile
+  void PushIfAbsent(std::shared_ptr<const WatchedChange> change);
+
+private:
+  void Wait(grpc::CompletionQueue* cq, void* tag, std::chrono::system_clock::time_point deadline);
+  void Buffer(std::shared_ptr<const WatchedChange> change, bool replace);
+  // Only keeps the latest change of each key, must be called with m_mutex held
+  void Coalesce();
+  // Must be called with m_mutex held
+  void Wake();
+
+  VariableWatchers& m_watchers;
+  size_t m_maxPending;
+
+  std::mutex m_mutex;
+  std::vector<std::shared_ptr<const WatchedChange>> m_pending;
+  size_t m_coalesceAt;
+  bool m_overflowed = false;
+  bool m_waiting = false;
+  // A member rather than part of the awaitable, Push may cancel it while the coroutine resumes from its deadline
+  grpc::Alarm m_alarm;
+};
+
+// Routes the changes of the variable store to the watchers of the keys, by exact key or by prefix
+class VariableWatchers {
+public:
+  static constexpr size_t DefaultMaxPending = 4096;
+
+  VariableWatchers() = default;
+  VariableWatchers(const VariableWatchers&) = delete;
+  VariableWatchers& operator=(const VariableWatchers&) = delete;
+
+  // The watcher receives the changes until it's destroyed
+  std::unique_ptr<VariableWatcher> Add(const std::vector<std::string>& keys, const std::vector<std::string>& prefixes, size_t maxPending = DefaultMaxPending);
+
+  // Keys and prefixes are stored keys, see StoredKey.
+  // Serializes the change once if anyone watches the key. Must be called under the key's shard lock so that the
+  // changes of a key reach the watchers in the order they're made
+  void Publish(std::string_view key, const std::optional<Variable>& variable);
+  // Only the serialization, for the initial values of a watcher
+  static std::shared_ptr<const WatchedChange> Serialize(std::string_view key, const std::optional<Variable>& variable);
+
+private:
+  friend class VariableWatcher;
+
+  struct Registration {
+    std::vector<std::string> keys;
+    std::vector<std::string> prefixes;
+  };
+
+  // Lets the maps be searched with a std::string_view
+  struct KeyHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+  };
+  using WatcherMap = std::unordered_map<std::string, std::vector<VariableWatcher*>, KeyHash, std::equal_to<>>;
+
+  void Remove(VariableWatcher* watcher);
+
+  // Checked before taking the lock, changes cost nothing while nobody watches
+  std::atomic<size_t> m_count = 0;
+  std::shared_mutex m_mutex;
+  WatcherMap m_keys;
+  WatcherMap m_prefixes;
+  // Number of watched prefixes of each length, a key is looked up once per distinct length
+  std::map<size_t, size_t> m_prefixLengths;
+  std::unordered_map<VariableWatcher*, Registration> m_registrations;
+};
@@ -0,0 +1,360 @@
+#include "write_ahead_log.hpp"
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utils/logs.hpp>
+
+// Record layout, integers in native byte order:
+//   u32 payload size, u32 crc32 of the payload
+//   payload: u64 sequence, u32 entry count, then per entry u32 key size, key, u8 flags, i64 value, u64 version and
+//   u64 expiry if flagged. Flags: HasValue, HasExpiry
+
+static auto Log() {
+  return utils::Log() << "[WriteAheadLog] ";
+}
+
+static constexpr size_t HeaderSize = 2 * sizeof(uint32_t);
+static constexpr uint8_t HasValue = 1;
+static constexpr uint8_t HasExpiry = 2;
+
+static uint32_t Crc32(std::string_view data) {
+  static const auto table = []() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320u : 0);
+      }
+      table[i] = crc;
+    }
+    return table;
+  }();
+  uint32_t crc = ~0u;
+  for (char c : data) {
+    crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+template<typename T>
+static void Put(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads a T at offset and moves past it, false if there isn't enough data
+template<typename T>
+static bool Get(std::string_view in, size_t& offset, T& value) {
+  if (in.size() - offset < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&value, in.data() + offset, sizeof(T));
+  offset += sizeof(T);
+  return true;
+}
+
+static bool ParsePayload(std::string_view payload, uint64_t& sequence, std::vector<LogEntry>& entries) {
+  size_t offset = 0;
+  uint32_t count = 0;
+  if (!Get(payload, offset, sequence) || !Get(payload, offset, count)) {
+    return false;
+  }
+  entries.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    LogEntry entry;
+    uint32_t keySize = 0;
+    if (!Get(payload, offset, keySize) || payload.size() - offset < keySize) {
+      return false;
+    }
+    entry.key = payload.substr(offset, keySize);
+    offset += keySize;
+    uint8_t flags = 0;
+    int64_t value = 0;
+    if (!Get(payload, offset, flags) || !Get(payload, offset, value) || !Get(payload, offset, entry.version)) {
+      return false;
+    }
+    if ((flags & HasExpiry) && !Get(payload, offset, entry.expiresAt)) {
+      return false;
+    }
+    if (flags & HasValue) {
+      entry.value = value;
+    }
+    entries.push_back(entry);
+  }
+  return offset == payload.size();
+}
+
+static utils::expected<std::string, std::string> ReadFile(const std::filesystem::path& path, uint64_t offset = 0) {
+  std::ifstream file(path, std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(offset));
+  std::string content(std::istreambuf_iterator<char>(file), {});
+  if (file.bad()) {
+    return utils::unexpected("Can't read " + path.string());
+  }
+  return content;
+}
+
+utils::expected<std::unique_ptr<WriteAheadLog>, std::string> WriteAheadLog::Open(Options options, uint64_t skipUpTo, const std::function<void(std::span<const LogEntry>)>& replay)
+{
+  uint64_t sequence = skipUpTo;
+  size_t offset = 0;
+  std::error_code error;
+  if (std::filesystem::exists(options.path, error)) {
+    auto content = ReadFile(options.path);
+    if (!content) {
+      return utils::unexpected(std::move(content.error()));
+    }
+    std::string_view data = *content;
+    size_t records = 0;
+    // First record found after a hole, nothing is replayed past it
+    uint64_t gapEnd = 0;
+    offset = ForEachRecord(data, [&](uint64_t recordSequence, std::span<const LogEntry> entries) {
+      if (gapEnd) {
+        return;
+      }
+      if (recordSequence > skipUpTo) {
+        // Records are numbered without holes, a missing one means the snapshot or the log isn't the one expected
+        if (recordSequence != sequence + 1) {
+          gapEnd = recordSequence;
+          return;
+        }
+        replay(entries);
+        ++records;
+      }
+      sequence = std::max(sequence, recordSequence);
+    });
+    if (gapEnd) {
+      return utils::unexpected(options.path.string() + " is missing records " + std::to_string(sequence + 1) + " to " + std::to_string(gapEnd - 1));
+    }
+    Log() << "Replayed " << records << " records from " << options.path.string();
+    if (offset < data.size()) {
+      // Most likely a crash in the middle of a write, whatever follows was never acknowledged
+      Log() << "Dropping " << data.size() - offset << " trailing bytes of invalid records";
+      std::filesystem::resize_file(options.path, offset, error);
+      if (error) {
+        return utils::unexpected("Can't truncate " + options.path.string() + ": " + error.message());
+      }
+    }
+  }
+
+  auto file = DurableFile::Open(options.path, DurableFile::Mode::Append);
+  if (!file) {
+    return utils::unexpected(std::move(file.error()));
+  }
+  return std::unique_ptr<WriteAheadLog>(new WriteAheadLog(std::move(options), std::move(*file), sequence, offset));
+}
+
+size_t WriteAheadLog::ForEachRecord(std::string_view data, const std::function<void(uint64_t, std::span<const LogEntry>)>& func)
+{
+  size_t offset = 0;
+  std::vector<LogEntry> entries;
+  while (offset < data.size()) {
+    size_t start = offset;
+    uint32_t size = 0;
+    uint32_t crc = 0;
+    uint64_t sequence = 0;
+    if (!Get(data, offset, size) || !Get(data, offset, crc) || data.size() - offset < size) {
+      return start;
+    }
+    auto payload = data.substr(offset, size);
+    if (Crc32(payload) != crc || !ParsePayload(payload, sequence, entries)) {
+      return start;
+    }
+    offset += size;
+    func(sequence, entries);
+  }
+  return offset;
+}
+
+WriteAheadLog::WriteAheadLog(Options options, DurableFile file, uint64_t sequence, uint64_t fileSize)
+  : m_options(std::move(options))
+  , m_file(std::move(file))
+  , m_appended(sequence)
+  , m_durable(sequence)
+  , m_logEnd(fileSize)
+  , m_fileSize(fileSize)
+  , m_thread([this]() { Run(); })
+{}
+
+WriteAheadLog::~WriteAheadLog()
+{
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wakeup.notify_one();
+  m_thread.join();
+}
+
+void WriteAheadLog::Append(std::span<const LogEntry> entries)
+{
+  std::string payload;
+  // The sequence number is only known once locked
+  Put(payload, uint64_t(0));
+  Put(payload, static_cast<uint32_t>(entries.size()));
+  for (const auto& entry : entries) {
+    Put(payload, static_cast<uint32_t>(entry.key.size()));
+    payload.append(entry.key);
+    Put(payload, static_cast<uint8_t>((entry.value ? HasValue : 0) | (entry.expiresAt ? HasExpiry : 0)));
+    Put(payload, entry.value.value_or(0));
+    Put(payload, entry.version);
+    if (entry.expiresAt) {
+      Put(payload, entry.expiresAt);
+    }
+  }
+
+  auto lock = std::unique_lock(m_mutex);
+  uint64_t sequence = ++m_appended;
+  std::memcpy(payload.data(), &sequence, sizeof(sequence));
+  Put(m_buffer, static_cast<uint32_t>(payload.size()));
+  Put(m_buffer, Crc32(payload));
+  m_buffer.append(payload);
+  m_logEnd += HeaderSize + payload.size();
+  if (m_pendingRecords++ == 0) {
+    m_firstPending = std::chrono::steady_clock::now();
+    m_wakeup.notify_one();
+  } else if (m_pendingRecords == m_options.batchSize) {
+    m_wakeup.notify_one();
+  }
+}
+
+bool WriteAheadLog::WaitDurable(uint64_t sequence)
+{
+  auto lock = std::unique_lock(m_mutex);
+  m_durableChanged.wait(lock, [&]() { return m_failed || m_durable >= sequence; });
+  return !m_failed;
+}
+
+WriteAheadLog::Cut WriteAheadLog::Mark()
+{
+  auto lock = std::unique_lock(m_mutex);
+  return Cut{ m_appended, m_logEnd };
+}
+
+uint64_t WriteAheadLog::Size()
+{
+  auto lock = std::unique_lock(m_mutex);
+  return m_logEnd - m_fileStart;
+}
+
+void WriteAheadLog::DropBefore(Cut cut)
+{
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_dropBefore = cut.offset;
+  }
+  m_wakeup.notify_one();
+}
+
+void WriteAheadLog::AddWaiter(Waiter waiter)
+{
+  auto lock = std::unique_lock(m_mutex);
+  m_waiters.push_back(waiter);
+  WakeWaiters();
+}
+
+void WriteAheadLog::WakeWaiters()
+{
+  for (size_t i = 0; i < m_waiters.size();) {
+    Waiter& waiter = m_waiters[i];
+    if (m_failed) {
+      // A cancelled alarm completes with ok = false
+      waiter.alarm->Set(waiter.cq, gpr_inf_future(GPR_CLOCK_MONOTONIC), waiter.tag);
+      waiter.alarm->Cancel();
+    } else if (waiter.sequence <= m_durable) {
+      waiter.alarm->Set(waiter.cq, gpr_time_0(GPR_CLOCK_MONOTONIC), waiter.tag);
+    } else {
+      ++i;
+      continue;
+    }
+    waiter = m_waiters.back();
+    m_waiters.pop_back();
+  }
+}
+
+WriteAheadLog::CompactResult WriteAheadLog::Compact(uint64_t offset, uint64_t fileSize)
+{
+  auto tail = ReadFile(m_options.path, offset);
+  if (!tail || tail->size() != fileSize - offset) {
+    Log() << "Failed to read the end of " << m_options.path.string();
+    return CompactResult::Skipped;
+  }
+  auto compactedPath = m_options.path;
+  compactedPath += ".compacting";
+  auto compacted = DurableFile::Open(compactedPath, DurableFile::Mode::Truncate);
+  if (!compacted) {
+    Log() << compacted.error();
+    return CompactResult::Skipped;
+  }
+  if (!compacted->Write(*tail) || !compacted->Sync()) {
+    Log() << "Failed to write " << compactedPath.string() << ": " << std::strerror(errno);
+    return CompactResult::Skipped;
+  }
+  if (auto replaced = DurableFile::Replace(compactedPath, m_options.path); !replaced) {
+    Log() << replaced.error();
+    return CompactResult::Skipped;
+  }
+  // The file is now the compacted one, appending carries on there
+  auto file = DurableFile::Open(m_options.path, DurableFile::Mode::Append);
+  if (!file) {
+    // Appending to the previous file would go to an unlinked inode
+    Log() << file.error();
+    return CompactResult::Failed;
+  }
+  m_file = std::move(*file);
+  return CompactResult::Compacted;
+}
+
+void WriteAheadLog::Run()
+{
+  auto lock = std::unique_lock(m_mutex);
+  while (true) {
+    m_wakeup.wait(lock, [this]() { return m_pendingRecords > 0 || m_dropBefore || m_stopping; });
+    if (m_pendingRecords == 0 && !m_dropBefore) {
+      break;
+    }
+    if (m_pendingRecords > 0) {
+      m_wakeup.wait_until(lock, m_firstPending + m_options.flushInterval, [this]() { return m_pendingRecords >= m_options.batchSize || m_stopping; });
+
+      std::string batch;
+      batch.swap(m_buffer);
+      m_pendingRecords = 0;
+      uint64_t sequence = m_appended;
+      bool failed = m_failed;
+      lock.unlock();
+      if (!failed && !(m_file.Write(batch) && m_file.Sync())) {
+        Log() << "Failed to write to " << m_options.path.string() << ": " << std::strerror(errno);
+        failed = true;
+      }
+      if (!failed && m_options.onDurable) {
+        m_options.onDurable(sequence, batch);
+      }
+      lock.lock();
+      m_failed = failed;
+      m_fileSize += batch.size();
+      m_durable = sequence;
+      WakeWaiters();
+      m_durableChanged.notify_all();
+    }
+    // Only once the records to drop are all in the file
+    if (m_dropBefore && *m_dropBefore <= m_fileStart + m_fileSize && !m_failed) {
+      uint64_t dropBefore = std::exchange(m_dropBefore, std::nullopt).value();
+      uint64_t offset = dropBefore - std::min(dropBefore, m_fileStart);
+      uint64_t fileSize = m_fileSize;
+      lock.unlock();
+      auto result = offset ? Compact(offset, fileSize) : CompactResult::Skipped;
+      lock.lock();
+      if (result == CompactResult::Compacted) {
+        m_fileStart = dropBefore;
+        m_fileSize -= offset;
+        Log() << "Dropped " << offset << " bytes of records covered by a snapshot";
+      } else if (result == CompactResult::Failed) {
+        m_failed = true;
+        WakeWaiters();
+        m_durableChanged.notify_all();
+      }
+    } else if (m_failed) {
+      m_dropBefore.reset();
+    }
+  }
+}
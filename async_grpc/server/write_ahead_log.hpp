@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <async_grpc/async_grpc.hpp>
+#include <utils/expected.hpp>
+#include "durable_file.hpp"
+
+// Append only log of the variable store's changes. Changes are buffered in memory and written by a background thread
+// with a single fsync per batch (group commit), callers co_await Sync() to know when their changes are on disk.
+// Records carry a sequence number and a checksum, a torn write at the end of the file is dropped on replay.
+
+// State of a key after a change, no value means it was deleted
+struct LogEntry {
+  std::string_view key;
+  std::optional<int64_t> value;
+  uint64_t version = 0;
+  // See Variable::expiresAt
+  uint64_t expiresAt = 0;
+};
+
+class WriteAheadLog {
+public:
+  struct Options {
+    std::filesystem::path path;
+    // Records that trigger a flush right away
+    size_t batchSize = 128;
+    // Longest a record waits for its batch to fill up, 0 flushes as soon as the previous fsync is done
+    std::chrono::microseconds flushInterval{ 1000 };
+    // Called by the flushing thread with each batch of records once it's on disk, framed as in the file, along with the
+    // sequence number of its last record. Batches come in order
+    std::function<void(uint64_t lastSequence, std::string_view records)> onDurable;
+  };
+
+  // Position in the log: the records up to sequence, which end at offset. Offsets count from the first record ever
+  // written and aren't affected by dropping records
+  struct Cut {
+    uint64_t sequence = 0;
+    uint64_t offset = 0;
+  };
+
+  // Calls replay with every record in the log after skipUpTo, in order, then opens it for appending.
+  // Records up to skipUpTo are already covered by a snapshot
+  static utils::expected<std::unique_ptr<WriteAheadLog>, std::string> Open(Options options, uint64_t skipUpTo, const std::function<void(std::span<const LogEntry>)>& replay);
+  // Calls func(sequence, entries) on each record framed in data, as in the file or given to onDurable. Returns the size
+  // of the valid records, less than data's size when a record is torn or corrupted
+  static size_t ForEachRecord(std::string_view data, const std::function<void(uint64_t, std::span<const LogEntry>)>& func);
+
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+  // Flushes what's left
+  ~WriteAheadLog();
+
+  // Entries of a record are replayed together or not at all
+  void Append(std::span<const LogEntry> entries);
+
+  // Resumes once every record appended before the call is on disk, the result is false if writing the log failed.
+  // The coroutine is resumed on its executor's completion queue, not on the flushing thread
+  auto Sync() {
+    return async_grpc::CompletionQueueAwaitable([this, sequence = Mark().sequence, alarm = grpc::Alarm()](const async_grpc::AwaitData& data) mutable {
+      AddWaiter(Waiter{ sequence, &alarm, data.cq, data.tag });
+    });
+  }
+
+  // Blocking version of Sync for threads that aren't executors
+  bool WaitDurable(uint64_t sequence);
+
+  // Where the log currently ends
+  Cut Mark();
+  // Size of the file once everything appended so far is flushed
+  uint64_t Size();
+  // Removes the records up to cut from the file, they must be covered by a durable snapshot.
+  // Done by the flushing thread, the remaining records are copied to a new file which replaces the log
+  void DropBefore(Cut cut);
+
+private:
+  struct Waiter {
+    uint64_t sequence;
+    grpc::Alarm* alarm;
+    grpc::CompletionQueue* cq;
+    void* tag;
+  };
+
+  WriteAheadLog(Options options, DurableFile file, uint64_t sequence, uint64_t fileSize);
+
+  void AddWaiter(Waiter waiter);
+  // Fires the alarms of the waiters whose records are on disk, must be called with m_mutex held
+  void WakeWaiters();
+  enum class CompactResult {
+    Compacted,
+    // The log is left as it was
+    Skipped,
+    // The log can't be appended to anymore
+    Failed,
+  };
+
+  // Called without m_mutex held, only the flushing thread touches the file
+  CompactResult Compact(uint64_t offset, uint64_t fileSize);
+  void Run();
+
+  Options m_options;
+  DurableFile m_file;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wakeup;
+  std::condition_variable m_durableChanged;
+  bool m_stopping = false;
+  bool m_failed = false;
+  // Records waiting for the next flush
+  std::string m_buffer;
+  size_t m_pendingRecords = 0;
+  std::chrono::steady_clock::time_point m_firstPending;
+  // Sequence numbers of the last appended and last flushed records
+  uint64_t m_appended = 0;
+  uint64_t m_durable = 0;
+  // Offset of the end of the last appended record, of the file's first record and size of what's written to the file
+  uint64_t m_logEnd = 0;
+  uint64_t m_fileStart = 0;
+  uint64_t m_fileSize = 0;
+  std::optional<uint64_t> m_dropBefore;
+  std::vector<Waiter> m_waiters;
+
+  std::jthread m_thread;
+};
@@ -0,0 +1,230 @@
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <utils/sharded_hash_map.hpp>
+#include "test_utils.hpp"
+
+// Keys are "<hash>:<name>", so that the tests choose which keys collide and where their probe sequences start
+struct ChosenHash {
+  size_t operator()(std::string_view key) const {
+    size_t hash = 0;
+    std::from_chars(key.data(), key.data() + key.find(':'), hash);
+    return hash;
+  }
+};
+
+// Few distinct hashes, most keys collide with several others
+struct CollidingHash {
+  size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key) % 8; }
+};
+
+// Keys are "<group>/<name>", the group gives the high half and a few bits of the whole key the low one so that the
+// slots collide a lot
+struct GroupHash {
+  using is_grouping = void;
+
+  size_t operator()(std::string_view key) const {
+    std::hash<std::string_view> hash;
+    return (hash(key.substr(0, key.find('/'))) << 32) | (hash(key) % 16);
+  }
+};
+
+static void TestInsertFindErase() {
+  utils::ShardedHashMap<int64_t> map;
+  CHECK(map.InsertOrAssign("a", 1));
+  CHECK(map.InsertOrAssign("b", 2));
+  CHECK(!map.InsertOrAssign("a", 3));
+  CHECK(map.Find("a") == 3);
+  CHECK(map.Find("b") == 2);
+  CHECK(!map.Find("c"));
+  CHECK(map.Size() == 2);
+  CHECK(map.Erase("a"));
+  CHECK(!map.Erase("a"));
+  CHECK(!map.Find("a"));
+  CHECK(map.Find("b") == 2);
+  CHECK(map.Size() == 1);
+}
+
+static void TestEraseShiftsClusterBack() {
+  // A single shard of 16 slots, the keys hashing to 15 wrap around to the start of the table
+  utils::ShardedHashMap<int64_t, ChosenHash> map(1);
+  std::unordered_map<std::string, int64_t> expected;
+  for (std::string key : { "3:a", "3:b", "4:a", "3:c", "15:a", "15:b", "15:c", "1:a" }) {
+    int64_t value = static_cast<int64_t>(expected.size());
+    map.InsertOrAssign(key, value);
+    expected[key] = value;
+  }
+  auto checkAll = [&]() {
+    for (const auto& [key, value] : expected) {
+      CHECK(map.Find(key) == value);
+    }
+    CHECK(map.Size() == expected.size());
+  };
+  checkAll();
+
+  // The rest of the cluster must stay reachable, including the key of another hash that landed after it
+  CHECK(map.Erase("3:a"));
+  expected.erase("3:a");
+  CHECK(!map.Find("3:a"));
+  checkAll();
+
+  // Same across the end of the table
+  CHECK(map.Erase("15:a"));
+  expected.erase("15:a");
+  CHECK(!map.Find("15:a"));
+  checkAll();
+
+  // Slots freed by the shifts are reused
+  for (const auto& [key, value] : expected) {
+    CHECK(map.Erase(key));
+  }
+  CHECK(map.Size() == 0);
+  CHECK(map.InsertOrAssign("3:a", 7));
+  CHECK(map.Find("3:a") == 7);
+}
+
+static void TestMatchesUnorderedMap() {
+  utils::ShardedHashMap<int64_t, CollidingHash> map(1);
+  std::unordered_map<std::string, int64_t> expected;
+  std::mt19937 random(42);
+  for (int i = 0; i < 20000; ++i) {
+    auto key = std::to_string(random() % 64);
+    if (random() % 3 == 0) {
+      CHECK(map.Erase(key) == (expected.erase(key) == 1));
+    } else {
+      int64_t value = random();
+      CHECK(map.InsertOrAssign(key, value) == !expected.contains(key));
+      expected[key] = value;
+    }
+    if (i % 100 == 0) {
+      for (int k = 0; k < 64; ++k) {
+        auto found = expected.find(std::to_string(k));
+        CHECK(map.Find(std::to_string(k)) == (found == expected.end() ? std::nullopt : std::optional(found->second)));
+      }
+      CHECK(map.Size() == expected.size());
+    }
+  }
+}
+
+static void TestGrowth() {
+  utils::ShardedHashMap<int64_t> map(4);
+  constexpr int64_t Count = 100000;
+  for (int64_t i = 0; i < Count; ++i) {
+    CHECK(map.InsertOrAssign("key" + std::to_string(i), i));
+  }
+  CHECK(map.Size() == Count);
+  for (int64_t i = 0; i < Count; ++i) {
+    CHECK(map.Find("key" + std::to_string(i)) == i);
+  }
+  for (int64_t i = 0; i < Count; i += 2) {
+    CHECK(map.Erase("key" + std::to_string(i)));
+  }
+  CHECK(map.Size() == Count / 2);
+  for (int64_t i = 0; i < Count; ++i) {
+    CHECK(map.Find("key" + std::to_string(i)) == (i % 2 ? std::optional(i) : std::nullopt));
+  }
+
+  // Reserving keeps what's there
+  map.Reserve(4 * Count);
+  CHECK(map.Size() == Count / 2);
+  CHECK(map.Find("key1") == 1);
+}
+
+static std::set<std::string> Group(const utils::ShardedHashMap<int64_t, GroupHash>& map, std::string_view group) {
+  std::set<std::string> keys;
+  map.ForEachInGroup(std::string(group) + "/", [&](std::string_view key, const int64_t&) {
+    CHECK(keys.emplace(key).second);
+  });
+  return keys;
+}
+
+static void TestGroups() {
+  utils::ShardedHashMap<int64_t, GroupHash> map(1);
+  std::unordered_map<std::string, std::set<std::string>> expected;
+  std::mt19937 random(7);
+  for (int i = 0; i < 20000; ++i) {
+    auto group = "g" + std::to_string(random() % 8);
+    auto key = group + "/" + std::to_string(random() % 32);
+    // Erasing shifts entries back, inserting grows the table, both move entries between slots
+    if (random() % 2 == 0) {
+      CHECK(map.Erase(key) == (expected[group].erase(key) == 1));
+    } else {
+      map.InsertOrAssign(key, i);
+      expected[group].insert(key);
+    }
+    if (i % 100 == 0) {
+      for (const auto& [name, keys] : expected) {
+        CHECK(Group(map, name) == keys);
+      }
+    }
+  }
+  map.Reserve(10000);
+  for (const auto& [name, keys] : expected) {
+    CHECK(Group(map, name) == keys);
+  }
+  CHECK(Group(map, "missing").empty());
+}
+
+static void TestModifyGroup() {
+  utils::ShardedHashMap<int64_t, GroupHash> map(4);
+  for (int64_t i = 0; i < 100; ++i) {
+    map.InsertOrAssign("a/" + std::to_string(i), i);
+    map.InsertOrAssign("b/" + std::to_string(i), i);
+  }
+  // Erase the group from within, the way a tenant is deleted
+  size_t erased = map.ModifyGroup("a/", [](auto& entries) {
+    std::vector<std::string> keys;
+    entries.ForEach([&](std::string_view key, const int64_t&) {
+      keys.emplace_back(key);
+    });
+    for (const auto& key : keys) {
+      CHECK(entries.Find(key).has_value());
+      entries.Modify(key, [](std::optional<int64_t>& value) { value.reset(); });
+    }
+    entries.Modify("a/new", [](std::optional<int64_t>& value) { value = 1; });
+    return keys.size();
+  });
+  CHECK(erased == 100);
+  CHECK(Group(map, "a") == std::set<std::string>{ "a/new" });
+  CHECK(Group(map, "b").size() == 100);
+  CHECK(map.Size() == 101);
+}
+
+static void TestConcurrentWriters() {
+  utils::ShardedHashMap<int64_t> map(8);
+  constexpr int Threads = 8;
+  constexpr int64_t PerThread = 10000;
+  std::vector<std::jthread> threads;
+  for (int t = 0; t < Threads; ++t) {
+    threads.emplace_back([&map, t]() {
+      for (int64_t i = 0; i < PerThread; ++i) {
+        map.InsertOrAssign(std::to_string(t) + ":" + std::to_string(i), i);
+      }
+    });
+  }
+  threads.clear();
+  CHECK(map.Size() == Threads * PerThread);
+  for (int t = 0; t < Threads; ++t) {
+    for (int64_t i = 0; i < PerThread; ++i) {
+      CHECK(map.Find(std::to_string(t) + ":" + std::to_string(i)) == i);
+    }
+  }
+}
+
+int main() {
+  test::Run("InsertFindErase", TestInsertFindErase);
+  test::Run("EraseShiftsClusterBack", TestEraseShiftsClusterBack);
+  test::Run("MatchesUnorderedMap", TestMatchesUnorderedMap);
+  test::Run("Growth", TestGrowth);
+  test::Run("Groups", TestGroups);
+  test::Run("ModifyGroup", TestModifyGroup);
+  test::Run("ConcurrentWriters", TestConcurrentWriters);
+  return test::Result();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+
+// The tests are plain programs run by ctest. A failed CHECK is reported and the test carries on, main returns
+// test::Result() so that the program fails if any check did.
+
+namespace test {
+
+  inline int& Failures() {
+    static int failures = 0;
+    return failures;
+  }
+
+  inline bool Check(bool condition, std::string_view expression, std::string_view file, int line) {
+    if (!condition) {
+      std::cerr << file << ':' << line << ": CHECK(" << expression << ") failed" << std::endl;
+      ++Failures();
+    }
+    return condition;
+  }
+
+  template<typename TFunc>
+  void Run(std::string_view name, TFunc&& func) {
+    int failures = Failures();
+    func();
+    std::cout << (Failures() == failures ? "[ OK ] " : "[FAIL] ") << name << std::endl;
+  }
+
+  inline int Result() {
+    return Failures() ? 1 : 0;
+  }
+
+  // Empty directory under the system's temporary one, removed with its content on destruction
+  class TempDir {
+  public:
+    TempDir() {
+      std::random_device random;
+      m_path = std::filesystem::temp_directory_path() / ("async_grpc_test_" + std::to_string(random()));
+      std::filesystem::create_directories(m_path);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    ~TempDir() {
+      std::error_code error;
+      std::filesystem::remove_all(m_path, error);
+    }
+
+    std::filesystem::path operator/(std::string_view name) const { return m_path / name; }
+
+  private:
+    std::filesystem::path m_path;
+  };
+
+}
+
+#define CHECK(...) ::test::Check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
@@ -0,0 +1,238 @@
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <server/variable_store.hpp>
+#include "test_utils.hpp"
+
+static std::optional<int64_t> Value(VariableStore& store, std::string_view key) {
+  auto variable = store.Read(key);
+  return variable ? std::optional(variable->value) : std::nullopt;
+}
+
+static std::map<std::string, int64_t> Tenant(const VariableStore& store, std::string_view tenant) {
+  std::map<std::string, int64_t> values;
+  for (const auto& [key, variable] : store.GetAll(tenant)) {
+    CHECK(values.emplace(key, variable.value).second);
+  }
+  return values;
+}
+
+static VariableStore::Options StoreOptions(const test::TempDir& dir) {
+  VariableStore::Options options;
+  options.log.path = dir / "log";
+  options.snapshot = dir / "snapshot";
+  // Snapshots are only written when the tests ask for one
+  options.snapshotLogSize = uint64_t(1) << 40;
+  return options;
+}
+
+static void TestSnapshotRoundTrip() {
+  test::TempDir dir;
+  std::unordered_map<std::string, Variable> variables;
+  for (int64_t i = 0; i < 1000; ++i) {
+    // Every other one expires, at some point far away
+    uint64_t expiresAt = i % 2 ? 0 : NowMs() + 3600000 + static_cast<uint64_t>(i);
+    variables.emplace("key" + std::to_string(i), Variable{ i * 3, static_cast<uint64_t>(i + 1), expiresAt });
+  }
+  variables.emplace("", Variable{ -1, 1001 });
+  CHECK(VariableSnapshot::Write(dir / "snapshot", variables, 42, 1001).has_value());
+
+  auto snapshot = VariableSnapshot::Load(dir / "snapshot");
+  CHECK(snapshot.has_value());
+  if (!snapshot) {
+    return;
+  }
+  CHECK((*snapshot)->LogSequence() == 42);
+  CHECK((*snapshot)->LastVersion() == 1001);
+  CHECK((*snapshot)->Size() == variables.size());
+  for (const auto& [key, variable] : variables) {
+    auto found = (*snapshot)->Find(key);
+    CHECK(found && found->value == variable.value && found->version == variable.version && found->expiresAt == variable.expiresAt);
+  }
+  CHECK(!(*snapshot)->Find("key1000"));
+  CHECK(!(*snapshot)->Find("missing"));
+
+  size_t count = 0;
+  (*snapshot)->ForEach([&](std::string_view key, const Variable& variable) {
+    auto expected = variables.find(std::string(key));
+    CHECK(expected != variables.end() && expected->second.value == variable.value && expected->second.version == variable.version
+      && expected->second.expiresAt == variable.expiresAt);
+    ++count;
+  });
+  CHECK(count == variables.size());
+}
+
+static void TestSnapshotEmpty() {
+  test::TempDir dir;
+  CHECK(VariableSnapshot::Write(dir / "snapshot", {}, 0, 0).has_value());
+  auto snapshot = VariableSnapshot::Load(dir / "snapshot");
+  CHECK(snapshot && (*snapshot)->Size() == 0 && !(*snapshot)->Find("a"));
+}
+
+static void TestSnapshotRejectsBadFile() {
+  test::TempDir dir;
+  std::filesystem::path path = dir / "snapshot";
+  CHECK(VariableSnapshot::Write(path, { { "a", Variable{ 1, 1 } } }, 1, 1).has_value());
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  CHECK(!VariableSnapshot::Load(path).has_value());
+}
+
+static void TestOverlay() {
+  test::TempDir dir;
+  {
+    VariableStore store;
+    CHECK(store.Open(StoreOptions(dir)).has_value());
+    store.Write("a", 1);
+    store.Write("b", 2);
+    store.Write("c", 3);
+    CHECK(store.WriteSnapshot().has_value());
+
+    // Changes on top of the snapshot hide what it holds
+    store.Write("a", 10);
+    CHECK(store.Del("b"));
+    CHECK(!store.Del("missing"));
+    store.Write("d", 4);
+    CHECK(Value(store, "a") == 10);
+    CHECK(!Value(store, "b"));
+    CHECK(Value(store, "c") == 3);
+    CHECK(Value(store, "d") == 4);
+  }
+
+  // The snapshot only covers the first three records, the log was cut there
+  auto snapshot = VariableSnapshot::Load(dir / "snapshot");
+  CHECK(snapshot && (*snapshot)->LogSequence() == 3 && (*snapshot)->Size() == 3);
+  size_t replayed = 0;
+  CHECK(!WriteAheadLog::Open(StoreOptions(dir).log, 0, [](std::span<const LogEntry>) {}).has_value());
+  CHECK(WriteAheadLog::Open(StoreOptions(dir).log, 3, [&](std::span<const LogEntry>) { ++replayed; }).has_value());
+  CHECK(replayed == 3);
+
+  {
+    VariableStore store;
+    CHECK(store.Open(StoreOptions(dir)).has_value());
+    CHECK(Value(store, "a") == 10);
+    CHECK(!Value(store, "b"));
+    CHECK(Value(store, "c") == 3);
+    CHECK(Value(store, "d") == 4);
+    // Versions keep growing across restarts
+    store.Write("e", 5);
+    CHECK(store.Read("e")->version > store.Read("d")->version);
+
+    // A second snapshot folds the overlay in, deletions included
+    CHECK(store.WriteSnapshot().has_value());
+    store.Write("c", 30);
+  }
+  VariableStore store;
+  CHECK(store.Open(StoreOptions(dir)).has_value());
+  CHECK(Value(store, "a") == 10);
+  CHECK(!Value(store, "b"));
+  CHECK(Value(store, "c") == 30);
+  CHECK(Value(store, "d") == 4);
+  CHECK(Value(store, "e") == 5);
+}
+
+static void TestSnapshotTenants() {
+  test::TempDir dir;
+  std::unordered_map<std::string, Variable> variables;
+  for (int64_t i = 0; i < 100; ++i) {
+    variables.emplace(StoredKey("player" + std::to_string(i % 10), std::to_string(i)), Variable{ i, 1 });
+  }
+  variables.emplace("player0", Variable{ -1, 1 });
+  CHECK(VariableSnapshot::Write(dir / "snapshot", variables, 0, 1).has_value());
+  auto snapshot = VariableSnapshot::Load(dir / "snapshot");
+  CHECK(snapshot.has_value());
+  if (!snapshot) {
+    return;
+  }
+  for (int tenant = 0; tenant < 10; ++tenant) {
+    auto prefix = StoredKey("player" + std::to_string(tenant), {});
+    size_t count = 0;
+    (*snapshot)->ForEachInTenant(prefix, [&](std::string_view key, const Variable& variable) {
+      CHECK(key.starts_with(prefix) && variable.value % 10 == tenant);
+      ++count;
+    });
+    CHECK(count == 10);
+  }
+  size_t missing = 0;
+  (*snapshot)->ForEachInTenant(StoredKey("player10", {}), [&](std::string_view, const Variable&) { ++missing; });
+  CHECK(missing == 0);
+  CHECK((*snapshot)->Find("player0")->value == -1);
+}
+
+static void TestTenants() {
+  test::TempDir dir;
+  auto check = [](VariableStore& store) {
+    CHECK((Tenant(store, "p1") == std::map<std::string, int64_t>{ { "a", 1 }, { "c", 5 } }));
+    CHECK((Tenant(store, "p2") == std::map<std::string, int64_t>{ { "a", 3 } }));
+    CHECK(Value(store, "a") == 4);
+  };
+  {
+    VariableStore store;
+    CHECK(store.Open(StoreOptions(dir)).has_value());
+    store.Write(StoredKey("p1", "a"), 1);
+    store.Write(StoredKey("p1", "b"), 2);
+    store.Write(StoredKey("p2", "a"), 3);
+    store.Write("a", 4);
+    CHECK(store.WriteSnapshot().has_value());
+    // GetAll merges the overlay with the snapshot
+    store.Write(StoredKey("p1", "c"), 5);
+    CHECK(store.Del(StoredKey("p1", "b")));
+    check(store);
+  }
+  {
+    VariableStore store;
+    CHECK(store.Open(StoreOptions(dir)).has_value());
+    check(store);
+    // Some of the tenant's keys are only in the snapshot, the others only in the overlay
+    CHECK(store.DeleteAll("p1") == 2);
+    CHECK(store.DeleteAll("p1") == 0);
+    CHECK(Tenant(store, "p1").empty());
+    CHECK((Tenant(store, "p2") == std::map<std::string, int64_t>{ { "a", 3 } }));
+  }
+  VariableStore store;
+  CHECK(store.Open(StoreOptions(dir)).has_value());
+  CHECK(Tenant(store, "p1").empty());
+  CHECK(!store.Read(StoredKey("p1", "a")));
+  CHECK((Tenant(store, "p2") == std::map<std::string, int64_t>{ { "a", 3 } }));
+  CHECK(Value(store, "a") == 4);
+}
+
+static void TestExpiry() {
+  test::TempDir dir;
+  uint64_t later = NowMs() + 3600000;
+  {
+    VariableStore store;
+    CHECK(store.Open(StoreOptions(dir)).has_value());
+    store.Write("gone", 1, NowMs() - 1);
+    store.Write("snapshot", 2, later);
+    CHECK(store.WriteSnapshot().has_value());
+    store.Write("log", 3, later);
+    // Other changes keep the expiry
+    CHECK(store.Increment("log", 1, 0).has_value());
+    CHECK(!store.Read("gone"));
+    CHECK(store.Read("log")->expiresAt == later);
+  }
+  // From the snapshot and from the log
+  VariableStore store;
+  CHECK(store.Open(StoreOptions(dir)).has_value());
+  CHECK(!store.Read("gone"));
+  auto fromSnapshot = store.Read("snapshot");
+  CHECK(fromSnapshot && fromSnapshot->value == 2 && fromSnapshot->expiresAt == later);
+  auto fromLog = store.Read("log");
+  CHECK(fromLog && fromLog->value == 4 && fromLog->expiresAt == later);
+  CHECK(!store.Write("log", 5));
+  CHECK(store.Read("log")->expiresAt == 0);
+}
+
+int main() {
+  test::Run("SnapshotRoundTrip", TestSnapshotRoundTrip);
+  test::Run("SnapshotEmpty", TestSnapshotEmpty);
+  test::Run("SnapshotRejectsBadFile", TestSnapshotRejectsBadFile);
+  test::Run("SnapshotTenants", TestSnapshotTenants);
+  test::Run("Overlay", TestOverlay);
+  test::Run("Tenants", TestTenants);
+  test::Run("Expiry", TestExpiry);
+  return test::Result();
+}
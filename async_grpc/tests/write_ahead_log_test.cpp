@@ -0,0 +1,163 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#include <server/write_ahead_log.hpp>
+#include "test_utils.hpp"
+
+// A replayed record written as "key=value@version" per entry, "key=-@version" for a deletion
+using Records = std::vector<std::string>;
+
+static std::string Describe(std::span<const LogEntry> entries) {
+  std::string record;
+  for (const auto& entry : entries) {
+    if (!record.empty()) {
+      record += ' ';
+    }
+    record += std::string(entry.key) + '=' + (entry.value ? std::to_string(*entry.value) : "-") + '@' + std::to_string(entry.version);
+  }
+  return record;
+}
+
+static WriteAheadLog::Options LogOptions(const std::filesystem::path& path) {
+  WriteAheadLog::Options options;
+  options.path = path;
+  return options;
+}
+
+static std::unique_ptr<WriteAheadLog> Open(const std::filesystem::path& path, Records& replayed, uint64_t skipUpTo = 0) {
+  auto log = WriteAheadLog::Open(LogOptions(path), skipUpTo, [&](std::span<const LogEntry> entries) {
+    replayed.push_back(Describe(entries));
+  });
+  CHECK(log.has_value());
+  return log ? std::move(*log) : nullptr;
+}
+
+// Appends the three records most tests start from, the log is flushed when it's destroyed
+static void AppendThree(const std::filesystem::path& path) {
+  Records replayed;
+  auto log = Open(path, replayed);
+  CHECK(replayed.empty());
+  log->Append(std::vector<LogEntry>{ { "a", 1, 1 } });
+  log->Append(std::vector<LogEntry>{ { "b", 2, 1 }, { "c", 3, 1 } });
+  log->Append(std::vector<LogEntry>{ { "a", std::nullopt, 2 } });
+}
+
+static void FlipByte(const std::filesystem::path& path, std::streamoff offset) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekg(offset);
+  char c = 0;
+  file.get(c);
+  file.seekp(offset);
+  file.put(static_cast<char>(c ^ 0x5a));
+}
+
+static void TestReplay() {
+  test::TempDir dir;
+  AppendThree(dir / "log");
+  Records replayed;
+  auto log = Open(dir / "log", replayed);
+  CHECK(replayed == Records{ "a=1@1", "b=2@1 c=3@1", "a=-@2" });
+}
+
+static void TestTruncatedTail() {
+  test::TempDir dir;
+  auto path = dir / "log";
+  AppendThree(path);
+  // Cut the last record in the middle, as a crash during the write would
+  auto size = std::filesystem::file_size(path);
+  std::filesystem::resize_file(path, size - 5);
+  {
+    Records replayed;
+    auto log = Open(path, replayed);
+    CHECK(replayed == Records{ "a=1@1", "b=2@1 c=3@1" });
+    log->Append(std::vector<LogEntry>{ { "d", 4, 1 } });
+  }
+  // The torn bytes were truncated, so the new record follows the valid ones
+  Records replayed;
+  auto log = Open(path, replayed);
+  CHECK(replayed == Records{ "a=1@1", "b=2@1 c=3@1", "d=4@1" });
+}
+
+static void TestCorruptTail() {
+  test::TempDir dir;
+  auto path = dir / "log";
+  AppendThree(path);
+  auto size = std::filesystem::file_size(path);
+  // The last byte belongs to the payload of the last record, its checksum no longer matches
+  FlipByte(path, static_cast<std::streamoff>(size - 1));
+  {
+    Records replayed;
+    auto log = Open(path, replayed);
+    CHECK(replayed == Records{ "a=1@1", "b=2@1 c=3@1" });
+  }
+  CHECK(std::filesystem::file_size(path) < size);
+}
+
+static void TestSkipsSnapshotRecords() {
+  test::TempDir dir;
+  AppendThree(dir / "log");
+  Records replayed;
+  auto log = Open(dir / "log", replayed, 2);
+  CHECK(replayed == Records{ "a=-@2" });
+  // Numbering carries on after the last record, not after the snapshot
+  CHECK(log->Mark().sequence == 3);
+}
+
+static void TestCompaction() {
+  test::TempDir dir;
+  auto path = dir / "log";
+  uint64_t size = 0;
+  {
+    Records replayed;
+    auto log = Open(path, replayed);
+    log->Append(std::vector<LogEntry>{ { "a", 1, 1 } });
+    log->Append(std::vector<LogEntry>{ { "b", 2, 2 } });
+    auto cut = log->Mark();
+    log->Append(std::vector<LogEntry>{ { "c", 3, 3 } });
+    size = log->Size();
+    log->DropBefore(cut);
+  }
+  CHECK(std::filesystem::file_size(path) < size);
+  {
+    Records replayed;
+    auto log = Open(path, replayed, 2);
+    CHECK(replayed == Records{ "c=3@3" });
+    log->Append(std::vector<LogEntry>{ { "d", 4, 4 } });
+  }
+  Records replayed;
+  auto log = Open(path, replayed, 2);
+  CHECK(replayed == Records{ "c=3@3", "d=4@4" });
+}
+
+static void TestSequenceGap() {
+  test::TempDir dir;
+  auto path = dir / "log";
+  {
+    Records replayed;
+    auto log = Open(path, replayed);
+    log->Append(std::vector<LogEntry>{ { "a", 1, 1 } });
+    log->Append(std::vector<LogEntry>{ { "b", 2, 2 } });
+    auto cut = log->Mark();
+    log->Append(std::vector<LogEntry>{ { "c", 3, 3 } });
+    log->DropBefore(cut);
+  }
+  // Without the snapshot covering the dropped records, the log can't be replayed
+  auto log = WriteAheadLog::Open(LogOptions(path), 0, [](std::span<const LogEntry>) {
+    CHECK(false);
+  });
+  CHECK(!log.has_value());
+  CHECK(!log && log.error().ends_with("is missing records 1 to 2"));
+}
+
+int main() {
+  test::Run("Replay", TestReplay);
+  test::Run("TruncatedTail", TestTruncatedTail);
+  test::Run("CorruptTail", TestCorruptTail);
+  test::Run("SkipsSnapshotRecords", TestSkipsSnapshotRecords);
+  test::Run("Compaction", TestCompaction);
+  test::Run("SequenceGap", TestSequenceGap);
+  return test::Result();
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <atomic>
 #include <coroutine>
 #include <optional>
+#include <utility>
 #include <variant>
 #include <cassert>
 
@@ -36,20 +38,37 @@ namespace async_lib {
     bool destroyOnDone = false;
     TExecutor* executor = nullptr;
     Job<TExecutor> parent;
+    // Set by whichever comes first of the task finishing and its parent awaiting it, the other one resumes the parent.
+    // Both can happen concurrently on executors running on several threads
+    std::atomic<bool> rendezvous{ false };
   };
 
+  // Spawned tasks destroy themselves, awaited ones hand over to their parent
   template<typename TExecutor>
-  void Resume(const Job<TExecutor>& job) {
-    job.handle.resume();
-    if (job.handle.done()) {
-      Job<TExecutor> parent = job.promise->parent;
-      if (job.promise->destroyOnDone) {
-        job.handle.destroy();
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template<std::derived_from<PromiseBase<TExecutor>> TPromise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> handle) noexcept {
+      PromiseBase<TExecutor>& promise = handle.promise();
+      if (promise.destroyOnDone) {
+        handle.destroy();
+        return std::noop_coroutine();
       }
-      if (parent) {
-        Resume(parent);
+      if (promise.rendezvous.exchange(true, std::memory_order_acq_rel)) {
+        return promise.parent.handle;
       }
+      return std::noop_coroutine();
     }
+
+    void await_resume() noexcept {}
+  };
+
+  template<typename TExecutor>
+  void Resume(const Job<TExecutor>& job) {
+    // Resumes the job until it gets suspended, the final suspend point takes care of its parent.
+    // The job may have been resumed and destroyed by another thread once this returns, it musn't be touched anymore
+    job.handle.resume();
   }
 
   template<typename T>
@@ -74,7 +93,7 @@ namespace async_lib {
   struct Promise : PromiseBase<TExecutor> {
     auto get_return_object() { return Task<TExecutor, T>(this); }
     std::suspend_always initial_suspend() { return {}; }
-    std::suspend_always final_suspend() noexcept { return {}; }
+    FinalAwaiter<TExecutor> final_suspend() noexcept { return {}; }
 
     template<typename U>
     void return_value(U&& value) {
@@ -90,7 +109,7 @@ namespace async_lib {
   struct Promise<TExecutor, void> : PromiseBase<TExecutor> {
     inline auto get_return_object() { return Task<TExecutor, void>(this); }
     inline std::suspend_always initial_suspend() { return {}; }
-    inline std::suspend_always final_suspend() noexcept { return {}; }
+    inline FinalAwaiter<TExecutor> final_suspend() noexcept { return {}; }
     inline void return_void() {}
     inline void unhandled_exception() {}
   };
@@ -148,21 +167,24 @@ namespace async_lib {
       std::coroutine_handle<promise_type>::from_promise(*m_promise).destroy();
     }
 
-    bool await_ready() { return std::coroutine_handle<promise_type>::from_promise(*m_promise).done(); }
+    bool await_ready() { return false; }
 
     template<std::derived_from<PromiseBase<TExecutor>> TPromise>
-    bool await_suspend(std::coroutine_handle<TPromise> parent) {
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> parent) {
       m_promise->parent = Job(parent);
-      // The task hasn't been started yet
+      // The task hasn't been started yet, run it, it will resume us when done
       if (!m_promise->executor) {
         m_promise->executor = parent.promise().executor;
-        auto cur = std::coroutine_handle<promise_type>::from_promise(*m_promise);
-        cur.resume();
-        return !cur.done();
+        m_promise->rendezvous.store(true, std::memory_order_relaxed);
+        return std::coroutine_handle<promise_type>::from_promise(*m_promise);
       }
       // The task was already started
       assert(m_promise->executor == parent.promise().executor);
-      return true;
+      if (m_promise->rendezvous.exchange(true, std::memory_order_acq_rel)) {
+        // and is done already
+        return parent;
+      }
+      return std::noop_coroutine();
     }
 
     T await_resume() {
@@ -1,29 +1,196 @@
 #include "async_game.hpp"
+#include <algorithm>
+#include <cassert>
+#include <utility>
 
 namespace async_game {
+  void ReadySignal::Notify() {
+    {
+      auto lock = std::unique_lock(m_mutex);
+      m_notified = true;
+    }
+    m_cv.notify_one();
+  }
+
+  bool ReadySignal::WaitUntil(std::chrono::steady_clock::time_point deadline) {
+    auto lock = std::unique_lock(m_mutex);
+    m_cv.wait_until(lock, deadline, [this] { return m_notified; });
+    return std::exchange(m_notified, false);
+  }
+
+  Executor::Executor()
+    : m_owner(this)
+    , m_priority(Priority::Normal)
+  {}
+
+  Executor::Executor(Executor& owner, Priority priority)
+    : m_owner(&owner)
+    , m_priority(priority)
+  {}
+
+  Executor::~Executor() = default;
+
+  Executor& Executor::WithPriority(Priority priority) {
+    Executor& owner = *m_owner;
+    if (priority == Priority::Normal) {
+      return owner;
+    }
+    auto& lane = owner.m_lanes[static_cast<size_t>(priority)];
+    if (!lane) {
+      lane = std::unique_ptr<Executor>(new Executor(owner, priority));
+    }
+    return *lane;
+  }
+
   void Executor::Spawn(const Job& job) {
     MarkReady(job);
   }
 
   void Executor::MarkReady(const Job& job) {
+    Executor& owner = *m_owner;
+    auto lock = std::unique_lock(owner.m_lock);
+    bool wasEmpty = owner.m_ready.empty();
+    owner.m_ready.push_back(Ready{ job, m_priority });
+    ReadySignal* signal = owner.m_readySignal;
+    lock.unlock();
+    // Once per batch, the thread draining collects all the jobs made ready until then
+    if (wasEmpty && signal) {
+      signal->Notify();
+    }
+  }
+
+  void Executor::SetReadySignal(ReadySignal* signal) {
+    assert(m_owner == this);
     auto lock = std::unique_lock(m_lock);
-    m_ready.push_back(job);
+    m_readySignal = signal;
   }
 
   void Executor::Update() {
+    assert(m_owner == this);
+    ++m_frame;
+    bool carriedOver = m_counters.deferred;
+    m_counters = FrameCounters{};
+    m_frameTime = std::chrono::nanoseconds::zero();
+    // Most executors have nothing to do on most frames
+    bool woken = WakeTimers();
+    if (!CollectReady() && !carriedOver && !woken) {
+      return;
+    }
+    ResumeQueued();
+  }
+
+  void Executor::Drain() {
+    assert(m_owner == this);
+    if (CollectReady()) {
+      ResumeQueued();
+    }
+  }
+
+  void Executor::ResumeQueued() {
+    // Drain only gets what the frame's Update and the previous calls to Drain left of the time budget
+    bool timed = m_budget.maxTime != std::chrono::nanoseconds::max();
+    auto start = timed ? Clock::now() : Clock::time_point();
+    auto timeLeft = m_budget.maxTime - m_frameTime;
+
+    // Jobs made ready by the ones resumed are collected once the queues are empty, like a new batch
     while (true) {
-      std::vector<Job> ready;
-      {
-        auto lock = std::unique_lock(m_lock);
-        ready.swap(m_ready);
+      bool starved = false;
+      size_t priority = PickQueue(starved);
+      if (priority == PriorityCount && (!CollectReady() || (priority = PickQueue(starved)) == PriorityCount)) {
+        break;
       }
-      if (ready.empty()) {
+      if (m_counters.resumed >= m_budget.maxJobs || (timed && Clock::now() - start >= timeLeft)) {
         break;
       }
-      for (const auto& job : ready) {
-        async_lib::Resume(job);
+      Job job = m_queued[priority][m_heads[priority]++].job;
+      ++m_counters.resumed;
+      m_counters.starved += starved;
+      async_lib::Resume(job);
+    }
+
+    if (timed) {
+      m_frameTime += Clock::now() - start;
+    }
+
+    // What's left is carried over, what was made ready since the last collect is seen on the next call
+    m_counters.deferred = 0;
+    for (size_t priority = 0; priority < PriorityCount; ++priority) {
+      auto& queued = m_queued[priority];
+      queued.erase(queued.begin(), queued.begin() + static_cast<std::ptrdiff_t>(m_heads[priority]));
+      m_heads[priority] = 0;
+      m_counters.deferred += queued.size();
+    }
+  }
+
+  bool Executor::CollectReady() {
+    {
+      auto lock = std::unique_lock(m_lock);
+      if (m_ready.empty()) {
+        return false;
       }
+      m_collected.swap(m_ready);
+    }
+    for (const auto& ready : m_collected) {
+      m_queued[static_cast<size_t>(ready.priority)].push_back(Queued{ ready.job, m_frame });
+    }
+    m_collected.clear();
+    return true;
+  }
+
+  void Executor::WakeOnFrame(const Job& job, uint64_t frames) {
+    Executor& owner = *m_owner;
+    owner.m_frameTimers.push_back(Timer<uint64_t>{ owner.m_frame + frames, owner.m_timerSequence++, job, m_priority });
+    std::push_heap(owner.m_frameTimers.begin(), owner.m_frameTimers.end());
+  }
+
+  void Executor::WakeAt(const Job& job, Clock::time_point deadline) {
+    Executor& owner = *m_owner;
+    owner.m_clockTimers.push_back(Timer<Clock::time_point>{ deadline, owner.m_timerSequence++, job, m_priority });
+    std::push_heap(owner.m_clockTimers.begin(), owner.m_clockTimers.end());
+  }
+
+  bool Executor::WakeTimers() {
+    bool woken = false;
+    auto wake = [&](auto& timers, auto now) {
+      while (!timers.empty() && timers.front().when <= now) {
+        std::pop_heap(timers.begin(), timers.end());
+        const auto& timer = timers.back();
+        m_queued[static_cast<size_t>(timer.priority)].push_back(Queued{ timer.job, m_frame });
+        timers.pop_back();
+        woken = true;
+      }
+    };
+    wake(m_frameTimers, m_frame);
+    if (!m_clockTimers.empty()) {
+      wake(m_clockTimers, Clock::now());
+    }
+    return woken;
+  }
+
+  size_t Executor::PickQueue(bool& starved) const {
+    size_t first = PriorityCount;
+    size_t oldest = PriorityCount;
+    for (size_t priority = 0; priority < PriorityCount; ++priority) {
+      const auto& queued = m_queued[priority];
+      size_t head = m_heads[priority];
+      if (head == queued.size()) {
+        continue;
+      }
+      if (first == PriorityCount) {
+        first = priority;
+      }
+      // Queues are in the order jobs were collected, the head waited the longest. Of the heads that waited too long,
+      // the oldest goes first so that a busy higher priority can't keep them waiting forever, ties go to the higher one
+      uint64_t frame = queued[head].frame;
+      if (m_frame - frame >= m_budget.maxDeferredFrames && (oldest == PriorityCount || frame < m_queued[oldest][m_heads[oldest]].frame)) {
+        oldest = priority;
+      }
+    }
+    if (oldest != PriorityCount) {
+      starved = oldest != first;
+      return oldest;
     }
+    return first;
   }
 
 }
\ No newline at end of file
@@ -1,27 +1,218 @@
 #pragma once
 
 #include <async_lib/async_lib.hpp>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
 
 namespace async_game {
   
   class Executor;
   using Job = async_lib::Job<Executor>;
+  class WaitFrames;
+  class WaitFor;
+
+  // Jobs of a higher priority are resumed first, gameplay continuations shouldn't wait behind bookkeeping
+  enum class Priority : uint8_t {
+    High,
+    Normal,
+    Low,
+  };
+  inline constexpr size_t PriorityCount = 3;
+
+  // Wakes a thread up when jobs are made ready on the executors notifying it, so that it can drain them
+  class ReadySignal {
+  public:
+    void Notify();
+    // Returns whether it was notified before deadline, and resets it
+    bool WaitUntil(std::chrono::steady_clock::time_point deadline);
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_notified = false;
+  };
 
   class Executor {
   public:
+    // Limits how much work Update does, what doesn't fit is carried over to the next call
+    struct Budget {
+      size_t maxJobs = std::numeric_limits<size_t>::max();
+      std::chrono::nanoseconds maxTime = std::chrono::nanoseconds::max();
+      // A job that waited that many calls to Update is resumed before any other, whatever its priority, the ones that
+      // waited the longest first
+      uint32_t maxDeferredFrames = 4;
+    };
+
+    // Of the last call to Update, and the calls to Drain that followed
+    struct FrameCounters {
+      size_t resumed = 0;
+      // Ready but carried over to the next call
+      size_t deferred = 0;
+      // Resumed ahead of their priority because they waited too long
+      size_t starved = 0;
+    };
+
+    Executor();
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+    ~Executor();
+
+    // Jobs spawned on the returned executor, and the coroutines they await, are resumed with that priority by this
+    // executor's Update. Jobs spawned on this one are Normal. Only from the thread updating the executor
+    Executor& WithPriority(Priority priority);
 
     void Spawn(const Job& job);
     void MarkReady(const Job& job);
 
+    void SetBudget(const Budget& budget) { m_budget = budget; }
+    // Notified whenever the executor gets ready jobs while it had none, it must outlive the executor or be unset
+    void SetReadySignal(ReadySignal* signal);
+    const FrameCounters& GetFrameCounters() const { return m_counters; }
+
     void Update();
+    // Resumes the jobs made ready since the last call to Update or Drain, between two calls to Update, within what's
+    // left of the frame's budget. It isn't a frame, jobs waiting for one are left alone
+    void Drain();
 
   private:
+    friend class WaitFrames;
+    friend class WaitFor;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Ready {
+      Job job;
+      Priority priority;
+    };
+
+    struct Queued {
+      Job job;
+      // Value of m_frame when Update first saw it
+      uint64_t frame;
+    };
+
+    // Ordered by when, then by sequence so that timers due together wake up in the order they were set
+    template<typename TWhen>
+    struct Timer {
+      TWhen when;
+      uint64_t sequence;
+      Job job;
+      Priority priority;
+
+      // Makes std::push_heap a min heap
+      bool operator<(const Timer& other) const {
+        return when != other.when ? when > other.when : sequence > other.sequence;
+      }
+    };
+
+    Executor(Executor& owner, Priority priority);
+
+    // Moves the ready jobs to the queues, returns whether there were any
+    bool CollectReady();
+    // Resumes the queued jobs, and the ones made ready meanwhile, until the budget runs out
+    void ResumeQueued();
+    // Priority of the next job to resume, PriorityCount once the queues are empty
+    size_t PickQueue(bool& starved) const;
+    // Only from a job resumed by the owner's Update
+    void WakeOnFrame(const Job& job, uint64_t frames);
+    void WakeAt(const Job& job, Clock::time_point deadline);
+    // Moves the timers due to the queues, returns whether there were any
+    bool WakeTimers();
+
+    // The executor the jobs are queued on, this one unless it was returned by WithPriority
+    Executor* m_owner;
+    Priority m_priority;
+
+    // What an idle executor's Update touches comes first, so that it fits a couple of cache lines
     std::mutex m_lock;
-    std::vector<Job> m_ready;
+    std::vector<Ready> m_ready;
+    ReadySignal* m_readySignal = nullptr;
+    uint64_t m_frame = 0;
+    FrameCounters m_counters;
+    // Spent resuming jobs by the last call to Update and the calls to Drain that followed, only kept with a time budget
+    std::chrono::nanoseconds m_frameTime{};
+
+    // Only used by Update. The jobs before the head of a queue were resumed, they're erased when Update returns
+    std::vector<Ready> m_collected;
+    std::array<std::vector<Queued>, PriorityCount> m_queued;
+    std::array<size_t, PriorityCount> m_heads{};
+    // Heaps, only touched by the thread updating the executor
+    std::vector<Timer<uint64_t>> m_frameTimers;
+    std::vector<Timer<Clock::time_point>> m_clockTimers;
+    uint64_t m_timerSequence = 0;
+    Budget m_budget;
+    std::array<std::unique_ptr<Executor>, PriorityCount> m_lanes;
   };
 
   template<typename T = void>
   using Task = async_lib::Task<Executor, T>;
+
+  // Resumes the coroutine on the frames-th next call to its executor's Update, with its priority. No other thread is
+  // involved and nothing is allocated, the executor keeps the timer in a heap
+  class WaitFrames {
+  public:
+    explicit WaitFrames(uint64_t frames)
+      : m_frames(frames)
+    {}
+
+    bool await_ready() const { return m_frames == 0; }
+
+    template<std::derived_from<async_lib::PromiseBase<Executor>> TPromise>
+    void await_suspend(std::coroutine_handle<TPromise> handle) {
+      handle.promise().executor->WakeOnFrame(Job(handle), m_frames);
+    }
+
+    void await_resume() const {}
+
+  private:
+    uint64_t m_frames;
+  };
+
+  inline WaitFrames NextFrame() {
+    return WaitFrames(1);
+  }
+
+  // Resumes the coroutine on the first call to its executor's Update once duration has elapsed, with its priority
+  class WaitFor {
+  public:
+    explicit WaitFor(std::chrono::nanoseconds duration)
+      : m_duration(duration)
+    {}
+
+    bool await_ready() const { return m_duration <= std::chrono::nanoseconds::zero(); }
+
+    template<std::derived_from<async_lib::PromiseBase<Executor>> TPromise>
+    void await_suspend(std::coroutine_handle<TPromise> handle) {
+      handle.promise().executor->WakeAt(Job(handle), Executor::Clock::now() + m_duration);
+    }
+
+    void await_resume() const {}
+
+  private:
+    std::chrono::nanoseconds m_duration;
+  };
+
+  // Gives the executor the coroutine runs on, to spawn coroutines next to it, without suspending it
+  class CurrentExecutor {
+  public:
+    bool await_ready() const { return false; }
+
+    template<std::derived_from<async_lib::PromiseBase<Executor>> TPromise>
+    bool await_suspend(std::coroutine_handle<TPromise> handle) {
+      m_executor = handle.promise().executor;
+      return false;
+    }
+
+    Executor& await_resume() const { return *m_executor; }
+
+  private:
+    Executor* m_executor = nullptr;
+  };
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <async_grpc/client.hpp>
+#include <benchmarks/bench_utils.hpp>
+#include <game/frame_scheduler.hpp>
+
+// Latency between a gRPC executor completing a call made by a game coroutine and the coroutine resuming, with the
+// game's 100ms frames. Every frame, an entity makes calls which complete after a random delay of
+// up to a frame on a gRPC executor thread, the way a slow RPC would. Without draining, the coroutine waits for the next
+// frame, with FrameScheduler::Options::drainCompletions it's resumed on its thread as soon as the completion comes.
+// Usage: completion_benchmark [frames = 30] [calls per frame = 10]
+
+namespace {
+
+  constexpr auto FramePeriod = std::chrono::milliseconds(100);
+
+  // splitmix64
+  uint64_t NextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+  class Caller : public Entity {
+  public:
+    Caller(async_grpc::CompletionQueueExecutor& grpcExecutor, size_t callsPerFrame, utils::Histogram& latencies)
+      : m_grpcExecutor(grpcExecutor)
+      , m_callsPerFrame(callsPerFrame)
+      , m_latencies(latencies)
+    {}
+
+    size_t GetCallsInFlight() const { return m_inFlight; }
+    void Stop() { m_stopped = true; }
+
+    virtual void Update([[maybe_unused]] Elapsed elapsed) override {
+      if (m_stopped) {
+        return;
+      }
+      for (size_t i = 0; i < m_callsPerFrame; ++i) {
+        auto delay = std::chrono::nanoseconds(NextRandom(m_random) % std::chrono::nanoseconds(FramePeriod).count());
+        ++m_inFlight;
+        async_lib::Spawn(m_executor, Call(delay));
+      }
+    }
+
+  private:
+    async_game::Task<> Call(std::chrono::nanoseconds delay) {
+      auto completedAt = co_await async_lib::SpawnCrossTask(m_grpcExecutor, Respond(delay));
+      m_latencies.Record(bench::ElapsedNs(completedAt));
+      --m_inFlight;
+    }
+
+    // Returns when it completed
+    static async_grpc::Task<bench::clock::time_point> Respond(std::chrono::nanoseconds delay) {
+      co_await async_grpc::Alarm(std::chrono::system_clock::now() + delay);
+      co_return bench::clock::now();
+    }
+
+    async_grpc::CompletionQueueExecutor& m_grpcExecutor;
+    size_t m_callsPerFrame;
+    utils::Histogram& m_latencies;
+    uint64_t m_random = 42;
+    size_t m_inFlight = 0;
+    bool m_stopped = false;
+  };
+
+  void Run(std::string_view name, bool drainCompletions, size_t frames, size_t callsPerFrame) {
+    async_grpc::ClientExecutorThreads grpcExecutor(1);
+    utils::Histogram latencies;
+    double cpuStart = bench::CpuSeconds();
+    auto start = bench::clock::now();
+    {
+      FrameScheduler scheduler({ .threads = 1, .drainCompletions = drainCompletions });
+      auto caller = std::make_unique<Caller>(grpcExecutor.GetExecutor(), callsPerFrame, latencies);
+      Caller& callerRef = *caller;
+      scheduler.Add(std::move(caller));
+
+      auto lastTick = bench::clock::now();
+      for (size_t frame = 0; frame < frames || callerRef.GetCallsInFlight(); ++frame) {
+        if (frame == frames) {
+          callerRef.Stop();
+        }
+        auto now = bench::clock::now();
+        scheduler.Update(now - lastTick);
+        lastTick = now;
+        scheduler.Idle(now + FramePeriod);
+      }
+    }
+    double seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+    bench::PrintLatencyRow(name, latencies, seconds, (bench::CpuSeconds() - cpuStart) / seconds);
+    grpcExecutor.Shutdown();
+  }
+
+}
+
+int main(int ac, char** av) {
+  size_t frames = 30;
+  size_t callsPerFrame = 10;
+  if (ac > 1) {
+    frames = std::stoul(av[1]);
+  }
+  if (ac > 2) {
+    callsPerFrame = std::stoul(av[2]);
+  }
+
+  std::cout << frames << " frames of " << FramePeriod.count() << "ms, " << callsPerFrame << " calls per frame" << std::endl;
+  bench::PrintLatencyHeader("completion to resume");
+  Run("next frame", false, frames, callsPerFrame);
+  Run("drained", true, frames, callsPerFrame);
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmarks/bench_utils.hpp>
+#include <game/character_chunk.hpp>
+#include <game/character_service_memory.hpp>
+#include <game/frame_scheduler.hpp>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Frame time of the game loop with a growing amount of fighting characters, each with its own in memory character
+// service, updated by FrameScheduler on a growing amount of threads. Frames are simulated 100ms apart, a character
+// spawns a coroutine earning xp every 10 frames, which runs on the next frame's PreUpdate.
+// Two layouts are compared:
+//  - objects: a CharacterChunk per character, the equivalent of an entity object each with its own executor
+//  - chunks: CharacterChunks of 1024 characters, sharing an executor and walked as arrays
+// Cache misses are counted on the thread calling Update, so only for single threaded runs, where the platform allows.
+// Then 100k characters in chunks, on a single thread, with a budget of jobs per chunk per frame: the characters
+// that started fighting together earn xp on the same frame, the budget spreads the resumption of their coroutines over
+// the next ones. Spawning them, on the frame before, isn't spread.
+// Resumed and deferred are the average amount of jobs per frame, over all the chunks.
+// Usage: frame_benchmark [frames = 200]
+
+namespace {
+
+  // Cache misses of the calling thread, through perf events on Linux
+  class CacheMissCounter {
+  public:
+    CacheMissCounter() {
+#ifdef __linux__
+      perf_event_attr attributes{};
+      attributes.type = PERF_TYPE_HARDWARE;
+      attributes.size = sizeof(attributes);
+      attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+      attributes.disabled = 1;
+      attributes.exclude_kernel = 1;
+      attributes.exclude_hv = 1;
+      m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+    }
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    ~CacheMissCounter() {
+#ifdef __linux__
+      if (m_fd >= 0) {
+        close(m_fd);
+      }
+#endif
+    }
+
+    void Start() {
+#ifdef __linux__
+      if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+    }
+
+    std::optional<uint64_t> Stop() {
+#ifdef __linux__
+      uint64_t count = 0;
+      if (m_fd >= 0 && ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0) == 0 && read(m_fd, &count, sizeof(count)) == sizeof(count)) {
+        return count;
+      }
+#endif
+      return std::nullopt;
+    }
+
+  private:
+    int m_fd = -1;
+  };
+
+  struct Result {
+    utils::Histogram frameTimes;
+    double seconds = 0;
+    std::optional<uint64_t> cacheMisses;
+    uint64_t resumed = 0;
+    uint64_t deferred = 0;
+  };
+
+  Result Run(size_t characters, CharacterChunk::Options chunkOptions, size_t threads, size_t frames) {
+    std::vector<std::unique_ptr<CharacterServiceMemory>> services;
+    FrameScheduler scheduler({ .threads = threads, .drainCompletions = false });
+    std::unique_ptr<CharacterChunk> chunk;
+    for (size_t i = 0; i < characters; ++i) {
+      if (!chunk) {
+        chunk = std::make_unique<CharacterChunk>(chunkOptions);
+      }
+      services.push_back(std::make_unique<CharacterServiceMemory>());
+      chunk->Add(*services.back());
+      if (chunk->IsFull()) {
+        scheduler.Add(std::move(chunk));
+      }
+    }
+    if (chunk) {
+      scheduler.Add(std::move(chunk));
+    }
+    // The first frame spawns Init, the next ones run it
+    scheduler.Update(Elapsed(0));
+    do {
+      scheduler.Update(Elapsed(0));
+    } while (scheduler.GetExecutorCounters().resumed);
+    scheduler.ForEach([](Entity& entity) {
+      entity.ProcessInput("fight");
+    });
+
+    Result result;
+    CacheMissCounter cacheMisses;
+    cacheMisses.Start();
+    auto start = bench::clock::now();
+    for (size_t frame = 0; frame < frames; ++frame) {
+      auto frameStart = bench::clock::now();
+      scheduler.Update(std::chrono::milliseconds(100));
+      result.frameTimes.Record(bench::ElapsedNs(frameStart));
+      auto counters = scheduler.GetExecutorCounters();
+      result.resumed += counters.resumed;
+      result.deferred += counters.deferred;
+    }
+    result.seconds = static_cast<double>(bench::ElapsedNs(start)) / 1e9;
+    result.cacheMisses = cacheMisses.Stop();
+    return result;
+  }
+
+}
+
+int main(int ac, char** av) {
+  size_t frames = 200;
+  if (ac > 1) {
+    frames = std::stoul(av[1]);
+  }
+
+  std::vector<size_t> threadCounts = { 1, 2, 4, 8 };
+  size_t hardwareThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  std::erase_if(threadCounts, [&](size_t threads) { return threads > hardwareThreads; });
+  if (threadCounts.back() != hardwareThreads) {
+    threadCounts.push_back(hardwareThreads);
+  }
+
+  std::cout << frames << " frames, " << hardwareThreads << " hardware threads" << std::endl;
+  std::cout << std::left << std::setw(12) << "characters" << std::setw(10) << "layout" << std::setw(10) << "threads"
+    << std::right
+    << std::setw(12) << "frames/s"
+    << std::setw(10) << "p50 us"
+    << std::setw(10) << "p99 us"
+    << std::setw(10) << "max us"
+    << std::setw(10) << "speedup"
+    << std::setw(14) << "misses/char" << std::endl;
+  for (size_t characters : { 1, 10'000, 100'000 }) {
+    for (auto [layout, chunkCapacity] : { std::pair{ "objects", size_t(1) }, std::pair{ "chunks", size_t(1024) } }) {
+      double baseline = 0;
+      for (size_t threads : threadCounts) {
+        auto result = Run(characters, CharacterChunk::Options{ .capacity = chunkCapacity, .quiet = true, .budget = {} }, threads, frames);
+        double framesPerSecond = static_cast<double>(frames) / result.seconds;
+        if (threads == 1) {
+          baseline = framesPerSecond;
+        }
+        auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+        std::cout << std::left << std::setw(12) << characters << std::setw(10) << layout << std::setw(10) << threads
+          << std::right << std::fixed << std::setprecision(1)
+          << std::setw(12) << framesPerSecond
+          << std::setw(10) << us(result.frameTimes.Percentile(50))
+          << std::setw(10) << us(result.frameTimes.Percentile(99))
+          << std::setw(10) << us(result.frameTimes.Max())
+          << std::setw(10) << std::setprecision(2) << framesPerSecond / baseline
+          << std::setw(14);
+        if (threads == 1 && result.cacheMisses) {
+          std::cout << static_cast<double>(*result.cacheMisses) / static_cast<double>(frames * characters);
+        } else {
+          std::cout << "-";
+        }
+        std::cout << std::endl;
+      }
+    }
+  }
+
+  std::cout << std::endl << std::left << std::setw(20) << "jobs per frame" << std::right
+    << std::setw(12) << "frames/s"
+    << std::setw(10) << "p50 us"
+    << std::setw(10) << "p99 us"
+    << std::setw(10) << "max us"
+    << std::setw(12) << "resumed"
+    << std::setw(12) << "deferred" << std::endl;
+  for (size_t maxJobs : { size_t(0), size_t(512), size_t(256), size_t(128) }) {
+    CharacterChunk::Options options{ .capacity = 1024, .quiet = true, .budget = {} };
+    if (maxJobs) {
+      options.budget.maxJobs = maxJobs;
+    }
+    auto result = Run(100'000, options, 1, frames);
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    auto perFrame = [&](uint64_t count) { return static_cast<double>(count) / static_cast<double>(frames); };
+    std::cout << std::left << std::setw(20) << (maxJobs ? std::to_string(maxJobs) : "unlimited") << std::right
+      << std::fixed << std::setprecision(1)
+      << std::setw(12) << static_cast<double>(frames) / result.seconds
+      << std::setw(10) << us(result.frameTimes.Percentile(50))
+      << std::setw(10) << us(result.frameTimes.Percentile(99))
+      << std::setw(10) << us(result.frameTimes.Max())
+      << std::setw(12) << perFrame(result.resumed)
+      << std::setw(12) << perFrame(result.deferred) << std::endl;
+  }
+}
@@ -0,0 +1,126 @@
+#include "character_chunk.hpp"
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[Game] ";
+}
+
+CharacterChunk::CharacterChunk(Options options)
+  : m_options(std::move(options))
+{
+  m_executor.SetBudget(m_options.budget);
+}
+
+size_t CharacterChunk::Add(CharacterService& characterService)
+{
+  m_states.push_back(State::Uninit);
+  m_timesSinceXp.push_back(Elapsed(0));
+  m_characterServices.push_back(&characterService);
+  return m_states.size() - 1;
+}
+
+void CharacterChunk::ProcessInput(std::string_view input)
+{
+  for (size_t index = 0; index < m_states.size(); ++index) {
+    ProcessInput(index, input);
+  }
+}
+
+void CharacterChunk::ProcessInput(size_t index, std::string_view input)
+{
+  State& state = m_states[index];
+  if (state == State::Idle && input == "fight") {
+    if (!m_options.quiet) {
+      Log() << "Let's fight!";
+    }
+    state = State::Fighting;
+    m_timesSinceXp[index] = Elapsed(0);
+  } else if (state == State::Fighting && input == "rest") {
+    if (!m_options.quiet) {
+      Log() << "Time for a break";
+    }
+    state = State::Idle;
+  } else if (state == State::Idle && input == "reincarnate") {
+    async_lib::Spawn(m_executor, Reincarnate(index));
+  }
+}
+
+void CharacterChunk::Update(Elapsed elapsed)
+{
+  // Walks the states, and the times of the fighting characters only, the services stay out of the cache until a
+  // coroutine needs them
+  for (size_t index = 0; index < m_states.size(); ++index) {
+    switch (m_states[index]) {
+    case State::Uninit: {
+      m_states[index] = State::Initializing;
+      // Nothing happens to the character until it's loaded
+      async_lib::Spawn(m_executor.WithPriority(async_game::Priority::High), Init(index));
+      break;
+    }
+    case State::Fighting: {
+      Elapsed& timeSinceXp = m_timesSinceXp[index];
+      timeSinceXp += elapsed;
+      if (timeSinceXp >= std::chrono::seconds(1)) {
+        timeSinceXp -= std::chrono::seconds(1);
+        async_lib::Spawn(m_executor, EarnXp(index));
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+async_game::Task<> CharacterChunk::Init(size_t index)
+{
+  auto player = co_await m_characterServices[index]->GetPlayer();
+  if (!player) {
+    if (!m_options.quiet) {
+      Log() << "Failed to load you (" << player.error().message << "), retrying in a second";
+    }
+    co_await async_game::WaitFor(std::chrono::seconds(1));
+    // Spawned again by the next update
+    m_states[index] = State::Uninit;
+    co_return;
+  }
+  if (!m_options.quiet) {
+    Log() << "You are level " << player->level << " with " << player->xp << "xp";
+  }
+  m_states[index] = State::Idle;
+}
+
+async_game::Task<> CharacterChunk::EarnXp(size_t index)
+{
+  CharacterService& characterService = *m_characterServices[index];
+  auto newXp = co_await characterService.GiveXp(100);
+  if (!newXp) {
+    if (!m_options.quiet) {
+      Log() << "The 100xp you earned got lost (" << newXp.error().message << ')';
+    }
+    co_return;
+  }
+  if (*newXp >= 1000) {
+    auto newLevel = co_await characterService.LevelUp();
+    if (!m_options.quiet && newLevel) {
+      Log() << "You earned 100xp! You leveled up! You are now level " << *newLevel;
+    } else if (!m_options.quiet) {
+      Log() << "You earned 100xp! You failed to level up (" << newLevel.error().message << ')';
+    }
+  } else if (!m_options.quiet) {
+    Log() << "You earned 100xp! You now have " << *newXp << " experience points";
+  }
+}
+
+async_game::Task<> CharacterChunk::Reincarnate(size_t index)
+{
+  if (!m_options.quiet) {
+    Log() << "You forgo your previous life...";
+  }
+  auto reset = co_await m_characterServices[index]->Reset();
+  if (!m_options.quiet && reset) {
+    Log() << "It is done, you are now a blank slate, ready for the upcoming challenges";
+  } else if (!m_options.quiet) {
+    Log() << "The ritual failed (" << reset.error().message << ')';
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "character_service.hpp"
+#include "entity.hpp"
+
+// Characters stored as component arrays, indexed by character, rather than an entity each: a frame walks the arrays
+// once, with a single virtual call for the whole chunk, and the coroutines of all the characters share the chunk's
+// executor. Characters never leave their chunk, their coroutines all run on the thread updating it.
+class CharacterChunk : public Entity {
+public:
+  struct Options {
+    // Characters added past it go to another chunk, which may be updated on another thread
+    size_t capacity = 1024;
+    // Doesn't log what happens to the characters, for benchmarks simulating lots of them
+    bool quiet = false;
+    // Of the chunk's executor, shared by all its characters
+    async_game::Executor::Budget budget;
+  };
+
+  explicit CharacterChunk(Options options);
+
+  bool IsFull() const { return m_states.size() >= m_options.capacity; }
+  size_t GetSize() const { return m_states.size(); }
+
+  // Returns the character's index in the chunk. Only between frames, characterService must outlive the chunk
+  size_t Add(CharacterService& characterService);
+
+  // Goes to every character of the chunk
+  virtual void ProcessInput(std::string_view input) override;
+  void ProcessInput(size_t index, std::string_view input);
+
+  virtual void Update(Elapsed elapsed) override;
+
+private:
+  enum class State : uint8_t {
+    Uninit,
+    Initializing,
+    Idle,
+    Fighting
+  };
+
+  async_game::Task<> Init(size_t index);
+  async_game::Task<> EarnXp(size_t index);
+  async_game::Task<> Reincarnate(size_t index);
+
+  Options m_options;
+  std::vector<State> m_states;
+  std::vector<Elapsed> m_timesSinceXp;
+  std::vector<CharacterService*> m_characterServices;
+};
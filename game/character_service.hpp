@@ -1,6 +1,7 @@
 #pragma once
 
 #include "async_game.hpp"
+#include <string>
 #include <utils/expected.hpp>
 
 struct Player {
@@ -8,20 +9,28 @@ struct Player {
   int64_t xp = 0;
 };
 
+// A call that failed may or may not have been applied
+struct CharacterServiceError {
+  std::string message;
+};
+
+template<typename T = void>
+using CharacterResult = utils::expected<T, CharacterServiceError>;
+
 struct CharacterService {
 
   virtual ~CharacterService() = default;
 
   // If player doesn't exist, creates it at level 1 with 0 xp
-  virtual async_game::Task<Player> GetPlayer() = 0;
+  virtual async_game::Task<CharacterResult<Player>> GetPlayer() = 0;
 
   // Returns the new ammount of xp
-  virtual async_game::Task<int64_t> GiveXp(int64_t ammount) = 0;
+  virtual async_game::Task<CharacterResult<int64_t>> GiveXp(int64_t ammount) = 0;
 
   // Will reset the ammount of xp and increase the level
   // Returns the new level.
-  virtual async_game::Task<int64_t> LevelUp() = 0;
+  virtual async_game::Task<CharacterResult<int64_t>> LevelUp() = 0;
 
   // Will set the player back as a level 1 with 0 xp
-  virtual async_game::Task<> Reset() = 0;
+  virtual async_game::Task<CharacterResult<>> Reset() = 0;
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "character_service_cache.hpp"
+#include <utility>
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[CharacterServiceCache] ";
+}
+
+CharacterServiceCache::CharacterServiceCache(Dependencies deps, Options options)
+  : m_dependencies(std::move(deps))
+  , m_options(std::move(options))
+{}
+
+async_game::Task<CharacterResult<Player>> CharacterServiceCache::GetPlayer()
+{
+  if (auto loaded = co_await Load(); !loaded) {
+    co_return utils::unexpected(std::move(loaded.error()));
+  }
+  co_return *m_player;
+}
+
+async_game::Task<CharacterResult<int64_t>> CharacterServiceCache::GiveXp(int64_t ammount)
+{
+  if (auto loaded = co_await Load(); !loaded) {
+    co_return utils::unexpected(std::move(loaded.error()));
+  }
+  m_player->xp += ammount;
+  m_pendingXp += ammount;
+  if (!m_flushScheduled) {
+    m_flushScheduled = true;
+    // Behind the game's own coroutines
+    async_game::Executor& executor = co_await async_game::CurrentExecutor();
+    async_lib::Spawn(executor.WithPriority(async_game::Priority::Low), FlushLater());
+  }
+  co_return m_player->xp;
+}
+
+async_game::Task<CharacterResult<int64_t>> CharacterServiceCache::LevelUp()
+{
+  co_await Acquire();
+  // The xp earned so far is reset with the level up, it has to reach the backend first
+  auto flushed = co_await Flush();
+  if (!flushed) {
+    m_busy = false;
+    co_return utils::unexpected(std::move(flushed.error()));
+  }
+  auto level = co_await m_dependencies.backend->LevelUp();
+  if (level) {
+    m_player->level = *level;
+    // Earned during the calls, still pending
+    m_player->xp = m_pendingXp;
+  } else {
+    m_stale = true;
+  }
+  m_busy = false;
+  co_return level;
+}
+
+async_game::Task<CharacterResult<>> CharacterServiceCache::Reset()
+{
+  co_await Acquire();
+  // Reset anyway
+  m_pendingXp = 0;
+  auto reset = co_await m_dependencies.backend->Reset();
+  if (reset) {
+    m_player = Player{};
+    m_player->xp = m_pendingXp;
+  } else {
+    m_stale = true;
+  }
+  m_busy = false;
+  co_return reset;
+}
+
+async_game::Task<> CharacterServiceCache::Acquire()
+{
+  while (m_busy) {
+    co_await async_game::NextFrame();
+  }
+  m_busy = true;
+}
+
+async_game::Task<CharacterResult<>> CharacterServiceCache::Load()
+{
+  if (m_player && !m_stale) {
+    co_return CharacterResult<>{};
+  }
+  co_await Acquire();
+  auto loaded = co_await Reload();
+  m_busy = false;
+  co_return loaded;
+}
+
+async_game::Task<CharacterResult<>> CharacterServiceCache::Reload()
+{
+  // Another coroutine may have loaded it while this one waited for the backend
+  if (m_player && !m_stale) {
+    co_return CharacterResult<>{};
+  }
+  auto player = co_await m_dependencies.backend->GetPlayer();
+  if (!player) {
+    Log() << "Failed to load the player: " << player.error().message;
+    co_return utils::unexpected(std::move(player.error()));
+  }
+  if (m_stale) {
+    Log() << "Reloaded the player after a failure, level " << player->level << " with " << player->xp << "xp";
+  }
+  m_player = *player;
+  // Earned while the player was loading or since the failure, not in the backend yet
+  m_player->xp += m_pendingXp;
+  m_stale = false;
+  co_return CharacterResult<>{};
+}
+
+async_game::Task<CharacterResult<>> CharacterServiceCache::Flush()
+{
+  if (auto loaded = co_await Reload(); !loaded) {
+    co_return loaded;
+  }
+  if (m_pendingXp == 0) {
+    co_return CharacterResult<>{};
+  }
+  int64_t sent = std::exchange(m_pendingXp, 0);
+  auto xp = co_await m_dependencies.backend->GiveXp(sent);
+  if (!xp) {
+    Log() << "Failed to flush " << sent << "xp: " << xp.error().message;
+    m_stale = true;
+    co_return utils::unexpected(std::move(xp.error()));
+  }
+  // The backend's xp, which other clients may have changed too, with what was earned during the call
+  m_player->xp = *xp + m_pendingXp;
+  co_return CharacterResult<>{};
+}
+
+async_game::Task<> CharacterServiceCache::FlushLater()
+{
+  co_await async_game::WaitFrames(m_options.flushInterval);
+  co_await Acquire();
+  // The xp earned from now on schedules another flush
+  m_flushScheduled = false;
+  co_await Flush();
+  m_busy = false;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "character_service.hpp"
+
+// Write-behind cache in front of any CharacterService. The player is loaded once, then reads and xp are answered from
+// memory right away: the xp is added up and sent as a single GiveXp flushInterval frames after the first grant, and
+// before each level up. Level ups and resets go to the backend at once, the calls to the backend are never concurrent.
+// A failed call may or may not have been applied, the cache then reloads the player on the next call and keeps the xp
+// earned since the failed one was sent on top of it: nothing is counted twice, but the xp of a failed flush may be
+// lost. So is the xp not flushed yet when the cache is destroyed.
+// The coroutines run on their caller's executor, all the calls have to come from coroutines updated by the same thread
+class CharacterServiceCache final : public CharacterService {
+public:
+  struct Dependencies {
+    std::unique_ptr<CharacterService> backend;
+  };
+
+  struct Options {
+    // Frames between the first xp granted and the flush
+    uint64_t flushInterval = 10;
+  };
+
+  CharacterServiceCache(Dependencies deps, Options options);
+
+  virtual async_game::Task<CharacterResult<Player>> GetPlayer() override;
+  virtual async_game::Task<CharacterResult<int64_t>> GiveXp(int64_t ammount) override;
+  virtual async_game::Task<CharacterResult<int64_t>> LevelUp() override;
+  virtual async_game::Task<CharacterResult<>> Reset() override;
+
+private:
+  // Resumes once no other coroutine calls the backend, and reserves it
+  async_game::Task<> Acquire();
+  // Loads the player if it isn't, or if it may differ from the backend's
+  async_game::Task<CharacterResult<>> Load();
+  // Both need the backend reserved
+  async_game::Task<CharacterResult<>> Reload();
+  async_game::Task<CharacterResult<>> Flush();
+  async_game::Task<> FlushLater();
+
+  Dependencies m_dependencies;
+  Options m_options;
+  // Includes the pending xp
+  std::optional<Player> m_player;
+  // Earned but not sent to the backend yet
+  int64_t m_pendingXp = 0;
+  bool m_flushScheduled = false;
+  bool m_busy = false;
+  // A call to the backend failed
+  bool m_stale = false;
+};
\ No newline at end of file
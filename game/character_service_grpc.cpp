@@ -1,4 +1,5 @@
 #include "character_service_grpc.hpp"
+#include <sstream>
 #include <async_grpc/iostream.hpp>
 #include <utils/logs.hpp>
 
@@ -6,122 +7,152 @@ static auto Log() {
   return utils::Log() << "[CharacterServiceGrpc] ";
 }
 
+static void SetIncrement(variable_service::Operation& operation, int64_t delta, int64_t initialValue) {
+  operation.mutable_increment()->set_delta(delta);
+  operation.mutable_increment()->set_initial_value(initialValue);
+}
+
+static CharacterServiceError ToError(const grpc::Status& status) {
+  std::ostringstream message;
+  message << status;
+  return CharacterServiceError{ message.str() };
+}
+
 CharacterServiceGrpc::CharacterServiceGrpc(Dependencies deps)
   : m_dependencies(std::move(deps))
   , m_client(grpc::CreateChannel("[::1]:4213", grpc::InsecureChannelCredentials()))
+  , m_session(m_client, m_dependencies.executor)
 {}
 
-async_game::Task<Player> CharacterServiceGrpc::GetPlayer()
+async_game::Task<CharacterResult<Player>> CharacterServiceGrpc::GetPlayer()
 {
-  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this]() -> async_grpc::Task<Player> {
+  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this]() -> async_grpc::Task<CharacterResult<Player>> {
     Player sent;
 
-    if (auto res = co_await Read("level")) {
-      sent.level = res->value_or(1);
-    }
-    if (auto res = co_await Read("xp")) {
-      sent.xp = res->value_or(0);
+    // Incrementing by 0 creates the values only if they don't exist, and reads both of them at once
+    variable_service::TransactRequest request;
+    SetIncrement(*AddOperation(request, "level"), 0, sent.level);
+    SetIncrement(*AddOperation(request, "xp"), 0, sent.xp);
+    auto res = co_await Transact(std::move(request));
+    if (!res) {
+      co_return utils::unexpected(ToError(res.error()));
     }
+    sent.level = res->results(0).value();
+    sent.xp = res->results(1).value();
 
     co_return sent;
   }());
 }
 
-async_game::Task<int64_t> CharacterServiceGrpc::GiveXp(int64_t ammount)
+async_game::Task<CharacterResult<int64_t>> CharacterServiceGrpc::GiveXp(int64_t ammount)
 {
-  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this, ammount]() -> async_grpc::Task<int64_t> {
-    int64_t cur_xp = (co_await Read("xp")).value_or(std::nullopt).value_or(0);
-    co_await Write("xp", cur_xp + ammount);
-    co_return cur_xp;
+  if (m_dependencies.xpAggregator) {
+    // Resumed by this coroutine's executor once the frame's batch is answered
+    auto xp = co_await m_dependencies.xpAggregator->GiveXp(m_dependencies.playerId, ammount);
+    if (!xp) {
+      co_return utils::unexpected(ToError(xp.error()));
+    }
+    co_return *xp;
+  }
+  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this, ammount]() -> async_grpc::Task<CharacterResult<int64_t>> {
+    auto xp = co_await Increment("xp", ammount, 0);
+    if (!xp) {
+      co_return utils::unexpected(ToError(xp.error()));
+    }
+    co_return *xp;
   }());
 }
 
-async_game::Task<int64_t> CharacterServiceGrpc::LevelUp()
+async_game::Task<CharacterResult<int64_t>> CharacterServiceGrpc::LevelUp()
 {
-  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this]() -> async_grpc::Task<int64_t> {
-    int64_t cur_level = (co_await Read("level")).value_or(std::nullopt).value_or(1);
-    co_await Write("level", cur_level + 1);
-    co_await Write("xp", 0);
-    co_return cur_level;
+  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this]() -> async_grpc::Task<CharacterResult<int64_t>> {
+    variable_service::TransactRequest request;
+    SetIncrement(*AddOperation(request, "level"), 1, 1);
+    AddOperation(request, "xp")->mutable_write()->set_value(0);
+    auto res = co_await Transact(std::move(request));
+    if (!res) {
+      co_return utils::unexpected(ToError(res.error()));
+    }
+    co_return res->results(0).value();
   }());
 }
 
-async_game::Task<> CharacterServiceGrpc::Reset()
+async_game::Task<CharacterResult<>> CharacterServiceGrpc::Reset()
 {
-  co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this]() -> async_grpc::Task<> {
-
-    co_await Del("level");
-    co_await Del("xp");
-
+  co_return co_await async_lib::SpawnCrossTask(m_dependencies.executor, [this]() -> async_grpc::Task<CharacterResult<>> {
+    // Whatever variables the player has
+    auto deleted = co_await DeleteAll();
+    if (!deleted) {
+      co_return utils::unexpected(ToError(deleted.error()));
+    }
+    co_return CharacterResult<>{};
   }());
 }
 
-async_grpc::Task<utils::expected<std::optional<int64_t>, grpc::Status>> CharacterServiceGrpc::Read(std::string_view name)
+async_grpc::Task<utils::expected<int64_t, grpc::Status>> CharacterServiceGrpc::Increment(std::string_view name, int64_t delta, int64_t initialValue)
 {
-  Log() << "Requesting " << name;
-  std::unique_ptr<grpc::ClientContext> context;
-  variable_service::ReadRequest request;
-  request.set_key(std::string(name));
-  variable_service::ReadResponse response;
-  auto status = grpc::Status::CANCELLED;
-  if (co_await m_client.AutoRetryUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Read), context, request, response, status))
-  {
-    if (status.ok()) {
-      Log() << "Got " << name << ", value: " << response.value();
-      co_return response.value();
-    }
-    if (status.error_code() == grpc::StatusCode::NOT_FOUND) {
-      Log() << "Value " << name << " not found";
-      co_return std::nullopt;
-    }
-    Log() << "Failed to retrieve " << name << ": " << status;
-  } else {
-    Log() << "Retrieving " << name << " cancelled";
+  Log() << "Incrementing " << name << " by " << delta;
+  variable_service::SessionRequest request;
+  auto* increment = request.mutable_increment();
+  increment->set_tenant(m_dependencies.playerId);
+  increment->set_key(std::string(name));
+  increment->set_delta(delta);
+  increment->set_initial_value(initialValue);
+  auto response = co_await m_session.Call(std::move(request));
+  if (!response) {
+    Log() << "Failed to increment " << name << ": " << response.error();
+    co_return utils::unexpected(response.error());
   }
-  co_return utils::unexpected(status);
+  Log() << "Incremented " << name << " to " << response->increment().value();
+  co_return response->increment().value();
 }
 
-async_grpc::Task<utils::expected<void, grpc::Status>> CharacterServiceGrpc::Write(std::string_view name, int64_t value)
+async_grpc::Task<utils::expected<variable_service::TransactResponse, grpc::Status>> CharacterServiceGrpc::Transact(variable_service::TransactRequest request)
 {
-  Log() << "Writing " << name << " to " << value;
-  std::unique_ptr<grpc::ClientContext> context;
-  variable_service::WriteRequest request;
-  request.set_key(std::string(name));
-  request.set_value(value);
-  variable_service::WriteResponse response;
-  auto status = grpc::Status::CANCELLED;
-  if (co_await m_client.AutoRetryUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Write), context, request, response, status))
-  {
-    if (status.ok()) {
-      Log() << "Successfuly wrote " << name;
-      co_return utils::expected<void, grpc::Status>{};
-    }
-    Log() << "Failed to write " << name << ": " << status;
+  Log() << "Transacting " << request.operations_size() << " operations";
+  int operations = request.operations_size();
+  variable_service::SessionRequest sessionRequest;
+  *sessionRequest.mutable_transact() = std::move(request);
+  auto response = co_await m_session.Call(std::move(sessionRequest));
+  if (!response) {
+    Log() << "Failed to transact: " << response.error();
+    co_return utils::unexpected(response.error());
   }
-  else {
-    Log() << "Writing " << name << " cancelled";
+  if (!response->transact().committed()) {
+    // None of our operations have an expected version, it shouldn't happen
+    Log() << "Transaction aborted on operation " << response->transact().failed_operation();
+    co_return utils::unexpected(grpc::Status(grpc::StatusCode::ABORTED, "Transaction aborted"));
   }
-  co_return utils::unexpected(status);
+  Log() << "Committed " << operations << " operations";
+  co_return std::move(*response->mutable_transact());
 }
 
-async_grpc::Task<utils::expected<void, grpc::Status>> CharacterServiceGrpc::Del(std::string_view name)
+async_grpc::Task<utils::expected<uint32_t, grpc::Status>> CharacterServiceGrpc::DeleteAll()
 {
-  Log() << "Deleting " << name;
+  Log() << "Deleting player " << m_dependencies.playerId;
   std::unique_ptr<grpc::ClientContext> context;
-  variable_service::DelRequest request;
-  request.set_key(std::string(name));
-  variable_service::DelResponse response;
+  variable_service::DeleteAllRequest request;
+  request.set_tenant(m_dependencies.playerId);
+  variable_service::DeleteAllResponse response;
   auto status = grpc::Status::CANCELLED;
-  if (co_await m_client.AutoRetryUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Del), context, request, response, status))
+  if (co_await m_client.AutoRetryUnary(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, DeleteAll), context, request, response, status))
   {
     if (status.ok()) {
-      Log() << "Successfully deleted " << name;
-      co_return utils::expected<void, grpc::Status>{};
+      Log() << "Deleted " << response.deleted() << " variables";
+      co_return response.deleted();
     }
-    Log() << "Failed to delete " << name << ": " << status;
+    Log() << "Failed to delete player " << m_dependencies.playerId << ": " << status;
   }
   else {
-    Log() << "Deleting " << name << " cancelled";
+    Log() << "Deleting player cancelled";
   }
   co_return utils::unexpected(status);
 }
+
+variable_service::Operation* CharacterServiceGrpc::AddOperation(variable_service::TransactRequest& request, std::string_view name)
+{
+  auto* operation = request.add_operations();
+  operation->set_tenant(m_dependencies.playerId);
+  operation->set_key(std::string(name));
+  return operation;
+}
\ No newline at end of file
@@ -1,25 +1,39 @@
 #include "character_service.hpp"
 #include <async_grpc/client.hpp>
+#include <string>
 #include <protos/variable_service.grpc.pb.h>
+#include "variable_session.hpp"
+#include "xp_aggregator.hpp"
 
 class CharacterServiceGrpc final : public CharacterService {
 public:
   struct Dependencies {
     async_grpc::CompletionQueueExecutor& executor;
+    // Tenant of the player's variables
+    std::string playerId;
+    // Sends the xp granted with the other players', once per frame, when set. It must outlive the service
+    XpAggregator* xpAggregator;
   };
 
   explicit CharacterServiceGrpc(Dependencies deps);
 
-  virtual async_game::Task<Player> GetPlayer() override;
-  virtual async_game::Task<int64_t> GiveXp(int64_t ammount) override;
-  virtual async_game::Task<int64_t> LevelUp() override;
-  virtual async_game::Task<> Reset() override;
+  virtual async_game::Task<CharacterResult<Player>> GetPlayer() override;
+  virtual async_game::Task<CharacterResult<int64_t>> GiveXp(int64_t ammount) override;
+  virtual async_game::Task<CharacterResult<int64_t>> LevelUp() override;
+  virtual async_game::Task<CharacterResult<>> Reset() override;
 
 private:
   Dependencies m_dependencies;
   async_grpc::Client<variable_service::VariableService> m_client;
+  // Carries the operations on single variables and the transactions, the other calls are rare
+  VariableSession m_session;
 
-  async_grpc::Task<utils::expected<std::optional<int64_t>, grpc::Status>> Read(std::string_view name);
-  async_grpc::Task<utils::expected<void, grpc::Status>> Write(std::string_view name, int64_t value);
-  async_grpc::Task<utils::expected<void, grpc::Status>> Del(std::string_view name);
+  // Returns the value after the increment
+  async_grpc::Task<utils::expected<int64_t, grpc::Status>> Increment(std::string_view name, int64_t delta, int64_t initialValue);
+  // Applies all the operations atomically, the response has one result per operation
+  async_grpc::Task<utils::expected<variable_service::TransactResponse, grpc::Status>> Transact(variable_service::TransactRequest request);
+  // Returns how many variables were deleted
+  async_grpc::Task<utils::expected<uint32_t, grpc::Status>> DeleteAll();
+  // Adds an operation on one of the player's variables
+  variable_service::Operation* AddOperation(variable_service::TransactRequest& request, std::string_view name);
 };
\ No newline at end of file
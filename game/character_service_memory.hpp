@@ -4,10 +4,10 @@
 
 class CharacterServiceMemory final : public CharacterService {
 public:
-  virtual async_game::Task<Player> GetPlayer() override;
-  virtual async_game::Task<int64_t> GiveXp(int64_t ammount) override;
-  virtual async_game::Task<int64_t> LevelUp() override;
-  virtual async_game::Task<> Reset() override;
+  virtual async_game::Task<CharacterResult<Player>> GetPlayer() override;
+  virtual async_game::Task<CharacterResult<int64_t>> GiveXp(int64_t ammount) override;
+  virtual async_game::Task<CharacterResult<int64_t>> LevelUp() override;
+  virtual async_game::Task<CharacterResult<>> Reset() override;
 
 private:
   Player m_player;
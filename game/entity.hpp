@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <string_view>
+#include "async_game.hpp"
+
+using Elapsed = std::chrono::nanoseconds;
+
+struct Entity {
+public:
+  virtual ~Entity() = default;
+
+  void PreUpdate() {
+    m_executor.Update();
+  }
+
+  // Resumes the coroutines made ready since PreUpdate, between frames
+  void Drain() {
+    m_executor.Drain();
+  }
+
+  void SetReadySignal(async_game::ReadySignal* signal) {
+    m_executor.SetReadySignal(signal);
+  }
+
+  virtual void ProcessInput([[maybe_unused]] std::string_view input) {}
+
+  virtual void Update([[maybe_unused]] Elapsed elapsed) {}
+
+  // Of the last PreUpdate
+  const async_game::Executor::FrameCounters& GetExecutorCounters() const {
+    return m_executor.GetFrameCounters();
+  }
+
+protected:
+  async_game::Executor m_executor;
+};
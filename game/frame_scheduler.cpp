@@ -0,0 +1,138 @@
+#include "frame_scheduler.hpp"
+#include <algorithm>
+#include <functional>
+
+FrameScheduler::FrameScheduler(Options options)
+  : m_options(std::move(options))
+  , m_shards(std::max<size_t>(m_options.threads, 1))
+  , m_barrier(static_cast<std::ptrdiff_t>(m_shards.size()))
+{
+  for (size_t shard = 1; shard < m_shards.size(); ++shard) {
+    m_workers.emplace_back(std::bind_front(&FrameScheduler::RunWorker, this, shard));
+  }
+}
+
+FrameScheduler::~FrameScheduler()
+{
+  if (m_shards.size() > 1) {
+    m_phase = Phase::Stop;
+    m_barrier.arrive_and_wait();
+    m_workers.clear();
+  }
+}
+
+void FrameScheduler::Add(std::unique_ptr<Entity> entity)
+{
+  if (m_options.drainCompletions) {
+    entity->SetReadySignal(&m_readySignal);
+  }
+  auto smallest = std::min_element(m_shards.begin(), m_shards.end(), [](const Shard& lhs, const Shard& rhs) {
+    return lhs.entities.size() < rhs.entities.size();
+  });
+  smallest->entities.push_back(std::move(entity));
+}
+
+size_t FrameScheduler::GetEntityCount() const
+{
+  size_t count = 0;
+  for (const auto& shard : m_shards) {
+    count += shard.entities.size();
+  }
+  return count;
+}
+
+async_game::Executor::FrameCounters FrameScheduler::GetExecutorCounters() const
+{
+  async_game::Executor::FrameCounters counters;
+  for (const auto& shard : m_shards) {
+    counters.resumed += shard.executorCounters.resumed;
+    counters.deferred += shard.executorCounters.deferred;
+    counters.starved += shard.executorCounters.starved;
+  }
+  return counters;
+}
+
+void FrameScheduler::Update(Elapsed elapsed)
+{
+  m_elapsed = elapsed;
+  Run(Phase::Frame);
+}
+
+void FrameScheduler::Idle(std::chrono::steady_clock::time_point until)
+{
+  if (!m_options.drainCompletions) {
+    std::this_thread::sleep_until(until);
+    return;
+  }
+  while (m_readySignal.WaitUntil(until)) {
+    Run(Phase::Drain);
+  }
+}
+
+void FrameScheduler::Run(Phase phase)
+{
+  m_phase = phase;
+  if (m_shards.size() > 1) {
+    m_barrier.arrive_and_wait();
+  }
+  RunPhase(0);
+}
+
+void FrameScheduler::RunWorker(size_t shard)
+{
+  while (true) {
+    m_barrier.arrive_and_wait();
+    if (m_phase == Phase::Stop) {
+      break;
+    }
+    RunPhase(shard);
+  }
+}
+
+void FrameScheduler::RunPhase(size_t shard)
+{
+  if (m_phase == Phase::Drain) {
+    RunDrain(shard);
+  } else {
+    RunFrame(shard);
+  }
+  if (m_shards.size() > 1) {
+    m_barrier.arrive_and_wait();
+  }
+}
+
+void FrameScheduler::RunFrame(size_t shard)
+{
+  auto& entities = m_shards[shard].entities;
+  auto& counters = m_shards[shard].executorCounters;
+  counters = {};
+  for (auto& entity : entities) {
+    entity->PreUpdate();
+    const auto& entityCounters = entity->GetExecutorCounters();
+    counters.resumed += entityCounters.resumed;
+    counters.deferred += entityCounters.deferred;
+    counters.starved += entityCounters.starved;
+  }
+  if (m_shards.size() > 1) {
+    // Coroutines resumed by PreUpdate may have touched entities of other shards through shared dependencies, none
+    // starts its Update before they're all done
+    m_barrier.arrive_and_wait();
+  }
+  for (auto& entity : entities) {
+    entity->Update(m_elapsed);
+  }
+}
+
+void FrameScheduler::RunDrain(size_t shard)
+{
+  // The counters of an entity are the frame's so far, they replace the shard's
+  auto& counters = m_shards[shard].executorCounters;
+  counters = {};
+  for (auto& entity : m_shards[shard].entities) {
+    entity->Drain();
+    const auto& entityCounters = entity->GetExecutorCounters();
+    counters.resumed += entityCounters.resumed;
+    counters.deferred += entityCounters.deferred;
+    counters.starved += entityCounters.starved;
+  }
+}
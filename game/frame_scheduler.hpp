@@ -0,0 +1,83 @@
+#pragma once
+
+#include <barrier>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "entity.hpp"
+
+// Updates entities on a pool of threads. Every thread owns a shard, an entity is added to the smallest one and never
+// leaves it, so its executor and coroutines always run on the same thread. A frame runs the PreUpdate of every entity,
+// waits for all the shards to be done, then runs their Update.
+// Entities on different shards run concurrently, whatever they share has to be thread safe.
+class FrameScheduler {
+public:
+  struct Options {
+    // Counts the thread calling Update, which updates the first shard itself
+    size_t threads = 1;
+    // Idle resumes the coroutines made ready between frames, by a gRPC call completing for instance, instead of
+    // sleeping until the next frame. Each shard drains its entities on its own thread
+    bool drainCompletions = false;
+  };
+
+  explicit FrameScheduler(Options options);
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+  ~FrameScheduler();
+
+  // Only between frames
+  void Add(std::unique_ptr<Entity> entity);
+
+  // Calls func with every entity, on the calling thread. Only between frames, the workers are waiting for the next one
+  template<typename TFunc>
+  void ForEach(TFunc&& func) {
+    for (auto& shard : m_shards) {
+      for (auto& entity : shard.entities) {
+        func(*entity);
+      }
+    }
+  }
+
+  size_t GetEntityCount() const;
+  size_t GetThreadCount() const { return m_shards.size(); }
+  // Summed over the entities, for the last frame and what was drained since. Only between frames
+  async_game::Executor::FrameCounters GetExecutorCounters() const;
+
+  // Returns once every entity was updated
+  void Update(Elapsed elapsed);
+  // Returns at until, to be called between frames
+  void Idle(std::chrono::steady_clock::time_point until);
+
+private:
+  enum class Phase {
+    Frame,
+    Drain,
+    Stop,
+  };
+
+  // Aligned so that threads don't share the cache line of their neighbour's vector
+  struct alignas(64) Shard {
+    std::vector<std::unique_ptr<Entity>> entities;
+    async_game::Executor::FrameCounters executorCounters;
+  };
+
+  // Runs phase on every shard, returns once they're all done
+  void Run(Phase phase);
+  void RunWorker(size_t shard);
+  void RunPhase(size_t shard);
+  void RunFrame(size_t shard);
+  void RunDrain(size_t shard);
+
+  Options m_options;
+  // Before the shards, gRPC threads may notify it until the entities are destroyed
+  async_game::ReadySignal m_readySignal;
+  std::vector<Shard> m_shards;
+  // Written between phases, the barrier publishes them to the workers
+  Phase m_phase = Phase::Frame;
+  Elapsed m_elapsed{ 0 };
+  // Crossed to start a phase and to end it, and between PreUpdate and Update
+  std::barrier<> m_barrier;
+  std::vector<std::jthread> m_workers;
+};
@@ -1,117 +1,19 @@
 #include <memory>
 #include <iostream>
 #include <string_view>
-#include <utils/logs.hpp>
 #include <thread>
 #include <mutex>
 #include <future>
 #include <condition_variable>
-#include "async_game.hpp"
+#include "character_chunk.hpp"
+#include "character_service_cache.hpp"
 #include "character_service_grpc.hpp"
 #include "character_service_memory.hpp"
+#include "frame_scheduler.hpp"
+#include "xp_aggregator.hpp"
 
 using namespace std::literals::string_view_literals;
 
-static auto Log() {
-  return utils::Log() << "[Game] ";
-}
-
-using Elapsed = std::chrono::nanoseconds;
-
-struct Entity {
-public:
-  virtual ~Entity() = default;
-
-  void PreUpdate() {
-    m_executor.Update();
-  }
-
-  virtual void ProcessInput([[maybe_unused]] std::string_view input) {}
-
-  virtual void Update([[maybe_unused]] Elapsed elapsed) {}
-
-protected:
-  async_game::Executor m_executor;
-};
-
-class Character : public Entity {
-public:
-  struct Dependencies {
-    CharacterService& characterService;
-  };
-
-  explicit Character(Dependencies dependencies)
-    : m_dependencies(std::move(dependencies))
-  {}
-
-  virtual void ProcessInput(std::string_view input) override {
-    if (m_state == State::Idle && input == "fight") {
-      Log() << "Let's fight!";
-      m_state = State::Fighting;
-      m_timeSinceXp = Elapsed(0);
-    } else if (m_state == State::Fighting && input == "rest") {
-      Log() << "Time for a break";
-      m_state = State::Idle;
-    } else if (m_state == State::Idle && input == "reincarnate") {
-      async_lib::Spawn(m_executor, Reincarnate());
-    }
-  }
-
-  virtual void Update(Elapsed elapsed) override {
-    switch (m_state) {
-    case State::Uninit: {
-      m_state = State::Initializing;
-      async_lib::Spawn(m_executor, Init());
-      break;
-    }
-    case State::Fighting: {
-      m_timeSinceXp += elapsed;
-      if (m_timeSinceXp >= std::chrono::seconds(1)) {
-        m_timeSinceXp -= std::chrono::seconds(1);
-        async_lib::Spawn(m_executor, EarnXp());
-      }
-      break;
-    }
-    default:
-      break;
-    }
-  }
-
-private:
-  async_game::Task<> Init() {
-    Player player = co_await m_dependencies.characterService.GetPlayer();
-    Log() << "You are level " << player.level << " with " << player.xp << "xp";
-    m_state = State::Idle;
-  }
-
-  async_game::Task<> EarnXp() {
-    auto log = Log() << "You earned 100xp! ";
-    int64_t newXp = co_await m_dependencies.characterService.GiveXp(100);
-    if (newXp >= 1000) {
-      int64_t newLevel = co_await m_dependencies.characterService.LevelUp();
-      log << "You leveled up! You are now level " << newLevel;
-    } else {
-      log << "You now have " << newXp << " experience points";
-    }
-  }
-
-  async_game::Task<> Reincarnate() {
-    Log() << "You forgo your previous life...";
-    co_await m_dependencies.characterService.Reset();
-    Log() << "It is done, you are now a blank slate, ready for the upcoming challenges";
-  }
-
-  Dependencies m_dependencies;
-  enum class State {
-    Uninit,
-    Initializing,
-    Idle,
-    Fighting
-  };
-  State m_state = State::Uninit;
-  Elapsed m_timeSinceXp = Elapsed(0);
-};
-
 class InputHandler {
 public:
   InputHandler()
@@ -160,16 +62,18 @@ public:
 
   struct Dependencies {
     std::unique_ptr<CharacterService> characterService;
+    // Sent to at the end of every frame when set
+    XpAggregator* xpAggregator;
   };
 
-  explicit Game(Dependencies&& dependencies)
+  Game(Dependencies&& dependencies, FrameScheduler::Options schedulerOptions)
     : m_dependencies(std::move(dependencies))
+    , m_scheduler(std::move(schedulerOptions))
     , m_lastTick(clock::now())
   {
-    m_entities.push_back(std::make_unique<Character>(Character::Dependencies{
-      .characterService = *m_dependencies.characterService
-      }
-    ));
+    auto characters = std::make_unique<CharacterChunk>(CharacterChunk::Options{});
+    characters->Add(*m_dependencies.characterService);
+    m_scheduler.Add(std::move(characters));
     m_pendingInput = m_inputHandler.GetString();
   }
 
@@ -182,29 +86,28 @@ public:
         m_done = true;
         return;
       }
-      for (auto& entityPtr : m_entities) {
-        entityPtr->ProcessInput(input);
-      }
+      m_scheduler.ForEach([&](Entity& entity) {
+        entity.ProcessInput(input);
+      });
       m_pendingInput = m_inputHandler.GetString();
     }
-    for (auto& entityPtr : m_entities) {
-      entityPtr->PreUpdate();
-    }
     auto now = clock::now();
     auto elapsed = now - m_lastTick;
-    for (auto& entityPtr : m_entities) {
-      entityPtr->Update(now - m_lastTick);
+    m_scheduler.Update(elapsed);
+    if (m_dependencies.xpAggregator) {
+      m_dependencies.xpAggregator->Send();
     }
     m_lastTick = now;
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(100) - elapsed);
+    m_scheduler.Idle(clock::now() + std::chrono::milliseconds(100) - elapsed);
   }
 
 private:
   Dependencies m_dependencies;
   InputHandler m_inputHandler;
   std::future<std::string> m_pendingInput;
-  std::vector<std::unique_ptr<Entity>> m_entities;
+  // A single thread, for a single character, and the character service entities would share isn't thread safe
+  FrameScheduler m_scheduler;
   bool m_done = false;
   clock::time_point m_lastTick;
 };
@@ -212,32 +115,65 @@ private:
 struct EnvDependencies
 {
   std::unique_ptr<async_grpc::ClientExecutorThreads> grpcExecutor;
+  std::unique_ptr<XpAggregator> xpAggregator;
 };
 
-std::unique_ptr<CharacterService> MakeCharacterService(std::string_view type, const EnvDependencies& dependencies) {
+std::unique_ptr<CharacterService> MakeCharacterService(std::string_view type, std::string_view playerId, const EnvDependencies& dependencies) {
   if (type == "memory") {
     return std::make_unique<CharacterServiceMemory>();
   }
   else if (type == "grpc") {
     assert(dependencies.grpcExecutor);
-    return std::make_unique<CharacterServiceGrpc>(CharacterServiceGrpc::Dependencies{ .executor = dependencies.grpcExecutor->GetExecutor() });
+    return std::make_unique<CharacterServiceGrpc>(CharacterServiceGrpc::Dependencies{ .executor = dependencies.grpcExecutor->GetExecutor(), .playerId = std::string(playerId), .xpAggregator = dependencies.xpAggregator.get() });
   }
   return nullptr;
 }
 
 int main(int ac, char** av) {
-  if (ac != 2 || (av[1] != "memory"sv && av[1] != "grpc"sv)) {
-    std::cout << "Usage: " << av[0] << " memory|grpc" << std::endl;
+  // Resumes the character as soon as its calls complete rather than on the next frame
+  bool drainCompletions = false;
+  // Answers from memory and sends the xp in batches, what isn't sent yet is lost on quit
+  bool cache = false;
+  // Sends the xp of all the characters as one transaction per frame
+  bool batchXp = false;
+  for (; ac > 1 && std::string_view(av[ac - 1]).starts_with("--"); --ac) {
+    if (av[ac - 1] == "--drain"sv) {
+      drainCompletions = true;
+    } else if (av[ac - 1] == "--cache"sv) {
+      cache = true;
+    } else if (av[ac - 1] == "--batch-xp"sv) {
+      batchXp = true;
+    } else {
+      ac = 0;
+      break;
+    }
+  }
+  if (ac < 2 || ac > 3 || (av[1] != "memory"sv && av[1] != "grpc"sv)) {
+    std::cout << "Usage: " << av[0] << " memory|grpc [player id = player] [--drain] [--cache] [--batch-xp]" << std::endl;
     return 1;
   }
+  std::string_view playerId = ac > 2 ? av[2] : "player";
 
   EnvDependencies deps;
   if (av[1] == "grpc"sv) {
     deps.grpcExecutor = std::make_unique<async_grpc::ClientExecutorThreads>(async_grpc::ClientExecutorThreads(2));
+    if (batchXp) {
+      deps.xpAggregator = std::make_unique<XpAggregator>(XpAggregator::Dependencies{ .executor = deps.grpcExecutor->GetExecutor() });
+    }
+  }
+
+  auto characterService = MakeCharacterService(av[1], playerId, deps);
+  if (cache) {
+    // About a second of xp at 10 frames per second
+    characterService = std::make_unique<CharacterServiceCache>(CharacterServiceCache::Dependencies{ .backend = std::move(characterService) }, CharacterServiceCache::Options{ .flushInterval = 10 });
   }
 
   auto game = Game({
-    .characterService = MakeCharacterService(av[1], deps)
+    .characterService = std::move(characterService),
+    .xpAggregator = deps.xpAggregator.get()
+    }, {
+    .threads = 1,
+    .drainCompletions = drainCompletions
     }
   );
 
@@ -0,0 +1,166 @@
+#include "variable_session.hpp"
+#include <vector>
+#include <async_grpc/iostream.hpp>
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[VariableSession] ";
+}
+
+VariableSession::VariableSession(async_grpc::Client<variable_service::VariableService>& client, async_grpc::CompletionQueueExecutor& executor)
+  : m_client(client)
+{
+  async_lib::Spawn(executor, Run());
+}
+
+VariableSession::~VariableSession()
+{
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_stopping = true;
+    if (m_context) {
+      m_context->TryCancel();
+    }
+  }
+  m_wake.Set();
+  m_stopped.get_future().wait();
+}
+
+async_grpc::Task<utils::expected<variable_service::SessionResponse, grpc::Status>> VariableSession::Call(variable_service::SessionRequest request)
+{
+  Pending pending;
+  {
+    auto lock = std::unique_lock(m_mutex);
+    if (m_stopping) {
+      co_return utils::unexpected(grpc::Status::CANCELLED);
+    }
+    uint64_t tag = ++m_nextTag;
+    request.set_tag(tag);
+    m_pending.emplace(tag, &pending);
+    m_outbox.push_back(std::move(request));
+  }
+  m_wake.Set();
+  co_await pending.done.Wait();
+  if (!pending.status.ok()) {
+    co_return utils::unexpected(std::move(pending.status));
+  }
+  if (pending.response.code() != grpc::StatusCode::OK) {
+    co_return utils::unexpected(grpc::Status(static_cast<grpc::StatusCode>(pending.response.code()), pending.response.message()));
+  }
+  co_return std::move(pending.response);
+}
+
+async_grpc::Task<> VariableSession::Run()
+{
+  while (true) {
+    {
+      auto lock = std::unique_lock(m_mutex);
+      if (m_stopping) {
+        break;
+      }
+      if (m_outbox.empty()) {
+        lock.unlock();
+        // Only opened once there's something to send
+        co_await m_wake.Wait();
+        continue;
+      }
+    }
+    co_await Stream();
+  }
+  Fail(grpc::Status::CANCELLED);
+  m_stopped.set_value();
+}
+
+async_grpc::Task<> VariableSession::Stream()
+{
+  grpc::ClientContext context;
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_context = &context;
+    m_readerDone = false;
+  }
+  auto call = co_await m_client.CallBidirectionalStream(ASYNC_GRPC_CLIENT_PREPARE_FUNC(variable_service::VariableService, Session), context);
+  if (!call) {
+    auto lock = std::unique_lock(m_mutex);
+    m_context = nullptr;
+    lock.unlock();
+    Fail(grpc::Status(grpc::StatusCode::UNAVAILABLE, "Failed to open the session"));
+    co_return;
+  }
+
+  // Dispatches the responses to the coroutines waiting for them
+  auto readResponses = [&]() -> async_grpc::Task<> {
+    variable_service::SessionResponse response;
+    while (co_await call->Read(response)) {
+      auto lock = std::unique_lock(m_mutex);
+      auto found = m_pending.find(response.tag());
+      if (found == m_pending.end()) {
+        continue;
+      }
+      Pending* pending = found->second;
+      m_pending.erase(found);
+      lock.unlock();
+      pending->response = std::move(response);
+      pending->done.Set();
+    }
+    auto lock = std::unique_lock(m_mutex);
+    m_readerDone = true;
+    lock.unlock();
+    m_wake.Set();
+  };
+  auto reader = co_await async_lib::StartSubroutine(readResponses());
+
+  std::vector<variable_service::SessionRequest> sending;
+  bool ok = true;
+  while (ok) {
+    {
+      auto lock = std::unique_lock(m_mutex);
+      if (m_readerDone || m_stopping) {
+        break;
+      }
+      sending.assign(std::make_move_iterator(m_outbox.begin()), std::make_move_iterator(m_outbox.end()));
+      m_outbox.clear();
+    }
+    if (sending.empty()) {
+      co_await m_wake.Wait();
+      continue;
+    }
+    // Everything queued goes out together, only the last write flushes
+    for (size_t i = 0; ok && i < sending.size(); ++i) {
+      auto options = grpc::WriteOptions();
+      if (i + 1 < sending.size()) {
+        options.set_buffer_hint();
+      }
+      ok = co_await call->Write(sending[i], options);
+    }
+    sending.clear();
+  }
+
+  // Ends the reader, whose responses wouldn't come anymore
+  context.TryCancel();
+  co_await std::move(reader);
+  grpc::Status status;
+  co_await call->Finish(status);
+  if (status.ok() || status.error_code() == grpc::StatusCode::CANCELLED) {
+    status = grpc::Status(grpc::StatusCode::UNAVAILABLE, "The session ended");
+  }
+  Log() << "Session ended [" << status << ']';
+  {
+    auto lock = std::unique_lock(m_mutex);
+    m_context = nullptr;
+  }
+  Fail(status);
+}
+
+void VariableSession::Fail(const grpc::Status& status)
+{
+  auto lock = std::unique_lock(m_mutex);
+  auto pending = std::exchange(m_pending, {});
+  // Never sent, they'd be answered on a stream that doesn't know their tags
+  m_outbox.clear();
+  lock.unlock();
+  for (auto& [tag, call] : pending) {
+    call->status = status;
+    call->done.Set();
+  }
+}
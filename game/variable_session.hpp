@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <async_grpc/client.hpp>
+#include <utils/expected.hpp>
+#include <protos/variable_service.grpc.pb.h>
+
+// Client side of the VariableService Session call: operations from any number of coroutines are sent over a single
+// stream without waiting for each other, and each coroutine resumes once the response with its tag arrives.
+// The stream is opened on the first call and reopened on the next one once it breaks, the calls in flight at that time
+// fail with the stream's status
+class VariableSession {
+public:
+  // The stream runs on executor, which must outlive the session
+  VariableSession(async_grpc::Client<variable_service::VariableService>& client, async_grpc::CompletionQueueExecutor& executor);
+  VariableSession(const VariableSession&) = delete;
+  VariableSession& operator=(const VariableSession&) = delete;
+  // Fails the calls in flight
+  ~VariableSession();
+
+  // The tag is set by the session. A failed operation is an error like the unary call's
+  async_grpc::Task<utils::expected<variable_service::SessionResponse, grpc::Status>> Call(variable_service::SessionRequest request);
+
+private:
+  struct Pending {
+    async_grpc::Event done;
+    variable_service::SessionResponse response;
+    grpc::Status status;
+  };
+
+  async_grpc::Task<> Run();
+  // Returns once the stream breaks
+  async_grpc::Task<> Stream();
+  // Fails the calls waiting for a response
+  void Fail(const grpc::Status& status);
+
+  async_grpc::Client<variable_service::VariableService>& m_client;
+
+  std::mutex m_mutex;
+  uint64_t m_nextTag = 0;
+  std::deque<variable_service::SessionRequest> m_outbox;
+  std::unordered_map<uint64_t, Pending*> m_pending;
+  bool m_readerDone = false;
+  bool m_stopping = false;
+  grpc::ClientContext* m_context = nullptr;
+  // Set when there's something to send or the stream broke
+  async_grpc::Event m_wake;
+  std::promise<void> m_stopped;
+};
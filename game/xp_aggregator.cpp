@@ -0,0 +1,84 @@
+#include "xp_aggregator.hpp"
+#include <unordered_map>
+#include <async_grpc/iostream.hpp>
+#include <utils/logs.hpp>
+
+static auto Log() {
+  return utils::Log() << "[XpAggregator] ";
+}
+
+XpAggregator::XpAggregator(Dependencies deps)
+  : m_dependencies(std::move(deps))
+  , m_client(grpc::CreateChannel("[::1]:4213", grpc::InsecureChannelCredentials()))
+  , m_session(m_client, m_dependencies.executor)
+{}
+
+void XpAggregator::Send()
+{
+  std::vector<Grant*> grants;
+  {
+    auto lock = std::unique_lock(m_mutex);
+    if (m_pending.empty()) {
+      return;
+    }
+    grants.swap(m_pending);
+  }
+  async_lib::Spawn(m_dependencies.executor, SendBatch(std::move(grants)));
+}
+
+void XpAggregator::Queue(Grant& grant)
+{
+  auto lock = std::unique_lock(m_mutex);
+  m_pending.push_back(&grant);
+}
+
+async_grpc::Task<> XpAggregator::SendBatch(std::vector<Grant*> grants)
+{
+  // One increment per player, operation of each grant
+  variable_service::SessionRequest request;
+  auto* transact = request.mutable_transact();
+  std::unordered_map<std::string_view, int> operations;
+  std::vector<int> grantOperations;
+  grantOperations.reserve(grants.size());
+  for (Grant* grant : grants) {
+    auto [found, inserted] = operations.try_emplace(grant->m_playerId, transact->operations_size());
+    if (inserted) {
+      auto* operation = transact->add_operations();
+      operation->set_tenant(std::string(grant->m_playerId));
+      operation->set_key("xp");
+      operation->mutable_increment();
+    }
+    auto* increment = transact->mutable_operations(found->second)->mutable_increment();
+    increment->set_delta(increment->delta() + grant->m_ammount);
+    grantOperations.push_back(found->second);
+  }
+
+  auto response = co_await m_session.Call(std::move(request));
+  if (response && !response->transact().committed()) {
+    // None of the operations have an expected version, it shouldn't happen
+    response = utils::unexpected(grpc::Status(grpc::StatusCode::ABORTED, "Transaction aborted"));
+  }
+  if (!response) {
+    Log() << "Failed to send " << grants.size() << " grants: " << response.error();
+    for (Grant* grant : grants) {
+      grant->m_result = utils::unexpected(response.error());
+    }
+  } else {
+    // The xp of a player right after each of its grants, from the last one back
+    std::vector<int64_t> values;
+    values.reserve(response->transact().results_size());
+    for (const auto& result : response->transact().results()) {
+      values.push_back(result.value());
+    }
+    for (size_t i = grants.size(); i-- > 0;) {
+      int64_t& value = values[grantOperations[i]];
+      grants[i]->m_result = value;
+      value -= grants[i]->m_ammount;
+    }
+  }
+  for (Grant* grant : grants) {
+    // The grant lives in the coroutine, which may be resumed as soon as it's spawned
+    async_game::Job job = grant->m_job;
+    job.promise->executor->Spawn(job);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <async_grpc/client.hpp>
+#include <utils/expected.hpp>
+#include <protos/variable_service.grpc.pb.h>
+#include "async_game.hpp"
+#include "variable_session.hpp"
+
+// Gathers the xp granted to all the players during a frame, from any thread, and sends them as a single transaction
+// of increments over a long lived session once the frame is over: one message and one log flush per frame rather than
+// per grant. The grants to a player are added up into a single increment. Each granting coroutine is then resumed by
+// its own executor with the player's xp right after its grant, or the status the batch failed with.
+class XpAggregator {
+public:
+  struct Dependencies {
+    // Runs the session and the batches, it must outlive the aggregator
+    async_grpc::CompletionQueueExecutor& executor;
+  };
+
+  class Grant {
+  public:
+    bool await_ready() const { return false; }
+
+    template<std::derived_from<async_lib::PromiseBase<async_game::Executor>> TPromise>
+    void await_suspend(std::coroutine_handle<TPromise> handle) {
+      m_job = async_game::Job(handle);
+      m_aggregator.Queue(*this);
+    }
+
+    utils::expected<int64_t, grpc::Status> await_resume() { return std::move(*m_result); }
+
+  private:
+    friend class XpAggregator;
+
+    Grant(XpAggregator& aggregator, std::string_view playerId, int64_t ammount)
+      : m_aggregator(aggregator)
+      , m_playerId(playerId)
+      , m_ammount(ammount)
+    {}
+
+    XpAggregator& m_aggregator;
+    std::string_view m_playerId;
+    int64_t m_ammount;
+    async_game::Job m_job;
+    std::optional<utils::expected<int64_t, grpc::Status>> m_result;
+  };
+
+  explicit XpAggregator(Dependencies deps);
+  XpAggregator(const XpAggregator&) = delete;
+  XpAggregator& operator=(const XpAggregator&) = delete;
+
+  // Adds ammount to the player's xp, starting from 0, with the next batch. playerId must outlive the grant
+  Grant GiveXp(std::string_view playerId, int64_t ammount) { return Grant(*this, playerId, ammount); }
+
+  // Sends what was granted since the last call, once per frame, between frames
+  void Send();
+
+private:
+  void Queue(Grant& grant);
+  async_grpc::Task<> SendBatch(std::vector<Grant*> grants);
+
+  Dependencies m_dependencies;
+  async_grpc::Client<variable_service::VariableService> m_client;
+  VariableSession m_session;
+
+  std::mutex m_mutex;
+  std::vector<Grant*> m_pending;
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "histogram.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace utils {
+
+  size_t Histogram::BucketIndex(uint64_t value)
+  {
+    if (value < SubBucketCount) {
+      return static_cast<size_t>(value);
+    }
+    // Group e covers [2^(e + SubBucketBits - 1), 2^(e + SubBucketBits)) with buckets 2^(e - 1) wide
+    size_t group = std::bit_width(value) - SubBucketBits;
+    return group * SubBucketCount + static_cast<size_t>(value >> (group - 1)) - SubBucketCount;
+  }
+
+  uint64_t Histogram::BucketLowerBound(size_t index)
+  {
+    size_t group = index / SubBucketCount;
+    uint64_t sub = index % SubBucketCount;
+    if (group == 0) {
+      return sub;
+    }
+    return (sub + SubBucketCount) << (group - 1);
+  }
+
+  uint64_t Histogram::BucketUpperBound(size_t index)
+  {
+    size_t group = index / SubBucketCount;
+    if (group == 0) {
+      return BucketLowerBound(index);
+    }
+    return BucketLowerBound(index) + ((uint64_t(1) << (group - 1)) - 1);
+  }
+
+  void Histogram::Record(uint64_t value, uint64_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    m_buckets[BucketIndex(value)] += count;
+    m_count += count;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+    m_sum += static_cast<long double>(value) * count;
+  }
+
+  void Histogram::RecordBucket(size_t index, uint64_t count)
+  {
+    if (count == 0) {
+      return;
+    }
+    m_buckets[index] += count;
+    m_count += count;
+    m_min = std::min(m_min, BucketLowerBound(index));
+    m_max = std::max(m_max, BucketUpperBound(index));
+    // Approximate with the middle of the bucket, we don't know better
+    m_sum += (static_cast<long double>(BucketLowerBound(index)) + BucketUpperBound(index)) / 2 * count;
+  }
+
+  void Histogram::Merge(const Histogram& other)
+  {
+    for (size_t i = 0; i < BucketCount; ++i) {
+      m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+  }
+
+  void Histogram::Reset()
+  {
+    *this = Histogram{};
+  }
+
+  double Histogram::Mean() const
+  {
+    return m_count ? static_cast<double>(m_sum / m_count) : 0.0;
+  }
+
+  uint64_t Histogram::Percentile(double percentile) const
+  {
+    if (m_count == 0) {
+      return 0;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * m_count));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BucketCount; ++i) {
+      seen += m_buckets[i];
+      if (seen >= rank) {
+        return std::min(BucketUpperBound(i), m_max);
+      }
+    }
+    return m_max;
+  }
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Log-linear histogram, in the spirit of HdrHistogram: every power of two range is split in SubBucketCount linear buckets,
+// giving a relative precision of 1/SubBucketCount on any recorded value.
+
+namespace utils {
+
+  class Histogram {
+  public:
+    static constexpr size_t SubBucketBits = 5;
+    static constexpr size_t SubBucketCount = size_t(1) << SubBucketBits;
+    static constexpr size_t BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+    static size_t BucketIndex(uint64_t value);
+    // Smallest value that lands in the bucket
+    static uint64_t BucketLowerBound(size_t index);
+    // Biggest value that lands in the bucket
+    static uint64_t BucketUpperBound(size_t index);
+
+    void Record(uint64_t value, uint64_t count = 1);
+    void RecordBucket(size_t index, uint64_t count);
+    void Merge(const Histogram& other);
+    void Reset();
+
+    uint64_t Count() const { return m_count; }
+    uint64_t Min() const { return m_count ? m_min : 0; }
+    uint64_t Max() const { return m_max; }
+    double Mean() const;
+    // percentile in [0, 100], returns the upper bound of the bucket containing it
+    uint64_t Percentile(double percentile) const;
+
+    uint64_t BucketCountAt(size_t index) const { return m_buckets[index]; }
+
+  private:
+    std::array<uint64_t, BucketCount> m_buckets{};
+    uint64_t m_count = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+    long double m_sum = 0;
+  };
+
+}
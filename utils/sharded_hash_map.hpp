@@ -0,0 +1,526 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Concurrent string keyed hash map. Keys are hashed once, the hash picks a shard and a slot within the shard's open
+// addressing table (linear probing, backward shift deletion so there are no tombstones).
+// Each shard has its own reader/writer lock, so writers only serialize with operations landing on the same shard.
+// The full hash is stored next to each slot, key comparisons only happen on a hash match.
+// A THash giving several keys the same high half on purpose groups them: the high half picks the shard, they share one
+// and the group is visited or modified as a whole under its lock (ForEachInGroup, ModifyGroup). The low half picks the
+// slot, a group spreads over its shard like any other keys. Such a THash declares is_grouping (like is_transparent),
+// the shards then chain the slots of each group so that visiting one costs its size, not the shard's.
+
+namespace utils {
+
+  template<typename TValue, typename THash = std::hash<std::string_view>>
+  class ShardedHashMap {
+  public:
+    static constexpr size_t DefaultShardCount = 256;
+    static constexpr bool Grouping = requires { typename THash::is_grouping; };
+
+    // shardCount is rounded up to a power of two
+    explicit ShardedHashMap(size_t shardCount = DefaultShardCount)
+      : m_shardMask(std::bit_ceil(std::max<size_t>(shardCount, 1)) - 1)
+      , m_shards(std::make_unique<Shard[]>(m_shardMask + 1))
+    {}
+
+    ShardedHashMap(const ShardedHashMap&) = delete;
+    ShardedHashMap& operator=(const ShardedHashMap&) = delete;
+
+    // Sizes the shards for count keys spread evenly, avoids rehashing while filling up
+    void Reserve(size_t count) {
+      size_t perShard = count / (m_shardMask + 1) + 1;
+      for (size_t i = 0; i <= m_shardMask; ++i) {
+        auto lock = std::unique_lock(m_shards[i].mutex);
+        m_shards[i].Reserve(perShard);
+      }
+    }
+
+    // Returns true if the key was inserted, false if it was assigned
+    bool InsertOrAssign(std::string_view key, TValue value) {
+      uint64_t hash = HashKey(key);
+      Shard& shard = ShardFor(hash);
+      auto lock = std::unique_lock(shard.mutex);
+      size_t slot = shard.FindSlot(key, hash);
+      if (slot != NotFound) {
+        shard.entries[slot].value = std::move(value);
+        return false;
+      }
+      shard.Insert(key, hash, std::move(value));
+      return true;
+    }
+
+    std::optional<TValue> Find(std::string_view key) const {
+      uint64_t hash = HashKey(key);
+      const Shard& shard = ShardFor(hash);
+      auto lock = std::shared_lock(shard.mutex);
+      size_t slot = shard.FindSlot(key, hash);
+      if (slot == NotFound) {
+        return std::nullopt;
+      }
+      return shard.entries[slot].value;
+    }
+
+    // Calls func(const TValue& value) in place under the shard's shared lock if key is present, without copying the
+    // value out. Returns whether it was
+    template<typename TFunc>
+    bool Visit(std::string_view key, TFunc&& func) const {
+      uint64_t hash = HashKey(key);
+      const Shard& shard = ShardFor(hash);
+      auto lock = std::shared_lock(shard.mutex);
+      size_t slot = shard.FindSlot(key, hash);
+      if (slot == NotFound) {
+        return false;
+      }
+      std::forward<TFunc>(func)(std::as_const(shard.entries[slot].value));
+      return true;
+    }
+
+    bool Erase(std::string_view key) {
+      uint64_t hash = HashKey(key);
+      Shard& shard = ShardFor(hash);
+      auto lock = std::unique_lock(shard.mutex);
+      size_t slot = shard.FindSlot(key, hash);
+      if (slot == NotFound) {
+        return false;
+      }
+      shard.EraseSlot(slot);
+      return true;
+    }
+
+    // Atomic read-modify-write: runs func(std::optional<TValue>& value) under the shard's exclusive lock, value holding the
+    // current value if any. Whatever value holds once func returns is stored, resetting it erases the key.
+    // Returns what func returns
+    template<typename TFunc>
+    auto Modify(std::string_view key, TFunc&& func) {
+      uint64_t hash = HashKey(key);
+      Shard& shard = ShardFor(hash);
+      auto lock = std::unique_lock(shard.mutex);
+      return shard.Modify(key, hash, std::forward<TFunc>(func));
+    }
+
+    // Same as Modify over several keys at once, func gets a std::span<std::optional<TValue>> matching keys.
+    // The shards of all keys are locked for the whole call, in shard order so that concurrent calls can't deadlock.
+    // Keys must be unique
+    template<typename TFunc>
+    auto ModifyMany(std::span<const std::string_view> keys, TFunc&& func) {
+      std::vector<uint64_t> hashes;
+      std::vector<size_t> shardIndexes;
+      hashes.reserve(keys.size());
+      shardIndexes.reserve(keys.size());
+      for (std::string_view key : keys) {
+        hashes.push_back(HashKey(key));
+        shardIndexes.push_back(ShardIndex(hashes.back()));
+      }
+      std::sort(shardIndexes.begin(), shardIndexes.end());
+      shardIndexes.erase(std::unique(shardIndexes.begin(), shardIndexes.end()), shardIndexes.end());
+      std::vector<std::unique_lock<std::shared_mutex>> locks;
+      locks.reserve(shardIndexes.size());
+      for (size_t index : shardIndexes) {
+        locks.emplace_back(m_shards[index].mutex);
+      }
+
+      std::vector<std::optional<TValue>> values(keys.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        const Shard& shard = ShardFor(hashes[i]);
+        size_t slot = shard.FindSlot(keys[i], hashes[i]);
+        if (slot != NotFound) {
+          values[i] = shard.entries[slot].value;
+        }
+      }
+      auto result = std::forward<TFunc>(func)(std::span<std::optional<TValue>>(values));
+      for (size_t i = 0; i < keys.size(); ++i) {
+        // Slots may have moved while storing the previous keys
+        Shard& shard = ShardFor(hashes[i]);
+        shard.Store(keys[i], hashes[i], shard.FindSlot(keys[i], hashes[i]), std::move(values[i]));
+      }
+      return result;
+    }
+
+    // Calls func(std::string_view key, const TValue& value) on every entry, one shard after the other under its shared lock.
+    // Not a snapshot, entries changed meanwhile in shards not visited yet may or may not be seen
+    template<typename TFunc>
+    void ForEach(TFunc&& func) const {
+      for (size_t i = 0; i <= m_shardMask; ++i) {
+        ForEachInShard(i, func);
+      }
+    }
+
+    // Same as ForEach on a single shard, whose entries are then seen as of a single point in time
+    template<typename TFunc>
+    void ForEachInShard(size_t index, TFunc&& func) const {
+      const Shard& shard = m_shards[index];
+      auto lock = std::shared_lock(shard.mutex);
+      for (size_t slot = 0; slot < shard.hashes.size(); ++slot) {
+        if (shard.hashes[slot]) {
+          func(std::string_view(shard.entries[slot].key), shard.entries[slot].value);
+        }
+      }
+    }
+
+    size_t ShardCount() const { return m_shardMask + 1; }
+
+    // Calls func(std::string_view key, const TValue& value) on the entries in the same group as key, key itself included
+    // if present, under the shard's shared lock. Follows the group's chain, in no particular order
+    template<typename TFunc>
+    void ForEachInGroup(std::string_view key, TFunc&& func) const {
+      static_assert(Grouping, "THash must declare is_grouping");
+      uint64_t hash = HashKey(key);
+      const Shard& shard = ShardFor(hash);
+      auto lock = std::shared_lock(shard.mutex);
+      shard.ForEachInGroup(hash, func);
+    }
+
+    // Position in the map when going through it a piece at a time, see ModifySlots
+    struct Cursor {
+      size_t shard = 0;
+      size_t slot = 0;
+
+      bool operator==(const Cursor&) const = default;
+    };
+
+    // Where a walk through the map ends
+    Cursor End() const { return Cursor{ m_shardMask + 1, 0 }; }
+
+    // Runs func(std::string_view key, std::optional<TValue>& value) on the entries of up to count slots from cursor, each
+    // shard under its exclusive lock only while its slots are visited. Resetting value erases the entry.
+    // Returns the cursor to continue from, End() once every shard was visited. Slots move when the shards grow or
+    // entries are erased, an entry changed in between two calls may be missed or visited twice
+    template<typename TFunc>
+    Cursor ModifySlots(Cursor cursor, size_t count, TFunc&& func) {
+      while (count && cursor.shard <= m_shardMask) {
+        Shard& shard = m_shards[cursor.shard];
+        auto lock = std::unique_lock(shard.mutex);
+        for (; count && cursor.slot < shard.hashes.size(); --count) {
+          if (!shard.hashes[cursor.slot]) {
+            ++cursor.slot;
+            continue;
+          }
+          Entry& entry = shard.entries[cursor.slot];
+          std::optional<TValue> value = std::move(entry.value);
+          func(std::string_view(entry.key), value);
+          if (value) {
+            entry.value = std::move(*value);
+            ++cursor.slot;
+          } else {
+            // The next entry of the cluster may be shifted back into the slot, it's visited next
+            shard.EraseSlot(cursor.slot);
+          }
+        }
+        if (cursor.slot >= shard.hashes.size()) {
+          cursor = Cursor{ cursor.shard + 1, 0 };
+        }
+      }
+      return cursor;
+    }
+
+    // Calls func(std::string_view key, const TValue& value) on up to count entries starting from a slot picked out of
+    // random, under the shard's shared lock, moving on to the next shards until count entries were seen or every shard
+    // was. For sampling the map, like picking eviction candidates
+    template<typename TFunc>
+    void Sample(uint64_t random, size_t count, TFunc&& func) const {
+      for (size_t i = 0; count && i <= m_shardMask; ++i) {
+        const Shard& shard = m_shards[(random + i) & m_shardMask];
+        auto lock = std::shared_lock(shard.mutex);
+        if (!shard.size) {
+          continue;
+        }
+        size_t mask = shard.hashes.size() - 1;
+        size_t start = (random >> 32) & mask;
+        for (size_t slot = 0; count && slot <= mask; ++slot) {
+          size_t index = (start + slot) & mask;
+          if (shard.hashes[index]) {
+            func(std::string_view(shard.entries[index].key), shard.entries[index].value);
+            --count;
+          }
+        }
+      }
+    }
+
+  private:
+    struct Shard;
+
+  public:
+    // Entries in the same group as a given key, all in the same locked shard
+    class Group {
+    public:
+      // func(std::string_view key, const TValue& value), entries must not be modified meanwhile
+      template<typename TFunc>
+      void ForEach(TFunc&& func) const {
+        m_shard.ForEachInGroup(m_hash, func);
+      }
+
+      std::optional<TValue> Find(std::string_view key) const {
+        size_t slot = m_shard.FindSlot(key, HashKey(key));
+        if (slot == NotFound) {
+          return std::nullopt;
+        }
+        return m_shard.entries[slot].value;
+      }
+
+      // Same as ShardedHashMap::Modify, key must be in the group
+      template<typename TFunc>
+      auto Modify(std::string_view key, TFunc&& func) {
+        uint64_t hash = HashKey(key);
+        assert(SameGroup(hash, m_hash));
+        return m_shard.Modify(key, hash, std::forward<TFunc>(func));
+      }
+
+    private:
+      friend class ShardedHashMap;
+
+      Group(Shard& shard, uint64_t hash)
+        : m_shard(shard)
+        , m_hash(hash)
+      {}
+
+      Shard& m_shard;
+      uint64_t m_hash;
+    };
+
+    // Calls func(Group& entries) under the exclusive lock of key's shard, so that the entries in the same group as key
+    // are read and changed atomically. Returns what func returns
+    template<typename TFunc>
+    auto ModifyGroup(std::string_view key, TFunc&& func) {
+      static_assert(Grouping, "THash must declare is_grouping");
+      uint64_t hash = HashKey(key);
+      Shard& shard = ShardFor(hash);
+      auto lock = std::unique_lock(shard.mutex);
+      Group entries(shard, hash);
+      return std::forward<TFunc>(func)(entries);
+    }
+
+    // Not a snapshot, shards are counted one after the other
+    size_t Size() const {
+      size_t size = 0;
+      for (size_t i = 0; i <= m_shardMask; ++i) {
+        auto lock = std::shared_lock(m_shards[i].mutex);
+        size += m_shards[i].size;
+      }
+      return size;
+    }
+
+  private:
+    static constexpr size_t NotFound = ~size_t(0);
+    static constexpr size_t MinCapacity = 16;
+
+    struct Entry {
+      std::string key;
+      TValue value{};
+    };
+
+    // Neighbours of a slot in its group's chain, NotFound at the ends
+    struct Links {
+      size_t prev = NotFound;
+      size_t next = NotFound;
+    };
+
+    // Aligned so that two shards' locks never share a cache line
+    struct alignas(64) Shard {
+      mutable std::shared_mutex mutex;
+      // 0 marks an empty slot, keys never hash to 0, see HashKey
+      std::vector<uint64_t> hashes;
+      std::vector<Entry> entries;
+      size_t size = 0;
+      // Only with a grouping THash: the chain links of each slot and the first slot of each group, by high half
+      std::vector<Links> links;
+      std::unordered_map<uint32_t, size_t> groupHeads;
+
+      size_t FindSlot(std::string_view key, uint64_t hash) const {
+        if (hashes.empty()) {
+          return NotFound;
+        }
+        size_t mask = hashes.size() - 1;
+        for (size_t i = hash & mask; hashes[i]; i = (i + 1) & mask) {
+          if (hashes[i] == hash && entries[i].key == key) {
+            return i;
+          }
+        }
+        return NotFound;
+      }
+
+      void Insert(std::string_view key, uint64_t hash, TValue value) {
+        // Keep the load factor under 3/4
+        if ((size + 1) * 4 > hashes.size() * 3) {
+          Reserve(size + 1);
+        }
+        size_t slot = FreeSlot(hash);
+        hashes[slot] = hash;
+        entries[slot].key.assign(key);
+        entries[slot].value = std::move(value);
+        Link(slot);
+        ++size;
+      }
+
+      template<typename TFunc>
+      auto Modify(std::string_view key, uint64_t hash, TFunc&& func) {
+        size_t slot = FindSlot(key, hash);
+        std::optional<TValue> value;
+        if (slot != NotFound) {
+          value = std::move(entries[slot].value);
+        }
+        if constexpr (std::is_void_v<std::invoke_result_t<TFunc, std::optional<TValue>&>>) {
+          std::forward<TFunc>(func)(value);
+          Store(key, hash, slot, std::move(value));
+        } else {
+          auto result = std::forward<TFunc>(func)(value);
+          Store(key, hash, slot, std::move(value));
+          return result;
+        }
+      }
+
+      // The entries of a group are anywhere in the shard, their chain goes through them without looking at the others
+      template<typename TFunc>
+      void ForEachInGroup(uint64_t hash, TFunc& func) const {
+        auto head = groupHeads.find(GroupOf(hash));
+        for (size_t i = head == groupHeads.end() ? NotFound : head->second; i != NotFound; i = links[i].next) {
+          func(std::string_view(entries[i].key), entries[i].value);
+        }
+      }
+
+      // slot is where key currently is, NotFound if absent
+      void Store(std::string_view key, uint64_t hash, size_t slot, std::optional<TValue>&& value) {
+        if (value) {
+          if (slot != NotFound) {
+            entries[slot].value = std::move(*value);
+          } else {
+            Insert(key, hash, std::move(*value));
+          }
+        } else if (slot != NotFound) {
+          EraseSlot(slot);
+        }
+      }
+
+      void EraseSlot(size_t slot) {
+        Unlink(slot);
+        size_t mask = hashes.size() - 1;
+        // Shift back the following entries of the cluster that would no longer be reachable
+        for (size_t next = (slot + 1) & mask; hashes[next]; next = (next + 1) & mask) {
+          size_t ideal = hashes[next] & mask;
+          bool reachable = slot <= next ? (slot < ideal && ideal <= next) : (slot < ideal || ideal <= next);
+          if (reachable) {
+            continue;
+          }
+          hashes[slot] = hashes[next];
+          entries[slot] = std::move(entries[next]);
+          MoveLinks(next, slot);
+          slot = next;
+        }
+        hashes[slot] = 0;
+        entries[slot] = Entry{};
+        --size;
+      }
+
+      void Reserve(size_t count) {
+        size_t capacity = std::max(MinCapacity, std::bit_ceil(count * 4 / 3 + 1));
+        if (capacity <= hashes.size()) {
+          return;
+        }
+        std::vector<uint64_t> oldHashes(capacity, 0);
+        std::vector<Entry> oldEntries(capacity);
+        oldHashes.swap(hashes);
+        oldEntries.swap(entries);
+        if constexpr (Grouping) {
+          // The chains are rebuilt as the entries are moved over
+          links.assign(capacity, Links{});
+          groupHeads.clear();
+        }
+        for (size_t i = 0; i < oldHashes.size(); ++i) {
+          if (oldHashes[i]) {
+            size_t slot = FreeSlot(oldHashes[i]);
+            hashes[slot] = oldHashes[i];
+            entries[slot] = std::move(oldEntries[i]);
+            Link(slot);
+          }
+        }
+      }
+
+      // Puts the entry at slot first in its group's chain
+      void Link(size_t slot) {
+        if constexpr (Grouping) {
+          auto [head, inserted] = groupHeads.try_emplace(GroupOf(hashes[slot]), slot);
+          links[slot] = Links{ NotFound, inserted ? NotFound : head->second };
+          if (!inserted) {
+            links[head->second].prev = slot;
+            head->second = slot;
+          }
+        }
+      }
+
+      void Unlink(size_t slot) {
+        if constexpr (Grouping) {
+          Links removed = links[slot];
+          if (removed.prev != NotFound) {
+            links[removed.prev].next = removed.next;
+          } else if (removed.next != NotFound) {
+            groupHeads[GroupOf(hashes[slot])] = removed.next;
+          } else {
+            groupHeads.erase(GroupOf(hashes[slot]));
+          }
+          if (removed.next != NotFound) {
+            links[removed.next].prev = removed.prev;
+          }
+        }
+      }
+
+      // The entry at from was moved to the free slot to, its neighbours now point there
+      void MoveLinks(size_t from, size_t to) {
+        if constexpr (Grouping) {
+          Links moved = links[from];
+          links[to] = moved;
+          if (moved.prev != NotFound) {
+            links[moved.prev].next = to;
+          } else {
+            groupHeads[GroupOf(hashes[to])] = to;
+          }
+          if (moved.next != NotFound) {
+            links[moved.next].prev = to;
+          }
+        }
+      }
+
+      size_t FreeSlot(uint64_t hash) const {
+        size_t mask = hashes.size() - 1;
+        size_t i = hash & mask;
+        while (hashes[i]) {
+          i = (i + 1) & mask;
+        }
+        return i;
+      }
+    };
+
+    static uint64_t HashKey(std::string_view key) {
+      uint64_t hash = static_cast<uint64_t>(THash{}(key));
+      return hash ? hash : 1;
+    }
+
+    static uint32_t GroupOf(uint64_t hash) { return static_cast<uint32_t>(hash >> 32); }
+    static bool SameGroup(uint64_t lhs, uint64_t rhs) { return GroupOf(lhs) == GroupOf(rhs); }
+
+    // The low bits pick the slot, the shard comes from the high ones so that both stay independent
+    size_t ShardIndex(uint64_t hash) const { return (hash >> 32) & m_shardMask; }
+    Shard& ShardFor(uint64_t hash) { return m_shards[ShardIndex(hash)]; }
+    const Shard& ShardFor(uint64_t hash) const { return m_shards[ShardIndex(hash)]; }
+
+    size_t m_shardMask;
+    std::unique_ptr<Shard[]> m_shards;
+  };
+
+}